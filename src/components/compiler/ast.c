@@ -86,6 +86,7 @@ static t_ast_element *ast_alloc_element(void) {
         yyerror("Out of memory");   /* LCOV_EXCL_LINE */
     }
     p->lineno = yylineno;
+    p->cache = NULL;
 
     return p;
 }
@@ -99,6 +100,7 @@ t_ast_element *ast_string(char *value) {
 
     p->type = typeAstString;
     p->string.value = smm_strdup(value);
+    p->string.object = NULL;
 
     return p;
 }
@@ -112,6 +114,7 @@ t_ast_element *ast_numerical(int value) {
 
     p->type = typeAstNumerical;
     p->numerical.value = value;
+    p->numerical.object = NULL;
 
     return p;
 }
@@ -125,6 +128,9 @@ t_ast_element *ast_identifier(char *var_name) {
 
     p->type = typeAstIdentifier;
     p->identifier.name = smm_strdup(var_name);
+    p->identifier.context = NULL;
+    p->identifier.slot = 0;
+    p->identifier.object = NULL;
 
     return p;
 }
@@ -339,6 +345,7 @@ void ast_free_node(t_ast_element *p) {
             }
             break;
     }
+    if (p->cache) smm_free(p->cache);
     smm_free(p);
 }
 
@@ -24,347 +24,624 @@
  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-#include <sys/stat.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "compiler/bytecode.h"
-#include "compiler/ast.h"
-#include "general/dll.h"
-#include "general/smm.h"
-#include "version.h"
+#include "vm/jit.h"
 #include "vm/vm_opcodes.h"
+#include "general/crc32.h"
+#include "general/md5.h"
+#include "general/smm.h"
+
+// Maximum nesting of code objects inside a bytecode file
+#define BYTECODE_MAX_DEPTH  64
 
-//
-///**
-// * Check if a constant already is present inside the bytecode structure
-// */
-//static int _bytecode_constant_exists(t_bytecode *bc, int type, void *value) {
-//    t_dll_element *e = DLL_HEAD(bc->constants_dll);
-//    long l;
-//
-//    while (e) {
-//        t_bytecode_constant *constant = e->data;
-//        if (constant->hdr.type == type) {
-//            switch (constant->hdr.type) {
-//                case BYTECODE_CONST_NULL :
-//                    return 1;
-//                    break;
-//                case BYTECODE_CONST_STRING :
-//                    if (strcmp(constant->data.s, value) == 0) return 1;
-//                    break;
-//                case BYTECODE_CONST_NUMERICAL :
-//                    printf("Checking %d against %d\n", constant->data.l, (long)value);
-//                    if (constant->data.l == (long)value) return 1;
-//                    break;
-//                case BYTECODE_CONST_BOOLEAN :
-//                    if (constant->data.l == (long)value) return 1;
-//                    break;
-//                case BYTECODE_CONST_REGEX :
-//                    break;
-//            }
-//        }
-//        e = DLL_NEXT(e);
-//    }
-//
-//    return 0;
-//}
-//
-///**
-// * Parse the AST and add all constants
-// */
-//static void _bytecode_parse_constants(t_ast_element *p, t_bytecode *bc) {
-//    t_bytecode_constant *constant = NULL;
-//    if (!p) return;
-//
-//    switch (p->type) {
-////        case typeAstString :
-////            printf("STRING: '%s'\n", p->string.value);
-////            if (! _bytecode_constant_exists(bc, BYTECODE_CONST_STRING, p->string.value)) {
-////                constant = (t_bytecode_constant *)smm_malloc(sizeof(t_bytecode_constant));
-////                constant->hdr.type = BYTECODE_CONST_STRING;
-////                constant->hdr.length = strlen(p->string.value);
-////                constant->data.s = smm_strdup(p->string.value);
-////                dll_append(bc->constant_dll, constant);
-////            }
-////            break;
-////        case typeAstNumerical :
-////            if (! _bytecode_constant_exists(bc, BYTECODE_CONST_NUMERICAL, (void *)p->numerical.value)) {
-////                constant = (t_bytecode_constant *)smm_malloc(sizeof(t_bytecode_constant));
-////                constant->hdr.type = BYTECODE_CONST_NUMERICAL;
-////                constant->hdr.length = sizeof(long);
-////                constant->data.l = p->numerical.value;
-////                dll_append(bc->constant_dll, constant);
-////            }
-////            break;
-////        case typeAstIdentifier :
-////            if (p->string.value[0] == '$') break;
-////            printf("IDENT: '%s'\n", p->string.value);
-////            if (! _bytecode_constant_exists(bc, BYTECODE_CONST_STRING, p->identifier.name)) {
-////                constant = (t_bytecode_constant *)smm_malloc(sizeof(t_bytecode_constant));
-////                constant->hdr.type = BYTECODE_CONST_STRING;
-////                constant->hdr.length = strlen(p->identifier.name);
-////                constant->data.s = smm_strdup(p->identifier.name);
-////                dll_append(bc->constant_dll, constant);
-////            }
-////            break;
-////        case typeNull :
-////            if (! _bytecode_constant_exists(bc, BYTECODE_CONST_NULL, NULL)) {
-////                constant = (t_bytecode_constant *)smm_malloc(sizeof(t_bytecode_constant));
-////                constant->hdr.type = BYTECODE_CONST_NULL;
-////                constant->hdr.length = 0;
-////                constant->data.l = 0;
-////                dll_append(bc->constant_dll, constant);
-////            }
-////            break;
-////        case typeOpr :
-////            // Plot all the operands
-////            for (int i=0; i!=p->opr.nops; i++) {
-////                _bytecode_parse_constants(p->opr.ops[i], bc);
-////            }
-////            break;
-////        case typeInterface :
-////            _bytecode_parse_constants(p->interface.implements, bc);
-////            _bytecode_parse_constants(p->interface.body, bc);
-////            break;
-////        case typeClass :
-////            _bytecode_parse_constants(p->class.extends, bc);
-////            _bytecode_parse_constants(p->class.implements, bc);
-////            _bytecode_parse_constants(p->class.body, bc);
-////            break;
-////        case typeMethod:
-////            _bytecode_parse_constants(p->method.arguments, bc);
-////            _bytecode_parse_constants(p->method.body, bc);
-////            break;
-//        default :
-//            printf("Unknown type!");
-//            exit(1);
-//            break;
-//    }
-//}
-//
-//
-///**
-// * Returns the length of byte from a (filled) bytecode structure.
-// */
-//static long bytecode_calculate_length(t_bytecode *bc) {
-//    t_dll_element *e;
-//    long len = sizeof(t_bytecode_header);
-//
-//    // Calculate and add constant lengths
-//    if (bc->constant_dll) {
-//        e = DLL_HEAD(bc->constant_dll);
-//        for (int i=0; i!=bc->constant_dll->size; i++) {
-//            t_bytecode_constant *constant = e->data;
-//            len += sizeof(t_bytecode_constant_header) + constant->hdr.length;
-//            e = DLL_NEXT(e);
-//        }
-//    }
-//
-//    // Calculate and add class lengths
-//    if (bc->class_dll) {
-//        e = DLL_HEAD(bc->class_dll);
-//        for (int i=0; i!=bc->class_dll->size; i++) {
-//            t_bytecode_constant *constant = e->data;
-//            len += sizeof(t_bytecode_constant_header) + constant->hdr.length;
-//            e = DLL_NEXT(e);
-//        }
-//    }
-//
-//    return len;
-//}
-//
-///**
-// *
-// */
-//static void bytecode_generate_buffer(t_bytecode *bc) {
-//    t_dll_element *e;
-//    int bufpos = 0;
-//
-//    // Create our binary bytecode buffer
-//    bc->length = bytecode_calculate_length(bc);
-//    bc->buffer = (char *)smm_malloc(bc->length);
-//
-//    // Skip the header. We still need to fill some vars first
-//    bufpos = sizeof(t_bytecode_header);
-//
-//    printf("CDS: %d\n", bc->constant_dll->size);
-//    printf("CDO: %08X (%d)\n", bufpos, bufpos);
-//
-//    // Add constant header vars
-//    bc->header->constant_count = bc->constant_dll->size;
-//    bc->header->constant_offset = bufpos;
-//
-//    // Add all constant entries
-//    e = DLL_HEAD(bc->constant_dll);
-//    for (int i=0; i!=bc->constant_dll->size; i++) {
-//        t_bytecode_constant *constant = e->data;
-//
-//        // Save header
-//        memcpy(bc->buffer+bufpos, &constant->hdr, sizeof(t_bytecode_constant_header));
-//        bufpos += sizeof(t_bytecode_constant_header);
-//
-//        // Save additional data
-//        if (constant->hdr.length) {
-//            if (constant->hdr.type == BYTECODE_CONST_STRING || constant->hdr.type == BYTECODE_CONST_REGEX) {
-//                memcpy(bc->buffer+bufpos, constant->data.s, constant->hdr.length);
-//            } else {
-//                memcpy(bc->buffer+bufpos, &constant->data.l, constant->hdr.length);
-//            }
-//            bufpos += constant->hdr.length;
-//        }
-//
-//        e = DLL_NEXT(e);
-//    }
-//
-//
-//    // Add class header vars
-//    bc->header->class_count = 0x0;
-//    bc->header->class_offset = bufpos;
-//
-//    // Add all constant entries
-//    e = DLL_HEAD(bc->class_dll);
-//    // @TODO: fill this
-//
-//    // Finally, go back and fill the header.
-//    bufpos = 0;
-//    memcpy(bc->buffer+bufpos, bc->header, sizeof(t_bytecode_header));
-//}
-//
-//
-//
-///**
-// * Allocate the bytecode structure
-// */
-//static t_bytecode *bytecode_structure_alloc(void) {
-//    t_bytecode *bc = (t_bytecode *)smm_malloc(sizeof(t_bytecode));
-//
-//    bc->length = 0;
-//    bc->header = (t_bytecode_header *)smm_malloc(sizeof(t_bytecode_header));
-//    bc->constant_dll = dll_init();
-//    bc->class_dll = dll_init();
-//
-//    memset(bc->header, 0, sizeof(t_bytecode_header));
-//
-//    return bc;
-//}
-//
-//
-///**
-// * Release the bytecode structure
-// */
-//void bytecode_free(t_bytecode *bc) {
-//    dll_free(bc->class_dll);
-//    dll_free(bc->constant_dll);
-//    smm_free(bc->header);
-//    smm_free(bc);
-//}
-//
-//
-///**
-// * Generate a complete binary bytecode buffer from an AST.
-// */
-//t_bytecode *bytecode_generate(t_ast_element *p, char *source_file) {
-//    t_bytecode *bc = bytecode_structure_alloc();
-//
-//    // Fetch modification time from source file and fill into header
-//    struct stat sb;
-//    if (! stat(source_file, &sb)) {
-//        bc->header->timestamp = sb.st_mtime;
-//    }
-//    bc->header->magic = MAGIC_HEADER;
-//    bc->header->version = saffire_version_binary;
-//
-//
-//    _bytecode_parse_constants(p, bc);
-//    //_bytecode_parse_classes(p, bc);
-//
-//    bytecode_generate_buffer(bc);
-//    return bc;
-//}
-//
-//
-//char *bytecode_generate_destfile(const char *src) {
-//    printf("SRC: '%s'\n", src);
-//    char *dst = (char *)smm_malloc(strlen(src)+2);
-//    memset(dst, 0, strlen(src)+2);
-//    strcpy(dst,src);
-//    dst[strlen(dst)] = 'c'; // Add extra c to create *.sfc
-//
-//    printf("DST: '%s'\n", dst);
-//    return dst;
-//}
+typedef struct _bytecode_buffer {
+    char *data;         // Buffer data
+    long len;           // Used length
+    long size;          // Allocated size
+} t_bytecode_buffer;
 
 
+/**
+ * Allocate an empty bytecode structure
+ */
+t_bytecode *bytecode_new(void) {
+    t_bytecode *bc = (t_bytecode *)smm_malloc(sizeof(t_bytecode));
+    memset(bc, 0, sizeof(t_bytecode));
+
+    return bc;
+}
 
 
 /**
- * Add a new constant to the bytecode structure
+ * Add a new constant to the bytecode structure, or return the index of an equal constant that is already
+ * present. Strings are copied.
  */
-static void _new_constant(t_bytecode *bc, int type, int len, void *data) {
+int bytecode_add_constant(t_bytecode *bc, int type, int len, void *data) {
+    for (int i=0; i!=bc->constants_len; i++) {
+        t_bytecode_constant *c = bc->constants[i];
+        if (c->type != type) continue;
+
+        switch (type) {
+            case BYTECODE_CONST_NULL :
+                return i;
+            case BYTECODE_CONST_STRING :
+                if (strcmp(c->data.s, (char *)data) == 0) return i;
+                break;
+            case BYTECODE_CONST_NUMERICAL :
+            case BYTECODE_CONST_BOOLEAN :
+                if (c->data.l == (long)data) return i;
+                break;
+        }
+    }
+
     t_bytecode_constant *c = smm_malloc(sizeof(t_bytecode_constant));
     c->type = type;
     c->len = len;
-    c->data.ptr = (void *)data;
+    c->object = NULL;
+    if (type == BYTECODE_CONST_STRING) {
+        c->data.s = smm_strdup((char *)data);
+    } else {
+        c->data.ptr = data;
+    }
 
     bc->constants = smm_realloc(bc->constants, sizeof(t_bytecode_constant *) * (bc->constants_len + 1));
     bc->constants[bc->constants_len] = c;
-    bc->constants_len++;
+    return bc->constants_len++;
 }
 
+
 /**
- * Add a new variable to the bytecode structure
+ * Add a new variable to the bytecode structure, or return the index of the variable when it is already present.
  */
-static void _new_variable(t_bytecode *bc, char *var) {
+int bytecode_add_variable(t_bytecode *bc, const char *var) {
+    for (int i=0; i!=bc->variables_len; i++) {
+        if (strcmp(bc->variables[i]->s, var) == 0) return i;
+    }
+
     t_bytecode_variable *c = smm_malloc(sizeof(t_bytecode_variable));
     c->len = strlen(var);
-    c->s = var;
+    c->s = smm_strdup(var);
 
     bc->variables = smm_realloc(bc->variables, sizeof(t_bytecode_variable *) * (bc->variables_len + 1));
     bc->variables[bc->variables_len] = c;
-    bc->variables_len++;
+    return bc->variables_len++;
 }
 
 
 /**
- * Create dummy bytecode instance
- * @TODO remove me
+ * Add an entry to the exception table. Entries must be added innermost first.
  */
-t_bytecode *generate_dummy_bytecode(void) {
-    char dummy_code[] =
-                        "\x64\x00\x00\x00\x00"      // LOAD_CONST   0 (0x1234)
-                        "\x5a\x00\x00\x00\x00"      // STORE_VAR    0 (a)
-                        "\x64\x01\x00\x00\x00"      // LOAD_CONST   1 (0x5678)
-                        "\x5a\x01\x00\x00\x00"      // STORE_VAR    1 (b)
-                        "\x65\x00\x00\x00\x00"      // LOAD_VAR     0 (a)
-                        "\x59"                      // PRINT_VAR
-                        "\x65\x01\x00\x00\x00"      // LOAD_VAR     1 (b)
-                        "\x59"                      // PRINT_VAR
-                        "\x65\x00\x00\x00\x00"      // LOAD_VAR     0 (a)
-                        "\x65\x01\x00\x00\x00"      // LOAD_VAR     1 (b)
-                        "\x02"                      // ROT_TWO
-                        "\x5a\x00\x00\x00\x00"      // STORE_VAR    0 (a)
-                        "\x5a\x01\x00\x00\x00"      // STORE_VAR    1 (b)
-                        "\x65\x00\x00\x00\x00"      // LOAD_VAR     0 (a)
-                        "\x59"                      // PRINT_VAR
-                        "\x65\x01\x00\x00\x00"      // LOAD_VAR     1 (b)
-                        "\x59"                      // PRINT_VAR
-                        "\x00"                      // STOP
-                       ;
+int bytecode_add_handler(t_bytecode *bc, int start, int end, int handler, int stack_level) {
+    bc->handlers = smm_realloc(bc->handlers, sizeof(t_bytecode_handler) * (bc->handlers_len + 1));
 
-    t_bytecode *bc = (t_bytecode *)smm_malloc(sizeof(t_bytecode));
-    bc->stack_size = 10;
-    bc->code_len = sizeof(dummy_code);
-    bc->code = smm_malloc(bc->code_len);
-    memcpy(bc->code, dummy_code, bc->code_len);
+    t_bytecode_handler *h = &bc->handlers[bc->handlers_len];
+    h->start = start;
+    h->end = end;
+    h->handler = handler;
+    h->stack_level = stack_level;
+    return bc->handlers_len++;
+}
+
+
+/**
+ * Replaces the line table. Entry i of the arrays says that the code from offsets[i] onwards was generated from
+ * source line lines[i], and offsets must be ascending. When an offset is found more than once, the last entry
+ * wins. Entries are stored as an offset delta and a (zigzag encoded) line delta, both in the same LEB128
+ * encoding as the operands, so most entries take two bytes.
+ */
+void bytecode_set_lines(t_bytecode *bc, const int *offsets, const int *lines, int count) {
+    unsigned char *buf = smm_malloc(count * 2 * OPERAND_MAX_SIZE + 1);
+    int len = 0, last_offset = 0, last_line = 0;
+
+    for (int i=0; i!=count; i++) {
+        if (i + 1 != count && offsets[i + 1] == offsets[i]) continue;
+        if (lines[i] == last_line) continue;
+
+        int delta = lines[i] - last_line;
+        len += vm_encode_operand(buf + len, offsets[i] - last_offset, 0);
+        len += vm_encode_operand(buf + len, ((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31), 0);
+        last_offset = offsets[i];
+        last_line = lines[i];
+    }
+
+    if (bc->lines && ! bc->map) smm_free(bc->lines);
+    bc->lines_len = len;
+    if (len) {
+        bc->lines = smm_realloc(buf, len);
+    } else {
+        bc->lines = NULL;
+        smm_free(buf);
+    }
+}
+
+
+/**
+ * Reads a single value of the line table. Returns 0 when the table ends before the value does.
+ */
+static int _read_line_value(const unsigned char **p, const unsigned char *end, unsigned int *value) {
+    int shift = 0;
+
+    *value = 0;
+    while (*p < end && shift < 7 * OPERAND_MAX_SIZE) {
+        unsigned char b = *(*p)++;
+        *value |= (unsigned int)(b & 0x7F) << shift;
+        if (! (b & 0x80)) return 1;
+        shift += 7;
+    }
+    return 0;
+}
+
+
+/**
+ * Reads the next entry of the line table into offset and line, which hold the previous entry. Returns 0 at the
+ * end of the table.
+ */
+static int _next_line(const unsigned char **p, const unsigned char *end, int *offset, int *line) {
+    unsigned int offset_delta, line_delta;
+
+    if (! _read_line_value(p, end, &offset_delta) || ! _read_line_value(p, end, &line_delta)) return 0;
+
+    *offset += offset_delta;
+    *line += (int)(line_delta >> 1) ^ -(int)(line_delta & 1);
+    return 1;
+}
+
+
+/**
+ * Decodes the line table into (allocated) arrays of offsets and lines. Returns the number of entries.
+ */
+int bytecode_get_lines(t_bytecode *bc, int **offsets, int **lines) {
+    const unsigned char *p = bc->lines;
+    const unsigned char *end = bc->lines + bc->lines_len;
+    int offset = 0, line = 0, count = 0;
+
+    // Every entry takes at least two bytes
+    *offsets = smm_malloc((bc->lines_len / 2 + 1) * sizeof(int));
+    *lines = smm_malloc((bc->lines_len / 2 + 1) * sizeof(int));
+
+    while (_next_line(&p, end, &offset, &line)) {
+        (*offsets)[count] = offset;
+        (*lines)[count] = line;
+        count++;
+    }
+
+    return count;
+}
+
+
+/**
+ * Returns the source line of the instruction at the code offset, or 0 when it is not known. This decodes the
+ * line table, so it is meant for errors and backtraces only.
+ */
+int bytecode_lineno(t_bytecode *bc, int offset) {
+    const unsigned char *p = bc->lines;
+    const unsigned char *end = bc->lines + bc->lines_len;
+    int entry_offset = 0, entry_line = 0, line = 0;
+
+    while (_next_line(&p, end, &entry_offset, &entry_line) && entry_offset <= offset) {
+        line = entry_line;
+    }
+
+    return line;
+}
+
+
+/**
+ * Release the bytecode structure, including all nested code constants. Code and strings of mapped bytecode
+ * live inside the mapping and are not freed separately.
+ */
+void bytecode_free(t_bytecode *bc) {
+    if (! bc) return;
+
+    for (int i=0; i!=bc->constants_len; i++) {
+        t_bytecode_constant *c = bc->constants[i];
+        if (c->type == BYTECODE_CONST_STRING && ! bc->map) smm_free(c->data.s);
+        if (c->type == BYTECODE_CONST_CODE) bytecode_free(c->data.code);
+        smm_free(c);
+    }
+    if (bc->constants) smm_free(bc->constants);
+
+    for (int i=0; i!=bc->variables_len; i++) {
+        if (! bc->map) smm_free(bc->variables[i]->s);
+        smm_free(bc->variables[i]);
+    }
+    if (bc->variables) smm_free(bc->variables);
+
+    if (bc->handlers) smm_free(bc->handlers);
+    if (bc->lines && ! bc->map) smm_free(bc->lines);
+
+    if (bc->jit) jit_free(bc->jit);
+
+    if (bc->caches) {
+        for (int i=0; i<=bc->code_len; i++) {
+            if (bc->caches[i]) smm_free(bc->caches[i]);
+        }
+        smm_free(bc->caches);
+    }
+
+    if (bc->code && ! bc->map) smm_free(bc->code);
+    if (bc->map_len) munmap(bc->map, bc->map_len);
+    smm_free(bc);
+}
+
+
+/**
+ * Returns the name of the bytecode file for a source file (foo.sf becomes foo.sfc)
+ */
+char *bytecode_generate_destfile(const char *src) {
+    char *dst = (char *)smm_malloc(strlen(src)+2);
+    strcpy(dst, src);
+    strcat(dst, "c");
+    return dst;
+}
+
+
+/**
+ * Returns the name of the cached bytecode file for a source file. Its name is derived from the absolute path
+ * of the source, so equally named scripts in different directories do not collide.
+ */
+char *bytecode_generate_cachefile(const char *cache_dir, const char *source_file) {
+    md5_state_t state;
+    md5_byte_t hash[16];
+
+    char *path = realpath(source_file, NULL);
+    const char *key = path ? path : source_file;
+
+    md5_init(&state);
+    md5_append(&state, (const md5_byte_t *)key, strlen(key));
+    md5_finish(&state, hash);
+    if (path) free(path);
+
+    char *dst = (char *)smm_malloc(strlen(cache_dir) + 1 + 32 + 4 + 1);
+    char *p = dst + sprintf(dst, "%s/", cache_dir);
+    for (int i=0; i!=16; i++) {
+        p += sprintf(p, "%02x", hash[i]);
+    }
+    strcpy(p, ".sfc");
+
+    return dst;
+}
+
+
+/**
+ * Fetches the modification time and CRC of a source file. Returns 1 on success, 0 when the file cannot be read.
+ * Callers take the stamp before the source is parsed, so a file that changes while it gets compiled never ends up
+ * with the stamp of its new version.
+ */
+int bytecode_source_stamp(const char *source_file, t_bytecode_source_stamp *stamp) {
+    struct stat sb;
+
+    if (stat(source_file, &sb) == -1) return 0;
+    stamp->timestamp = sb.st_mtime;
+    return crc32_file(source_file, &stamp->crc);
+}
+
+
+/**
+ * Returns 1 when the (mapped) bytecode was compiled from the version of the source file in the stamp.
+ */
+int bytecode_is_current(t_bytecode *bc, t_bytecode_source_stamp *stamp) {
+    t_bytecode_binary_header header;
+
+    if (! bc->map) return 0;
+    memcpy(&header, bc->map, sizeof(header));
+
+    return (header.timestamp == stamp->timestamp && header.crc == stamp->crc);
+}
+
+
+/**
+ * Reserves (zeroed) room inside the buffer. Everything is 4-byte aligned. Returns the offset of the room.
+ */
+static long _buffer_reserve(t_bytecode_buffer *buf, long len) {
+    long offset = (buf->len + 3) & ~3;
+
+    if (offset + len > buf->size) {
+        buf->size = (offset + len) * 2;
+        buf->data = smm_realloc(buf->data, buf->size);
+    }
+    memset(buf->data + buf->len, 0, offset + len - buf->len);
+    buf->len = offset + len;
+
+    return offset;
+}
+
+
+/**
+ * Adds data to the buffer. Returns the offset of the data.
+ */
+static long _buffer_write(t_bytecode_buffer *buf, const void *data, long len) {
+    long offset = _buffer_reserve(buf, len);
+    memcpy(buf->data + offset, data, len);
+    return offset;
+}
+
+
+/**
+ * Writes a code object and all the code objects inside it into the buffer. Returns the offset of the code object.
+ */
+static long _bytecode_write_code(t_bytecode_buffer *buf, t_bytecode *bc) {
+    t_bytecode_binary_code code;
+    t_bytecode_binary_constant constant;
+    t_bytecode_binary_variable variable;
+    t_bytecode_binary_handler handler;
+
+    long offset = _buffer_reserve(buf, sizeof(t_bytecode_binary_code));
+
+    code.stack_size = bc->stack_size;
+    code.code_len = bc->code_len;
+    code.code_offset = _buffer_write(buf, bc->code, bc->code_len);
+
+    code.handlers_len = bc->handlers_len;
+    code.handlers_offset = _buffer_reserve(buf, bc->handlers_len * sizeof(t_bytecode_binary_handler));
+    for (int i=0; i!=bc->handlers_len; i++) {
+        handler.start = bc->handlers[i].start;
+        handler.end = bc->handlers[i].end;
+        handler.handler = bc->handlers[i].handler;
+        handler.stack_level = bc->handlers[i].stack_level;
+        memcpy(buf->data + code.handlers_offset + i * sizeof(t_bytecode_binary_handler), &handler, sizeof(handler));
+    }
+
+    code.lines_len = bc->lines_len;
+    code.lines_offset = _buffer_write(buf, bc->lines, bc->lines_len);
+
+    code.constants_len = bc->constants_len;
+    code.constants_offset = _buffer_reserve(buf, bc->constants_len * sizeof(t_bytecode_binary_constant));
+    code.variables_len = bc->variables_len;
+    code.variables_offset = _buffer_reserve(buf, bc->variables_len * sizeof(t_bytecode_binary_variable));
+
+    for (int i=0; i!=bc->variables_len; i++) {
+        variable.len = bc->variables[i]->len;
+        variable.offset = _buffer_write(buf, bc->variables[i]->s, variable.len + 1);
+        memcpy(buf->data + code.variables_offset + i * sizeof(t_bytecode_binary_variable), &variable, sizeof(variable));
+    }
+
+    for (int i=0; i!=bc->constants_len; i++) {
+        t_bytecode_constant *c = bc->constants[i];
+
+        constant.type = c->type;
+        constant.len = c->len;
+        switch (c->type) {
+            case BYTECODE_CONST_STRING :
+                constant.value = _buffer_write(buf, c->data.s, c->len + 1);
+                break;
+            case BYTECODE_CONST_CODE :
+                constant.value = _bytecode_write_code(buf, c->data.code);
+                break;
+            case BYTECODE_CONST_NULL :
+                constant.value = 0;
+                break;
+            default :
+                constant.value = c->data.l;
+                break;
+        }
+        memcpy(buf->data + code.constants_offset + i * sizeof(t_bytecode_binary_constant), &constant, sizeof(constant));
+    }
+
+    memcpy(buf->data + offset, &code, sizeof(code));
+    return offset;
+}
+
+
+/**
+ * Saves bytecode into a .sfc file. The stamp is the version of the source file the bytecode was compiled from, or
+ * NULL when unknown. Returns 1 on success, 0 on failure.
+ */
+int bytecode_save(const char *dest_file, t_bytecode_source_stamp *stamp, t_bytecode *bc) {
+    t_bytecode_binary_header header;
+    t_bytecode_buffer buf = { NULL, 0, 0 };
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC_HEADER;
+    header.version = BYTECODE_VERSION;
+
+    if (stamp) {
+        header.timestamp = stamp->timestamp;
+        header.crc = stamp->crc;
+    }
+
+    _buffer_reserve(&buf, sizeof(t_bytecode_binary_header));
+    header.code_offset = _bytecode_write_code(&buf, bc);
+    header.length = buf.len;
+    memcpy(buf.data, &header, sizeof(header));
+
+    // Write into a temporary file first and rename it, so readers never see a partially written file
+    char *tmp_file = (char *)smm_malloc(strlen(dest_file) + 8);
+    sprintf(tmp_file, "%s.XXXXXX", dest_file);
+
+    int ret = 0;
+    int fd = mkstemp(tmp_file);
+    if (fd != -1) {
+        FILE *f = fdopen(fd, "wb");
+        if (f) {
+            fchmod(fd, 0644);
+            ret = (fwrite(buf.data, 1, buf.len, f) == (size_t)buf.len);
+            ret = (fclose(f) == 0) && ret;
+        } else {
+            close(fd);
+        }
+
+        if (ret && rename(tmp_file, dest_file) == 0) {
+            ret = 1;
+        } else {
+            unlink(tmp_file);
+            ret = 0;
+        }
+    }
+
+    smm_free(tmp_file);
+    smm_free(buf.data);
+    return ret;
+}
+
+
+/**
+ * Returns 1 when [offset, offset+len) is found inside the map
+ */
+static int _in_map(long map_len, uint64_t offset, uint64_t len) {
+    return offset <= (uint64_t)map_len && len <= (uint64_t)map_len - offset;
+}
+
+
+/**
+ * Returns a \0 terminated string of len bytes from the map, or NULL when it is not inside the map
+ */
+static char *_map_string(char *map, long map_len, uint64_t offset, uint32_t len) {
+    if (! _in_map(map_len, offset, (uint64_t)len + 1) || map[offset + len] != '\0') return NULL;
+    return map + offset;
+}
+
+
+/**
+ * Creates a bytecode structure for the code object at the offset. The code and strings are used in place,
+ * only the constant and variable tables are allocated. Returns NULL when the code object is invalid.
+ *
+ * Code objects are written in the order they are loaded, each one after the one before. A code object must
+ * therefore lie after the last loaded code object (last_offset), so no code object is loaded twice.
+ */
+static t_bytecode *_bytecode_load_code(char *map, long map_len, uint64_t offset, int depth, uint64_t *last_offset) {
+    t_bytecode_binary_code code;
+    t_bytecode_binary_constant constant;
+    t_bytecode_binary_variable variable;
+    t_bytecode_binary_handler handler;
+
+    if (depth > BYTECODE_MAX_DEPTH) return NULL;
+    if (offset <= *last_offset) return NULL;
+    if (! _in_map(map_len, offset, sizeof(code))) return NULL;
+    *last_offset = offset;
+    memcpy(&code, map + offset, sizeof(code));
+
+    if (! _in_map(map_len, code.code_offset, code.code_len)) return NULL;
+    if (! _in_map(map_len, code.constants_offset, (uint64_t)code.constants_len * sizeof(constant))) return NULL;
+    if (! _in_map(map_len, code.variables_offset, (uint64_t)code.variables_len * sizeof(variable))) return NULL;
+    if (! _in_map(map_len, code.handlers_offset, (uint64_t)code.handlers_len * sizeof(handler))) return NULL;
+    if (! _in_map(map_len, code.lines_offset, code.lines_len)) return NULL;
+
+    t_bytecode *bc = bytecode_new();
+    bc->map = map;
+    bc->stack_size = code.stack_size;
+    bc->code_len = code.code_len;
+    bc->code = map + code.code_offset;
+
+    // A damaged line table only gives wrong line numbers, it is read with bounds checks
+    bc->lines_len = code.lines_len;
+    bc->lines = code.lines_len ? (unsigned char *)map + code.lines_offset : NULL;
+
+    // The verifier checks the entries themselves
+    if (code.handlers_len) {
+        bc->handlers = smm_malloc(code.handlers_len * sizeof(t_bytecode_handler));
+        for (int i=0; i!=code.handlers_len; i++) {
+            memcpy(&handler, map + code.handlers_offset + i * sizeof(handler), sizeof(handler));
+            bc->handlers[i].start = handler.start;
+            bc->handlers[i].end = handler.end;
+            bc->handlers[i].handler = handler.handler;
+            bc->handlers[i].stack_level = handler.stack_level;
+        }
+        bc->handlers_len = code.handlers_len;
+    }
+
+    bc->variables = smm_malloc(code.variables_len * sizeof(t_bytecode_variable *));
+    for (int i=0; i!=code.variables_len; i++) {
+        memcpy(&variable, map + code.variables_offset + i * sizeof(variable), sizeof(variable));
+
+        char *s = _map_string(map, map_len, variable.offset, variable.len);
+        if (! s) goto error;
+
+        bc->variables[i] = smm_malloc(sizeof(t_bytecode_variable));
+        bc->variables[i]->len = variable.len;
+        bc->variables[i]->s = s;
+        bc->variables_len++;
+    }
+
+    bc->constants = smm_malloc(code.constants_len * sizeof(t_bytecode_constant *));
+    for (int i=0; i!=code.constants_len; i++) {
+        memcpy(&constant, map + code.constants_offset + i * sizeof(constant), sizeof(constant));
+
+        t_bytecode_constant *c = smm_malloc(sizeof(t_bytecode_constant));
+        c->type = constant.type;
+        c->len = constant.len;
+        c->object = NULL;
+        bc->constants[i] = c;
+        bc->constants_len++;
+
+        switch (constant.type) {
+            case BYTECODE_CONST_STRING :
+                c->data.s = _map_string(map, map_len, constant.value, constant.len);
+                if (! c->data.s) goto error;
+                break;
+            case BYTECODE_CONST_CODE :
+                c->data.code = _bytecode_load_code(map, map_len, constant.value, depth + 1, last_offset);
+                if (! c->data.code) {
+                    c->type = BYTECODE_CONST_NULL;
+                    goto error;
+                }
+                break;
+            case BYTECODE_CONST_NUMERICAL :
+            case BYTECODE_CONST_BOOLEAN :
+            case BYTECODE_CONST_NULL :
+                c->data.l = constant.value;
+                break;
+            default :
+                c->type = BYTECODE_CONST_NULL;
+                goto error;
+        }
+    }
+
+    return bc;
+
+error:
+    bytecode_free(bc);
+    return NULL;
+}
+
+
+/**
+ * Maps a .sfc file into memory and returns the verified bytecode for it. Returns NULL when the file cannot
+ * be read or is not a valid bytecode file.
+ */
+t_bytecode *bytecode_load(const char *filename) {
+    t_bytecode_binary_header header;
+    struct stat sb;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof(header)) {
+        close(fd);
+        return NULL;
+    }
+
+    // Private mapping: pages are only copied when the VM writes into the code
+    char *map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    memcpy(&header, map, sizeof(header));
+    if (header.magic != MAGIC_HEADER || header.version != BYTECODE_VERSION || header.length != sb.st_size) {
+        munmap(map, sb.st_size);
+        return NULL;
+    }
 
-    bc->constants = NULL;
-    bc->variables = NULL;
+    uint64_t last_offset = 0;
+    t_bytecode *bc = _bytecode_load_code(map, sb.st_size, header.code_offset, 0, &last_offset);
+    if (! bc) {
+        munmap(map, sb.st_size);
+        return NULL;
+    }
 
-    // constants
-    _new_constant(bc, BYTECODE_CONST_NUMERICAL, 4, (void *)0x1234);
-    _new_constant(bc, BYTECODE_CONST_NUMERICAL, 4, (void *)0x5678);
-    _new_variable(bc, "a");
-    _new_variable(bc, "b");
+    bc->map_len = sb.st_size;
 
+    // The VM trusts the code completely, so a damaged file must not get that far
+    if (! bytecode_verify(bc)) {
+        bytecode_free(bc);
+        return NULL;
+    }
     return bc;
 }
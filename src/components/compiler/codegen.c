@@ -0,0 +1,1110 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "compiler/bytecode.h"
+#include "compiler/ast.h"
+#include "compiler/parser.tab.h"
+#include "compiler/saffire_compiler.h"
+#include "vm/vm_opcodes.h"
+#include "objects/object.h"
+#include "objects/method.h"
+#include "general/smm.h"
+
+/*
+ * The code generator walks the AST and emits bytecode for the VM. Every code block (the main program and
+ * every method body) gets its own bytecode structure. Method bodies are stored as code constants inside the
+ * bytecode of the class that defines them.
+ *
+ * Expressions always leave exactly one object on the stack, statements leave the stack as they found it.
+ *
+ * When generating register instructions, assignments, increments and conditions are calculated directly
+ * into the frame's variables (which act as registers). Temporary results go into hidden variables.
+ *
+ * Every instruction is tagged with the line of the node it was generated for. A new entry is only added to the
+ * line table when the line changes, so most statements cost a single entry.
+ *
+ * Try blocks do not generate any code on entry. The code ranges they cover are recorded instead, and end up in
+ * the exception table of the bytecode together with the offset of their handler.
+ */
+
+typedef struct _codegen_try {
+    t_ast_element *finally;     // Finally block that runs when the code leaves the try block (or NULL)
+    int *ranges;                // Start and end offsets of the code ranges covered by the try block
+    int ranges_len;             // Number of offsets in ranges
+    struct _codegen_try *prev;  // Try block around this one (or NULL)
+} t_codegen_try;
+
+typedef struct _codegen {
+    t_bytecode *bc;             // Bytecode we are generating
+    int code_size;              // Allocated size of the code buffer
+    int depth;                  // Current stack depth
+    int max_depth;              // Maximum stack depth found so far
+    int in_class;               // 1 when we are generating a class body
+    int registers;              // 1 when we generate register instructions
+    int temps;                  // Number of temporary registers in use
+    t_codegen_try *tries;       // Innermost try block we are generating (or NULL)
+    int line;                   // Line of the node we are generating
+    int *line_offsets;          // Code offsets at which the line changes
+    int *lines;                 // Line found from the matching code offset onwards
+    int lines_len;              // Number of entries in the line arrays
+    int lines_size;             // Allocated number of entries
+} t_codegen;
+
+
+static void _codegen_stmt(t_codegen *cg, t_ast_element *p);
+static void _codegen_expr(t_codegen *cg, t_ast_element *p);
+static void _codegen_reg_expr(t_codegen *cg, t_ast_element *p, int dst);
+
+
+/**
+ * Print out an error and exit
+ */
+static void _codegen_error(t_ast_element *p, char *str, ...) {
+    va_list args;
+    va_start(args, str);
+    fprintf(stderr, "Error in line %d: ", p ? p->lineno : 0);
+    vfprintf(stderr, str, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+
+/**
+ * Emits a single byte into the code buffer
+ */
+static void _emit_byte(t_codegen *cg, unsigned char b) {
+    t_bytecode *bc = cg->bc;
+
+    if (bc->code_len == cg->code_size) {
+        cg->code_size = cg->code_size ? cg->code_size * 2 : 64;
+        bc->code = smm_realloc(bc->code, cg->code_size);
+    }
+    bc->code[bc->code_len++] = b;
+}
+
+
+/**
+ * Sets the line for the instructions emitted from now on to the line of the node
+ */
+static void _codegen_line(t_codegen *cg, t_ast_element *p) {
+    if (p && p->lineno) cg->line = p->lineno;
+}
+
+
+/**
+ * Emits an opcode with its operands (when the opcode needs them). Jump targets are padded to their maximum
+ * size, so they can be patched later on. Returns the offset of the emitted opcode.
+ */
+static int _emit(t_codegen *cg, int opcode, int oparg) {
+    unsigned char buf[INSTRUCTION_MAX_SIZE];
+    int pos = cg->bc->code_len;
+
+    if (cg->lines_len == 0 || cg->lines[cg->lines_len - 1] != cg->line) {
+        if (cg->lines_len == cg->lines_size) {
+            cg->lines_size = cg->lines_size ? cg->lines_size * 2 : 16;
+            cg->line_offsets = smm_realloc(cg->line_offsets, cg->lines_size * sizeof(int));
+            cg->lines = smm_realloc(cg->lines, cg->lines_size * sizeof(int));
+        }
+        cg->line_offsets[cg->lines_len] = pos;
+        cg->lines[cg->lines_len++] = cg->line;
+    }
+
+    int len = vm_encode_instruction(buf, opcode, oparg, OPERAND_MAX_SIZE);
+    for (int i=0; i!=len; i++) _emit_byte(cg, buf[i]);
+
+    int needed, peak;
+    int effect = vm_opcode_stack_effect(opcode, oparg, &needed, &peak);
+    if (cg->depth + peak > cg->max_depth) cg->max_depth = cg->depth + peak;
+    cg->depth += effect;
+
+    return pos;
+}
+
+
+/**
+ * Sets the target of an already emitted jump to the current position
+ */
+static void _patch_jump(t_codegen *cg, int pos) {
+    int opcode = (unsigned char)cg->bc->code[pos];
+
+    if ((opcode == VM_REG_JUMP_IF_FALSE || opcode == VM_REG_JUMP_IF_TRUE) && cg->bc->code_len > REG_JUMP_MAX) {
+        _codegen_error(NULL, "Code is too large to use registers, compile without registers");
+    }
+
+    // The target is always the first operand
+    vm_encode_operand((unsigned char *)cg->bc->code + pos + 1, cg->bc->code_len, OPERAND_MAX_SIZE);
+}
+
+
+/**
+ * Emits a LOAD_CONST for the given constant
+ */
+static void _emit_const(t_codegen *cg, int type, int len, void *data) {
+    _emit(cg, VM_LOAD_CONST, bytecode_add_constant(cg->bc, type, len, data));
+}
+
+
+/**
+ * Returns 1 when the node is a literal, and fills in the constant for it
+ */
+static int _literal(t_ast_element *p, int *type, int *len, void **data) {
+    *len = 0;
+    *data = NULL;
+
+    switch (p->type) {
+        case typeAstNull :
+            *type = BYTECODE_CONST_NULL;
+            return 1;
+
+        case typeAstString :
+            *type = BYTECODE_CONST_STRING;
+            *len = strlen(p->string.value);
+            *data = p->string.value;
+            return 1;
+
+        case typeAstNumerical :
+            *type = BYTECODE_CONST_NUMERICAL;
+            *len = sizeof(long);
+            *data = (void *)(long)p->numerical.value;
+            return 1;
+
+        case typeAstIdentifier :
+            // Do constant vars
+            if (strcasecmp(p->identifier.name, "True") == 0) {
+                *type = BYTECODE_CONST_BOOLEAN;
+                *len = sizeof(long);
+                *data = (void *)1L;
+                return 1;
+            }
+            if (strcasecmp(p->identifier.name, "False") == 0) {
+                *type = BYTECODE_CONST_BOOLEAN;
+                *len = sizeof(long);
+                *data = (void *)0L;
+                return 1;
+            }
+            if (strcasecmp(p->identifier.name, "Null") == 0) {
+                *type = BYTECODE_CONST_NULL;
+                return 1;
+            }
+            return 0;
+
+        default :
+            return 0;
+    }
+}
+
+
+/**
+ * Returns the binary opcode for an operator, or 0 when it is not a binary operator
+ */
+static int _binary_opcode(int oper) {
+    switch (oper) {
+        case '+'           : return VM_BINARY_ADD;
+        case '-'           : return VM_BINARY_SUBTRACT;
+        case '*'           : return VM_BINARY_MULTIPLY;
+        case '/'           : return VM_BINARY_DIVIDE;
+        case T_AND         : return VM_BINARY_AND;
+        case T_OR          : return VM_BINARY_OR;
+        case '^'           : return VM_BINARY_XOR;
+        case T_SHIFT_LEFT  : return VM_BINARY_SHL;
+        case T_SHIFT_RIGHT : return VM_BINARY_SHR;
+    }
+    return 0;
+}
+
+
+/**
+ * Returns the comparison for an operator, or 0 when it is not a comparison
+ */
+static int _comparison(int oper) {
+    switch (oper) {
+        case '<'  : return COMPARISON_LT;
+        case '>'  : return COMPARISON_GT;
+        case T_GE : return COMPARISON_GE;
+        case T_LE : return COMPARISON_LE;
+        case T_NE : return COMPARISON_NE;
+        case T_EQ : return COMPARISON_EQ;
+    }
+    return 0;
+}
+
+
+/**
+ * Returns 1 when the node is an empty expression statement
+ */
+static int _is_empty(t_ast_element *p) {
+    if (! p || p->type == typeAstNull) return 1;
+    return (p->type == typeAstOpr && p->opr.oper == ';');
+}
+
+
+/**
+ * Returns the expression inside a list of expressions when the list holds just one expression
+ */
+static t_ast_element *_single_expression(t_ast_element *p) {
+    if (p->type == typeAstOpr && p->opr.oper == T_EXPRESSIONS && p->opr.nops == 1) {
+        return p->opr.ops[0];
+    }
+    return p;
+}
+
+
+/**
+ * Returns the register for a variable
+ */
+static int _register(t_codegen *cg, t_ast_element *p, const char *name) {
+    int idx = bytecode_add_variable(cg->bc, name);
+    if (idx > REG_MAX) {
+        _codegen_error(p, "Too many variables to use registers, compile without registers");
+    }
+    return idx;
+}
+
+
+/**
+ * Returns a free temporary register. Temporaries are named %tN, which can never clash with an identifier.
+ */
+static int _temp_register(t_codegen *cg, t_ast_element *p) {
+    char name[32];
+    snprintf(name, sizeof(name), "%%t%d", cg->temps++);
+    return _register(cg, p, name);
+}
+
+
+/**
+ * Returns 1 when evaluating the node could change a variable
+ */
+static int _has_side_effects(t_ast_element *p) {
+    if (! p || p->type != typeAstOpr) return 0;
+
+    if (p->opr.oper == T_ASSIGNMENT || p->opr.oper == T_OP_INC || p->opr.oper == T_OP_DEC) return 1;
+    for (int i=0; i!=p->opr.nops; i++) {
+        if (_has_side_effects(p->opr.ops[i])) return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Returns a constant as a source operand
+ */
+static int _const_operand(t_codegen *cg, t_ast_element *p, int type, int len, void *data) {
+    int idx = bytecode_add_constant(cg->bc, type, len, data);
+    if (idx > REG_MAX) {
+        _codegen_error(p, "Too many constants to use registers, compile without registers");
+    }
+    return idx | REG_CONST;
+}
+
+
+/**
+ * Returns a source operand for the expression. Literals and variables are used directly, everything else is
+ * calculated into a temporary register.
+ */
+static int _codegen_operand(t_codegen *cg, t_ast_element *p) {
+    int type, len;
+    void *data;
+
+    if (_literal(p, &type, &len, &data)) {
+        return _const_operand(cg, p, type, len, data);
+    }
+
+    if (p->type == typeAstIdentifier) {
+        return _register(cg, p, p->identifier.name);
+    }
+
+    int tmp = _temp_register(cg, p);
+    _codegen_reg_expr(cg, p, tmp);
+    return tmp;
+}
+
+
+/**
+ * Returns source operands for both sides of a binary expression. The left side is copied into a temporary
+ * register when the right side could change it.
+ */
+static void _codegen_operands(t_codegen *cg, t_ast_element *p, int *a, int *b) {
+    *a = _codegen_operand(cg, p->opr.ops[0]);
+
+    if (! (*a & REG_CONST) && _has_side_effects(p->opr.ops[1])) {
+        int tmp = _temp_register(cg, p);
+        _emit(cg, VM_REG_MOVE, REG_PACK(tmp, *a, 0));
+        *a = tmp;
+    }
+
+    *b = _codegen_operand(cg, p->opr.ops[1]);
+}
+
+
+/**
+ * Generates an expression into a register
+ */
+static void _codegen_reg_expr(t_codegen *cg, t_ast_element *p, int dst) {
+    int type, len, a, b, opcode, cmp;
+    void *data;
+    int save = cg->temps;
+
+    _codegen_line(cg, p);
+
+    if (! p) {
+        _emit(cg, VM_REG_MOVE, REG_PACK(dst, _const_operand(cg, p, BYTECODE_CONST_NULL, 0, NULL), 0));
+        return;
+    }
+
+    if (_literal(p, &type, &len, &data) || p->type == typeAstIdentifier) {
+        a = _codegen_operand(cg, p);
+        if (a != dst) {
+            _emit(cg, VM_REG_MOVE, REG_PACK(dst, a, 0));
+        }
+
+    } else if (p->type == typeAstOpr && p->opr.nops == 2 && (opcode = _binary_opcode(p->opr.oper)) != 0) {
+        _codegen_operands(cg, p, &a, &b);
+        _emit(cg, opcode - VM_BINARY_ADD + VM_REG_ADD, REG_PACK(dst, a, b));
+
+    } else if (p->type == typeAstOpr && p->opr.nops == 2 && (cmp = _comparison(p->opr.oper)) != 0) {
+        _codegen_operands(cg, p, &a, &b);
+        _emit(cg, cmp - COMPARISON_EQ + VM_REG_COMPARE_EQ, REG_PACK(dst, a, b));
+
+    } else {
+        // No register instruction for this expression, so calculate it on the stack
+        _codegen_expr(cg, p);
+        _emit(cg, VM_STORE_VAR, dst);
+    }
+
+    cg->temps = save;
+}
+
+
+/**
+ * Generates an expression statement with register instructions. Returns 0 when the statement has no register
+ * form, in which case nothing is generated.
+ */
+static int _codegen_reg_stmt(t_codegen *cg, t_ast_element *p) {
+    p = _single_expression(p);
+    if (p->type != typeAstOpr) return 0;
+
+    t_ast_element *var = p->opr.nops ? p->opr.ops[0] : NULL;
+    if (! var || var->type != typeAstIdentifier) return 0;
+
+    switch (p->opr.oper) {
+        case T_ASSIGNMENT :
+            // Only = assignments, everything else is reported by the stack code generation
+            if (p->opr.ops[1]->type != typeAstOpr || p->opr.ops[1]->opr.oper != T_ASSIGNMENT) return 0;
+
+            _codegen_reg_expr(cg, p->opr.ops[2], _register(cg, var, var->identifier.name));
+            return 1;
+
+        case T_OP_INC :
+        case T_OP_DEC : {
+            int reg = _register(cg, var, var->identifier.name);
+            int one = _const_operand(cg, p, BYTECODE_CONST_NUMERICAL, sizeof(long), (void *)1L);
+
+            _emit(cg, p->opr.oper == T_OP_INC ? VM_REG_ADD : VM_REG_SUBTRACT, REG_PACK(reg, reg, one));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Generates a conditional jump on the outcome of the expression. Returns the position of the jump so it can be
+ * patched later on.
+ */
+static int _codegen_cond_jump(t_codegen *cg, t_ast_element *p, int opcode, int target) {
+    int type, len;
+    void *data;
+
+    if (p) p = _single_expression(p);
+
+    if (! cg->registers) {
+        // Compare and branch in one go, without creating a boolean in between
+        if (p && p->type == typeAstOpr && _comparison(p->opr.oper)) {
+            _codegen_expr(cg, p->opr.ops[0]);
+            _codegen_expr(cg, p->opr.ops[1]);
+            opcode = (opcode == VM_POP_JUMP_IF_FALSE) ? VM_COMPARE_JUMP_IF_FALSE_EQ : VM_COMPARE_JUMP_IF_TRUE_EQ;
+            return _emit(cg, opcode + _comparison(p->opr.oper) - COMPARISON_EQ, target);
+        }
+
+        _codegen_expr(cg, p);
+        return _emit(cg, opcode, target);
+    }
+
+    // Jump on a variable directly, or calculate the condition into a temporary register
+    int save = cg->temps;
+    int reg;
+    if (p && p->type == typeAstIdentifier && ! _literal(p, &type, &len, &data)) {
+        reg = _register(cg, p, p->identifier.name);
+    } else {
+        reg = _temp_register(cg, p);
+        _codegen_reg_expr(cg, p, reg);
+    }
+    cg->temps = save;
+
+    opcode = (opcode == VM_POP_JUMP_IF_FALSE) ? VM_REG_JUMP_IF_FALSE : VM_REG_JUMP_IF_TRUE;
+    return _emit(cg, opcode, REG_JUMP_PACK(reg, target));
+}
+
+
+/**
+ * Generates a complete code block (the main program or a method body) into a new bytecode structure
+ */
+static t_bytecode *_codegen_block(t_ast_element *p, int registers) {
+    t_codegen cg;
+    memset(&cg, 0, sizeof(t_codegen));
+    cg.bc = bytecode_new();
+    cg.registers = registers;
+
+    _codegen_stmt(&cg, p);
+
+    // Every code block returns null when it does not return anything by itself
+    _emit_const(&cg, BYTECODE_CONST_NULL, 0, NULL);
+    _emit(&cg, VM_RETURN_VALUE, 0);
+
+    cg.bc->stack_size = cg.max_depth;
+
+    bytecode_set_lines(cg.bc, cg.line_offsets, cg.lines, cg.lines_len);
+    smm_free(cg.line_offsets);
+    smm_free(cg.lines);
+
+    // Jump targets were emitted at their maximum size
+    bytecode_shrink(cg.bc);
+    return cg.bc;
+}
+
+
+/**
+ * Generates the method definition inside the class that is currently on the stack
+ */
+static void _codegen_method(t_codegen *cg, t_ast_element *p) {
+    if (! cg->in_class) {
+        _codegen_error(p, "Trying to define a method outside a class. This should be caught by the parser!");
+    }
+
+    int vis = 0;
+    if (p->method.modifiers & MODIFIER_PUBLIC) vis |= METHOD_VISIBILITY_PUBLIC;
+    if (p->method.modifiers & MODIFIER_PROTECTED) vis |= METHOD_VISIBILITY_PROTECTED;
+    if (p->method.modifiers & MODIFIER_PRIVATE) vis |= METHOD_VISIBILITY_PRIVATE;
+
+    int flags = 0;
+    if (p->method.modifiers & MODIFIER_FINAL) flags |= METHOD_FLAG_FINAL;
+    if (p->method.modifiers & MODIFIER_ABSTRACT) flags |= METHOD_FLAG_ABSTRACT;
+    if (p->method.modifiers & MODIFIER_STATIC) flags |= METHOD_FLAG_STATIC;
+
+    t_bytecode *body = _codegen_block(p->method.body, cg->registers);
+
+    _emit_const(cg, BYTECODE_CONST_CODE, 0, body);
+    _emit_const(cg, BYTECODE_CONST_NUMERICAL, sizeof(long), (void *)(long)flags);
+    _emit_const(cg, BYTECODE_CONST_NUMERICAL, sizeof(long), (void *)(long)vis);
+    _emit(cg, VM_STORE_METHOD, bytecode_add_variable(cg->bc, p->method.name));
+}
+
+
+/**
+ * Generates a class definition. The class stays on the stack while its body is generated.
+ */
+static void _codegen_class(t_codegen *cg, t_ast_element *p) {
+    _emit_const(cg, BYTECODE_CONST_STRING, strlen(p->class.name), p->class.name);
+    _emit(cg, VM_BUILD_CLASS, 0);
+
+    int saved_in_class = cg->in_class;
+    cg->in_class = 1;
+    _codegen_stmt(cg, p->class.body);
+    cg->in_class = saved_in_class;
+
+    _emit(cg, VM_STORE_CLASS, 0);
+}
+
+
+/**
+ * Generates a method call or class instantiation with the given call opcode. A CALL_METHOD leaves the result
+ * on the stack, a TAIL_CALL returns it.
+ */
+static void _codegen_call(t_codegen *cg, t_ast_element *p, int opcode) {
+    int argc = 0;
+
+    if (p->opr.ops[0]->type == typeAstNull) {
+        // No object: call or instantiate the identifier directly
+        _emit_const(cg, BYTECODE_CONST_NULL, 0, NULL);
+        _codegen_expr(cg, p->opr.ops[1]);
+    } else {
+        t_ast_element *hte = p->opr.ops[1];
+        if (hte->type != typeAstIdentifier) {
+            _codegen_error(p, "Can only have identifiers here");
+        }
+        _codegen_expr(cg, p->opr.ops[0]);
+        _emit(cg, VM_LOAD_METHOD, bytecode_add_variable(cg->bc, hte->identifier.name));
+    }
+
+    t_ast_element *args = p->opr.ops[2];
+    if (args->type == typeAstOpr && args->opr.oper == T_ARGUMENT_LIST) {
+        for (int i=0; i!=args->opr.nops; i++) {
+            _codegen_expr(cg, args->opr.ops[i]);
+        }
+        argc = args->opr.nops;
+    } else if (args->type != typeAstNull) {
+        _codegen_error(p, "Expected an argument list (or nothing)");
+    }
+
+    _emit(cg, opcode, argc);
+}
+
+
+/**
+ * Starts a new code range for the try block
+ */
+static void _try_range_start(t_codegen *cg, t_codegen_try *t) {
+    t->ranges = smm_realloc(t->ranges, (t->ranges_len + 2) * sizeof(int));
+    t->ranges[t->ranges_len++] = cg->bc->code_len;
+}
+
+/**
+ * Ends the current code range of the try block
+ */
+static void _try_range_end(t_codegen *cg, t_codegen_try *t) {
+    t->ranges[t->ranges_len++] = cg->bc->code_len;
+}
+
+/**
+ * Enters a try block, the code that follows is covered by it
+ */
+static void _try_enter(t_codegen *cg, t_codegen_try *t, t_ast_element *finally) {
+    t->finally = finally;
+    t->ranges = NULL;
+    t->ranges_len = 0;
+    t->prev = cg->tries;
+    cg->tries = t;
+    _try_range_start(cg, t);
+}
+
+/**
+ * Leaves the try block and adds its ranges to the exception table. The handler gets the stack of level items,
+ * with the exception on top of it.
+ */
+static void _try_leave(t_codegen *cg, t_codegen_try *t, int handler, int level) {
+    _try_range_end(cg, t);
+    cg->tries = t->prev;
+
+    for (int i=0; i<t->ranges_len; i += 2) {
+        if (t->ranges[i] == t->ranges[i + 1]) continue;
+        bytecode_add_handler(cg->bc, t->ranges[i], t->ranges[i + 1], handler, level);
+    }
+    smm_free(t->ranges);
+}
+
+/**
+ * Returns the value on top of the stack from inside try blocks. The finally blocks run first, innermost first,
+ * each of them outside the try block it belongs to. The ranges of the try blocks continue after the return.
+ */
+static void _codegen_return_from_try(t_codegen *cg) {
+    t_codegen_try *tries = cg->tries;
+
+    for (t_codegen_try *t = tries; t; t = t->prev) {
+        _try_range_end(cg, t);
+        cg->tries = t->prev;
+        if (t->finally) _codegen_stmt(cg, t->finally);
+    }
+    _emit(cg, VM_RETURN_VALUE, 0);
+
+    cg->tries = tries;
+    for (t_codegen_try *t = tries; t; t = t->prev) {
+        _try_range_start(cg, t);
+    }
+}
+
+/**
+ * Runs the finally block of the (catch blocks of the) try block we are leaving normally
+ */
+static void _codegen_finally(t_codegen *cg, t_codegen_try *t) {
+    _try_range_end(cg, t);
+    cg->tries = t->prev;
+    _codegen_stmt(cg, t->finally);
+    cg->tries = t;
+    _try_range_start(cg, t);
+}
+
+/**
+ * Returns the number of catch blocks in the catch list, and stores them in order into catches (when not NULL)
+ */
+static int _catch_blocks(t_ast_element *list, t_ast_element **catches) {
+    // A catch is a header and a body, a list is a list followed by a catch
+    if (list->opr.ops[0]->opr.oper == T_CATCH) {
+        if (catches) catches[0] = list;
+        return 1;
+    }
+
+    int count = _catch_blocks(list->opr.ops[0], catches);
+    if (catches) catches[count] = list->opr.ops[1];
+    return count + 1;
+}
+
+/**
+ * Generates try, catch and finally. Throwing inside the try block continues at the handler, which checks the
+ * catch blocks in order. When none of them catches the exception, it is thrown again. The finally block is
+ * generated at every way out of the statement.
+ */
+static void _codegen_try(t_codegen *cg, t_ast_element *p) {
+    t_ast_element *finally = (p->opr.oper == T_FINALLY) ? p->opr.ops[2] : NULL;
+    t_codegen_try body, handlers;
+    int level = cg->depth;
+
+    int count = _catch_blocks(p->opr.ops[1], NULL);
+    t_ast_element **catches = smm_malloc(count * sizeof(t_ast_element *));
+    _catch_blocks(p->opr.ops[1], catches);
+
+    // Jumps to the end of the statement
+    int *done = smm_malloc((count + 1) * sizeof(int));
+
+    _try_enter(cg, &body, finally);
+    _codegen_stmt(cg, p->opr.ops[0]);
+    if (finally) _codegen_finally(cg, &body);
+    done[0] = _emit(cg, VM_JUMP_ABSOLUTE, 0);
+    _try_leave(cg, &body, cg->bc->code_len, level);
+
+    // Exceptions thrown by the catch blocks still need to run the finally block
+    if (finally) _try_enter(cg, &handlers, finally);
+
+    for (int i=0; i!=count; i++) {
+        t_ast_element *header = catches[i]->opr.ops[0];
+
+        // The handler starts with the exception on the stack
+        cg->depth = level + 1;
+        _emit(cg, VM_LOAD_VAR, bytecode_add_variable(cg->bc, header->opr.ops[0]->string.value));
+        int next = _emit(cg, VM_MATCH_EXCEPTION, 0);
+        _emit(cg, VM_STORE_VAR, bytecode_add_variable(cg->bc, header->opr.ops[1]->string.value));
+
+        _codegen_stmt(cg, catches[i]->opr.ops[1]);
+        if (finally) _codegen_finally(cg, &handlers);
+        done[i + 1] = _emit(cg, VM_JUMP_ABSOLUTE, 0);
+        _patch_jump(cg, next);
+    }
+
+    // Nothing caught the exception (or a catch block threw), run the finally block and throw it again
+    cg->depth = level + 1;
+    if (finally) {
+        _try_leave(cg, &handlers, cg->bc->code_len, level);
+        _codegen_stmt(cg, finally);
+    }
+    _emit(cg, VM_THROW, 0);
+
+    for (int i=0; i!=count + 1; i++) {
+        _patch_jump(cg, done[i]);
+    }
+
+    smm_free(done);
+    smm_free(catches);
+}
+
+
+/**
+ * Generates ++ and -- on a variable. Leaves the new value on the stack.
+ */
+static void _codegen_incdec(t_codegen *cg, t_ast_element *p, int opcode) {
+    t_ast_element *var = p->opr.ops[0];
+    if (var->type != typeAstIdentifier) {
+        _codegen_error(p, "Left hand side is not writable!");
+    }
+
+    int idx = bytecode_add_variable(cg->bc, var->identifier.name);
+    _emit(cg, VM_LOAD_VAR, idx);
+    _emit_const(cg, BYTECODE_CONST_NUMERICAL, sizeof(long), (void *)1L);
+    _emit(cg, opcode, 0);
+    _emit(cg, VM_DUP_TOP, 0);
+    _emit(cg, VM_STORE_VAR, idx);
+}
+
+
+/**
+ * Generates an expression. Always leaves exactly one object on the stack.
+ */
+static void _codegen_expr(t_codegen *cg, t_ast_element *p) {
+    t_ast_element *hte;
+    int type, len;
+    void *data;
+
+    _codegen_line(cg, p);
+
+    if (! p) {
+        _emit_const(cg, BYTECODE_CONST_NULL, 0, NULL);
+        return;
+    }
+
+    if (_literal(p, &type, &len, &data)) {
+        _emit_const(cg, type, len, data);
+        return;
+    }
+
+    switch (p->type) {
+        case typeAstIdentifier :
+            _emit(cg, VM_LOAD_VAR, bytecode_add_variable(cg->bc, p->identifier.name));
+            return;
+
+        case typeAstOpr :
+            break;
+
+        default :
+            _codegen_error(p, "Cannot use a class, interface or method as an expression");
+            return;
+    }
+
+    switch (p->opr.oper) {
+        case T_EXPRESSIONS :
+            // No expression, just return NULL
+            if (p->opr.nops == 0) {
+                _emit_const(cg, BYTECODE_CONST_NULL, 0, NULL);
+                return;
+            }
+
+            // Do all expressions, but only remember the first one
+            _codegen_expr(cg, p->opr.ops[0]);
+            for (int i=1; i!=p->opr.nops; i++) {
+                _codegen_expr(cg, p->opr.ops[i]);
+                _emit(cg, VM_POP_TOP, 0);
+            }
+            return;
+
+        case T_ASSIGNMENT :
+            hte = p->opr.ops[0];
+            if (hte->type != typeAstIdentifier) {
+                _codegen_error(p, "Left hand side is not writable!");
+            }
+
+            // Check if we have a normal assignment. We only support this for now...
+            t_ast_element *e = p->opr.ops[1];
+            if (e->type != typeAstOpr || e->opr.oper != T_ASSIGNMENT) {
+                _codegen_error(p, "We only support = assignments (no += etc)");
+            }
+
+            _codegen_expr(cg, p->opr.ops[2]);
+            _emit(cg, VM_DUP_TOP, 0);
+            _emit(cg, VM_STORE_VAR, bytecode_add_variable(cg->bc, hte->identifier.name));
+            return;
+
+        case T_METHOD_CALL :
+            _codegen_call(cg, p, VM_CALL_METHOD);
+            return;
+
+        case '.' :
+            hte = p->opr.ops[1];
+            if (hte->type != typeAstIdentifier) {
+                _codegen_error(p, "Can only have identifiers here");
+            }
+            _codegen_expr(cg, p->opr.ops[0]);
+            _emit(cg, VM_LOAD_ATTRIB, bytecode_add_variable(cg->bc, hte->identifier.name));
+            return;
+
+        /* Comparisons */
+        case '<' :
+        case '>' :
+        case T_GE :
+        case T_LE :
+        case T_NE :
+        case T_EQ :
+            _codegen_expr(cg, p->opr.ops[0]);
+            _codegen_expr(cg, p->opr.ops[1]);
+            _emit(cg, VM_COMPARE_OP, _comparison(p->opr.oper));
+            return;
+
+        /* Operators */
+        case '+' :
+        case '-' :
+        case '*' :
+        case '/' :
+        case T_AND :
+        case T_OR :
+        case '^' :
+        case T_SHIFT_LEFT :
+        case T_SHIFT_RIGHT :
+            _codegen_expr(cg, p->opr.ops[0]);
+            _codegen_expr(cg, p->opr.ops[1]);
+            _emit(cg, _binary_opcode(p->opr.oper), 0);
+            return;
+
+        /* Unary operators */
+        case T_OP_INC :
+            _codegen_incdec(cg, p, VM_BINARY_ADD);
+            return;
+        case T_OP_DEC :
+            _codegen_incdec(cg, p, VM_BINARY_SUBTRACT);
+            return;
+
+        default :
+            _codegen_error(p, "Unhandled opcode: %d", p->opr.oper);
+            return;
+    }
+}
+
+
+/**
+ * Generates a statement. Leaves the stack as it was found.
+ */
+static void _codegen_stmt(t_codegen *cg, t_ast_element *p) {
+    t_ast_element *hte;
+    int pos1, pos2, top;
+
+    _codegen_line(cg, p);
+
+    if (! p) return;
+
+    switch (p->type) {
+        case typeAstNull :
+        case typeAstInterface :
+            // @TODO: interfaces
+            return;
+
+        case typeAstClass :
+            _codegen_class(cg, p);
+            return;
+
+        case typeAstMethod :
+            _codegen_method(cg, p);
+            return;
+
+        case typeAstOpr :
+            break;
+
+        default :
+            // A single scalar or identifier used as a statement
+            _codegen_expr(cg, p);
+            _emit(cg, VM_POP_TOP, 0);
+            return;
+    }
+
+    switch (p->opr.oper) {
+        case ';' :
+            // Empty statement
+            return;
+
+        case T_PROGRAM :
+            _codegen_stmt(cg, p->opr.ops[0]);     // use declarations
+            _codegen_stmt(cg, p->opr.ops[1]);     // top statements
+            return;
+
+        case T_TOP_STATEMENTS :
+        case T_USE_STATEMENTS :
+        case T_STATEMENTS :
+            for (int i=0; i!=p->opr.nops; i++) {
+                _codegen_stmt(cg, p->opr.ops[i]);
+            }
+            return;
+
+        case T_IMPORT :
+            // Class to import, and context to import it from
+            _codegen_expr(cg, p->opr.ops[0]);
+            _codegen_expr(cg, p->opr.ops[2]);
+
+            // Alias X as X if needed
+            hte = p->opr.ops[1]->type == typeAstNull ? p->opr.ops[0] : p->opr.ops[1];
+            _emit(cg, VM_IMPORT, bytecode_add_variable(cg->bc, hte->string.value));
+            return;
+
+        case T_USE :
+            // Context to use
+            _codegen_expr(cg, p->opr.ops[0]);
+
+            // Alias X as X if needed
+            hte = p->opr.ops[0];
+            if (p->opr.nops > 1 && p->opr.ops[1]->type != typeAstNull) {
+                hte = p->opr.ops[1];
+            }
+            _emit(cg, VM_USE, bytecode_add_variable(cg->bc, hte->string.value));
+            return;
+
+        case T_RETURN :
+            hte = p->opr.nops ? _single_expression(p->opr.ops[0]) : NULL;
+            if (hte && hte->type == typeAstOpr && hte->opr.oper == T_METHOD_CALL && ! cg->tries) {
+                // Returning the result of a call: the callee can take over our frame (unless our handlers
+                // must be able to catch what it throws)
+                _codegen_call(cg, hte, VM_TAIL_CALL);
+                return;
+            }
+            _codegen_expr(cg, hte);
+            if (cg->tries) {
+                _codegen_return_from_try(cg);
+            } else {
+                _emit(cg, VM_RETURN_VALUE, 0);
+            }
+            return;
+
+        case T_YIELD :
+            // Suspends the frame. Any method that yields is run as a generator.
+            _codegen_expr(cg, p->opr.ops[0]);
+            _emit(cg, VM_YIELD_VALUE, 0);
+            return;
+
+        case T_THROW :
+            _codegen_expr(cg, p->opr.ops[0]);
+            _emit(cg, VM_THROW, 0);
+            return;
+
+        case T_TRY :
+        case T_FINALLY :
+            _codegen_try(cg, p);
+            return;
+
+        /**
+         * Control structures
+         */
+        case T_DO :
+            // Always execute our inner block at least once
+            top = cg->bc->code_len;
+            _codegen_stmt(cg, p->opr.ops[0]);
+            _codegen_cond_jump(cg, p->opr.ops[1], VM_POP_JUMP_IF_TRUE, top);
+            return;
+
+        case T_WHILE :
+            // Check condition first. If the first check fails, we execute the (optional) else block.
+            pos1 = _codegen_cond_jump(cg, p->opr.ops[0], VM_POP_JUMP_IF_FALSE, 0);
+
+            top = cg->bc->code_len;
+            _codegen_stmt(cg, p->opr.ops[1]);
+            _codegen_cond_jump(cg, p->opr.ops[0], VM_POP_JUMP_IF_TRUE, top);
+
+            if (p->opr.nops > 2) {
+                pos2 = _emit(cg, VM_JUMP_ABSOLUTE, 0);
+                _patch_jump(cg, pos1);
+                _codegen_stmt(cg, p->opr.ops[2]);
+                _patch_jump(cg, pos2);
+            } else {
+                _patch_jump(cg, pos1);
+            }
+            return;
+
+        case T_FOREACH :
+            // foreach (iterable as variable) body. The iterator stays on the stack while the loop runs.
+            hte = _single_expression(p->opr.ops[1]);
+            if (hte->type != typeAstIdentifier) {
+                _codegen_error(p, "Can only iterate into a variable");
+            }
+
+            _codegen_expr(cg, p->opr.ops[0]);
+            top = _emit(cg, VM_FOR_ITER, 0);
+            _emit(cg, VM_STORE_VAR, bytecode_add_variable(cg->bc, hte->identifier.name));
+            _codegen_stmt(cg, p->opr.ops[2]);
+            _emit(cg, VM_JUMP_ABSOLUTE, top);
+            _patch_jump(cg, top);
+
+            // FOR_ITER pops the iterator when it is done
+            cg->depth--;
+            return;
+
+        case T_FOR :
+            // for (init; condition; increment) body. The increment is optional.
+            _codegen_stmt(cg, p->opr.ops[0]);
+
+            pos1 = -1;
+            if (! _is_empty(p->opr.ops[1])) {
+                pos1 = _codegen_cond_jump(cg, p->opr.ops[1], VM_POP_JUMP_IF_FALSE, 0);
+            }
+
+            top = cg->bc->code_len;
+            if (p->opr.nops > 3) {
+                _codegen_stmt(cg, p->opr.ops[3]);
+                _codegen_stmt(cg, p->opr.ops[2]);
+            } else {
+                _codegen_stmt(cg, p->opr.ops[2]);
+            }
+
+            if (pos1 == -1) {
+                _emit(cg, VM_JUMP_ABSOLUTE, top);
+            } else {
+                _codegen_cond_jump(cg, p->opr.ops[1], VM_POP_JUMP_IF_TRUE, top);
+                _patch_jump(cg, pos1);
+            }
+            return;
+
+        /**
+         * Conditional statements
+         */
+        case T_IF :
+            pos1 = _codegen_cond_jump(cg, p->opr.ops[0], VM_POP_JUMP_IF_FALSE, 0);
+            _codegen_stmt(cg, p->opr.ops[1]);
+
+            if (p->opr.nops > 2) {
+                // Execute (optional) else-block
+                pos2 = _emit(cg, VM_JUMP_ABSOLUTE, 0);
+                _patch_jump(cg, pos1);
+                _codegen_stmt(cg, p->opr.ops[2]);
+                _patch_jump(cg, pos2);
+            } else {
+                _patch_jump(cg, pos1);
+            }
+            return;
+
+        case T_CONST :
+            if (! cg->in_class) {
+                // @TODO: We could create constants OUTSIDE a class!
+                _codegen_error(p, "Defining constants outside classes is not yet supported!");
+            }
+
+            hte = p->opr.ops[0];
+            if (hte->type != typeAstIdentifier) {
+                _codegen_error(p, "Constant name needs to be an identifier");
+            }
+
+            _codegen_expr(cg, p->opr.ops[1]);
+            _emit(cg, VM_STORE_CONST, bytecode_add_variable(cg->bc, hte->identifier.name));
+            return;
+
+        case T_PROPERTY :
+            if (! cg->in_class) {
+                _codegen_error(p, "Cannot define properties outside classes. This should be caught by the parser!");
+            }
+
+            hte = p->opr.ops[1];
+            if (hte->type != typeAstIdentifier) {
+                _codegen_error(p, "Property name needs to be an identifier");
+            }
+
+            _codegen_expr(cg, p->opr.ops[2]);
+            _emit(cg, VM_STORE_PROPERTY, bytecode_add_variable(cg->bc, hte->identifier.name));
+            return;
+
+        default :
+            if (cg->registers && _codegen_reg_stmt(cg, p)) {
+                return;
+            }
+
+            // Expression statement, discard the result
+            _codegen_expr(cg, p);
+            _emit(cg, VM_POP_TOP, 0);
+            return;
+    }
+}
+
+
+/**
+ * Generate bytecode from an AST.
+ */
+t_bytecode *bytecode_generate(t_ast_element *p, char *source_file, int flags) {
+    return _codegen_block(p, (flags & BYTECODE_REGISTERS) ? 1 : 0);
+}
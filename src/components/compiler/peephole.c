@@ -0,0 +1,562 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "compiler/bytecode.h"
+#include "vm/vm_opcodes.h"
+#include "general/smm.h"
+
+// Superinstructions are not fused while the opcode sequences that could be fused are profiled
+int bytecode_superinstructions = 1;
+
+/*
+ * The peephole optimizer rewrites the code of a bytecode structure after it has been generated. The code is
+ * decoded into a list of instructions in which jump targets are instruction indexes instead of byte offsets.
+ * The exception table is converted to instruction indexes as well while the code is decoded, and every
+ * instruction remembers its source line. Removed instructions are turned into NOPs and are dropped when the
+ * code is encoded again.
+ */
+
+typedef struct _peephole_instr {
+    int opcode;             // Opcode of the instruction
+    int oparg;              // Operand (instruction index for jumps)
+    int reg;                // Register of a register jump
+    int is_target;          // 1 when a jump lands on this instruction
+    int line;               // Source line of the instruction (or 0)
+} t_peephole_instr;
+
+typedef struct _peephole {
+    t_bytecode *bc;             // Bytecode we are optimizing
+    t_peephole_instr *instr;    // Decoded instructions
+    int len;                    // Number of instructions
+} t_peephole;
+
+
+/**
+ * Returns 1 when the opcode is a jump that also holds a register in its operand
+ */
+static int _is_reg_jump(int opcode) {
+    return (opcode == VM_REG_JUMP_IF_FALSE || opcode == VM_REG_JUMP_IF_TRUE);
+}
+
+
+/**
+ * Returns the index of the first instruction at or after idx that is not a NOP. Returns the number of
+ * instructions when there is none.
+ */
+static int _next_live(t_peephole *ph, int idx) {
+    while (idx < ph->len && ph->instr[idx].opcode == VM_NOP) idx++;
+    return idx;
+}
+
+
+/**
+ * Decodes the code into instructions. Returns 0 when the code cannot be decoded (or a jump does not land on
+ * an instruction), in which case the code will not be optimized.
+ */
+static int _decode(t_peephole *ph) {
+    t_bytecode *bc = ph->bc;
+
+    // Maps byte offsets to instruction indexes (-1 when the offset is inside an instruction)
+    int *index = smm_malloc((bc->code_len + 1) * sizeof(int));
+    for (int i=0; i<=bc->code_len; i++) index[i] = -1;
+
+    ph->instr = smm_malloc((bc->code_len + 1) * sizeof(t_peephole_instr));
+    ph->len = 0;
+
+    int *line_offsets, *lines;
+    int lines_len = bytecode_get_lines(bc, &line_offsets, &lines);
+    int line = 0, l = 0;
+
+    int pos = 0;
+    while (pos < bc->code_len) {
+        t_peephole_instr *in = &ph->instr[ph->len];
+        index[pos] = ph->len++;
+
+        while (l != lines_len && line_offsets[l] <= pos) line = lines[l++];
+
+        in->reg = 0;
+        in->is_target = 0;
+        in->line = line;
+        pos = vm_decode_instruction((const unsigned char *)bc->code, bc->code_len, pos, &in->opcode, &in->oparg);
+        if (pos == -1) break;
+    }
+    smm_free(line_offsets);
+    smm_free(lines);
+    if (pos == -1) goto error;
+    index[bc->code_len] = ph->len;
+
+    for (int i=0; i!=ph->len; i++) {
+        t_peephole_instr *in = &ph->instr[i];
+        if (! vm_opcode_is_jump(in->opcode)) continue;
+
+        if (_is_reg_jump(in->opcode)) {
+            in->reg = REG_JUMP_REG(in->oparg);
+            in->oparg = REG_JUMP_TARGET(in->oparg);
+        }
+
+        if (in->oparg < 0 || in->oparg > bc->code_len || index[in->oparg] == -1) goto error;
+        in->oparg = index[in->oparg];
+    }
+
+    // Handlers must land on an instruction, and their ranges must start and end on one
+    for (int i=0; i!=bc->handlers_len; i++) {
+        t_bytecode_handler *h = &bc->handlers[i];
+        if (h->start < 0 || h->start > h->end || h->end > bc->code_len) goto error;
+        if (index[h->start] == -1 || index[h->end] == -1 || h->handler < 0 || h->handler >= bc->code_len || index[h->handler] == -1) goto error;
+    }
+    for (int i=0; i!=bc->handlers_len; i++) {
+        t_bytecode_handler *h = &bc->handlers[i];
+        h->start = index[h->start];
+        h->end = index[h->end];
+        h->handler = index[h->handler];
+    }
+
+    smm_free(index);
+    return 1;
+
+error:
+    smm_free(index);
+    smm_free(ph->instr);
+    return 0;
+}
+
+
+/**
+ * Encodes a single instruction into buf, with jumps pointing to the given instruction offsets. The target of a
+ * jump is padded to target_width bytes. Returns the length of the instruction.
+ */
+static int _encode_instr(t_peephole_instr *in, int *offset, unsigned char *buf, int target_width) {
+    int oparg = in->oparg;
+
+    if (_is_reg_jump(in->opcode)) {
+        oparg = REG_JUMP_PACK(in->reg, offset[in->oparg]);
+    } else if (vm_opcode_is_jump(in->opcode)) {
+        oparg = offset[in->oparg];
+    }
+    return vm_encode_instruction(buf, in->opcode, oparg, target_width);
+}
+
+
+/**
+ * Encodes the instructions back into the code, dropping all NOPs
+ */
+static void _encode(t_peephole *ph) {
+    t_bytecode *bc = ph->bc;
+    unsigned char buf[INSTRUCTION_MAX_SIZE];
+
+    /*
+     * New byte offset and size of every instruction. Removed instructions get the offset of the next live
+     * one. The size of a jump depends on the offset of its target, so we repeat until nothing grows anymore.
+     * Sizes never shrink, which guarantees we stop.
+     */
+    int *offset = smm_malloc((ph->len + 1) * sizeof(int));
+    int *size = smm_malloc((ph->len + 1) * sizeof(int));
+    memset(offset, 0, (ph->len + 1) * sizeof(int));
+    memset(size, 0, (ph->len + 1) * sizeof(int));
+
+    int pos, changed;
+    do {
+        changed = 0;
+        pos = 0;
+        for (int i=0; i!=ph->len; i++) {
+            offset[i] = pos;
+            if (ph->instr[i].opcode == VM_NOP) continue;
+
+            int len = _encode_instr(&ph->instr[i], offset, buf, 0);
+            if (len > size[i]) {
+                size[i] = len;
+                changed = 1;
+            }
+            pos += size[i];
+        }
+        offset[ph->len] = pos;
+    } while (changed);
+
+    char *code = smm_malloc(pos ? pos : 1);
+    pos = 0;
+    for (int i=0; i!=ph->len; i++) {
+        t_peephole_instr *in = &ph->instr[i];
+        if (in->opcode == VM_NOP) continue;
+
+        // A jump that ended up shorter than its slot gets a padded target
+        int len = _encode_instr(in, offset, buf, 0);
+        if (len < size[i]) {
+            unsigned char target[OPERAND_MAX_SIZE];
+            int target_len = vm_encode_operand(target, offset[in->oparg], 0);
+            len = _encode_instr(in, offset, buf, target_len + size[i] - len);
+        }
+
+        memcpy(code + pos, buf, len);
+        pos += len;
+    }
+
+    for (int i=0; i!=bc->handlers_len; i++) {
+        t_bytecode_handler *h = &bc->handlers[i];
+        h->start = offset[h->start];
+        h->end = offset[h->end];
+        h->handler = offset[h->handler];
+    }
+
+    int *line_offsets = smm_malloc((ph->len + 1) * sizeof(int));
+    int *lines = smm_malloc((ph->len + 1) * sizeof(int));
+    int lines_len = 0;
+    for (int i=0; i!=ph->len; i++) {
+        if (ph->instr[i].opcode == VM_NOP) continue;
+        line_offsets[lines_len] = offset[i];
+        lines[lines_len++] = ph->instr[i].line;
+    }
+    bytecode_set_lines(bc, line_offsets, lines, lines_len);
+    smm_free(line_offsets);
+    smm_free(lines);
+
+    if (! bc->map) smm_free(bc->code);
+    bc->code = code;
+    bc->code_len = pos;
+
+    smm_free(size);
+    smm_free(offset);
+}
+
+
+/**
+ * Points every jump to the final destination of a chain of unconditional jumps, and removes jumps to the
+ * next instruction. Afterwards every jump lands on a live instruction and is_target is up-to-date. The bounds
+ * and handlers of the exception table count as targets too, so no instruction is fused across them.
+ */
+static int _thread_jumps(t_peephole *ph) {
+    int changed = 0;
+
+    for (int i=0; i!=ph->len; i++) ph->instr[i].is_target = 0;
+
+    for (int i=0; i!=ph->len; i++) {
+        t_peephole_instr *in = &ph->instr[i];
+        if (! vm_opcode_is_jump(in->opcode)) continue;
+
+        // Follow unconditional jumps. The hop limit protects us against jump cycles.
+        int target = _next_live(ph, in->oparg);
+        for (int hops=0; hops != ph->len && target < ph->len && ph->instr[target].opcode == VM_JUMP_ABSOLUTE; hops++) {
+            target = _next_live(ph, ph->instr[target].oparg);
+        }
+        if (target != in->oparg) {
+            in->oparg = target;
+            changed = 1;
+        }
+
+        if (in->opcode == VM_JUMP_ABSOLUTE && target == _next_live(ph, i + 1)) {
+            in->opcode = VM_NOP;
+            changed = 1;
+        }
+    }
+
+    for (int i=0; i!=ph->len; i++) {
+        t_peephole_instr *in = &ph->instr[i];
+        if (vm_opcode_is_jump(in->opcode) && in->oparg < ph->len) ph->instr[in->oparg].is_target = 1;
+    }
+
+    for (int i=0; i!=ph->bc->handlers_len; i++) {
+        t_bytecode_handler *h = &ph->bc->handlers[i];
+        ph->instr[h->handler].is_target = 1;
+        if (h->start < ph->len) ph->instr[h->start].is_target = 1;
+        if (h->end < ph->len) ph->instr[h->end].is_target = 1;
+    }
+
+    return changed;
+}
+
+
+/**
+ * Returns the numerical value of the constant loaded by the instruction, or 0 when it does not load a
+ * numerical constant.
+ */
+static int _numerical_const(t_peephole *ph, t_peephole_instr *in, long *value) {
+    if (in->opcode != VM_LOAD_CONST) return 0;
+    if (in->oparg < 0 || in->oparg >= ph->bc->constants_len) return 0;
+
+    t_bytecode_constant *c = ph->bc->constants[in->oparg];
+    if (c->type != BYTECODE_CONST_NUMERICAL) return 0;
+
+    *value = c->data.l;
+    return 1;
+}
+
+
+/**
+ * Folds LOAD_CONST, LOAD_CONST, BINARY_(ADD|SUBTRACT|MULTIPLY) on numericals into a single LOAD_CONST
+ */
+static int _fold_constants(t_peephole *ph, int i1, int i2, int i3) {
+    t_peephole_instr *a = &ph->instr[i1], *b = &ph->instr[i2], *op = &ph->instr[i3];
+    long l, r;
+    unsigned long result;
+
+    if (! _numerical_const(ph, a, &l) || ! _numerical_const(ph, b, &r)) return 0;
+
+    // Wrap around on overflow instead of relying on undefined behaviour
+    switch (op->opcode) {
+        case VM_BINARY_ADD :      result = (unsigned long)l + (unsigned long)r; break;
+        case VM_BINARY_SUBTRACT : result = (unsigned long)l - (unsigned long)r; break;
+        case VM_BINARY_MULTIPLY : result = (unsigned long)l * (unsigned long)r; break;
+        default :
+            return 0;
+    }
+
+    a->oparg = bytecode_add_constant(ph->bc, BYTECODE_CONST_NUMERICAL, sizeof(long), (void *)(long)result);
+    b->opcode = VM_NOP;
+    op->opcode = VM_NOP;
+    return 1;
+}
+
+
+/**
+ * Runs the patterns over the instructions. Only the first instruction of a pattern may be a jump target.
+ */
+static int _apply_patterns(t_peephole *ph) {
+    int changed = 0;
+
+    for (int i1 = _next_live(ph, 0); i1 < ph->len; i1 = _next_live(ph, i1 + 1)) {
+        int i2 = _next_live(ph, i1 + 1);
+        if (i2 >= ph->len || ph->instr[i2].is_target) continue;
+        int i3 = _next_live(ph, i2 + 1);
+
+        t_peephole_instr *a = &ph->instr[i1], *b = &ph->instr[i2];
+
+        // STORE_VAR x, LOAD_VAR x  =>  DUP_TOP, STORE_VAR x
+        if (a->opcode == VM_STORE_VAR && b->opcode == VM_LOAD_VAR && a->oparg == b->oparg) {
+            a->opcode = VM_DUP_TOP;
+            b->opcode = VM_STORE_VAR;
+            changed = 1;
+            continue;
+        }
+
+        if (i3 >= ph->len || ph->instr[i3].is_target) continue;
+
+        // DUP_TOP, STORE_VAR x, POP_TOP  =>  STORE_VAR x
+        if (a->opcode == VM_DUP_TOP && b->opcode == VM_STORE_VAR && ph->instr[i3].opcode == VM_POP_TOP) {
+            a->opcode = VM_NOP;
+            ph->instr[i3].opcode = VM_NOP;
+            changed = 1;
+            continue;
+        }
+
+        // LOAD_CONST, LOAD_CONST, BINARY_ADD  =>  LOAD_CONST
+        if (_fold_constants(ph, i1, i2, i3)) {
+            changed = 1;
+        }
+    }
+
+    return changed;
+}
+
+
+/**
+ * Replaces LOAD_VAR a, LOAD_(VAR|CONST) b, BINARY_(ADD|SUBTRACT|MULTIPLY), [DUP_TOP,] STORE_VAR c with the
+ * register instruction c = a op b (followed by LOAD_VAR c when the result was duplicated). The result does not
+ * pass through the stack, so the VM can keep a numerical result unboxed in the frame.
+ */
+static int _fuse_register_operator(t_peephole *ph, int i1, int i2, int i3) {
+    if (i3 >= ph->len || ph->instr[i3].is_target) return 0;
+    int i4 = _next_live(ph, i3 + 1);
+    if (i4 >= ph->len || ph->instr[i4].is_target) return 0;
+
+    t_peephole_instr *a = &ph->instr[i1], *b = &ph->instr[i2], *op = &ph->instr[i3], *dup = NULL;
+
+    if (ph->instr[i4].opcode == VM_DUP_TOP) {
+        dup = &ph->instr[i4];
+        i4 = _next_live(ph, i4 + 1);
+        if (i4 >= ph->len || ph->instr[i4].is_target) return 0;
+    }
+    t_peephole_instr *store = &ph->instr[i4];
+
+    if (a->opcode != VM_LOAD_VAR || store->opcode != VM_STORE_VAR) return 0;
+    if (b->opcode != VM_LOAD_VAR && b->opcode != VM_LOAD_CONST) return 0;
+    if (op->opcode != VM_BINARY_ADD && op->opcode != VM_BINARY_SUBTRACT && op->opcode != VM_BINARY_MULTIPLY) return 0;
+    if (a->oparg > REG_MAX || b->oparg > REG_MAX || store->oparg > REG_MAX) return 0;
+
+    int src2 = (b->opcode == VM_LOAD_CONST) ? (b->oparg | REG_CONST) : b->oparg;
+    a->opcode = op->opcode - VM_BINARY_ADD + VM_REG_ADD;
+    a->oparg = REG_PACK(store->oparg, a->oparg, src2);
+    b->opcode = VM_NOP;
+    op->opcode = VM_NOP;
+    if (dup) {
+        dup->opcode = VM_NOP;
+        store->opcode = VM_LOAD_VAR;
+    } else {
+        store->opcode = VM_NOP;
+    }
+    return 1;
+}
+
+
+/**
+ * Replaces LOAD_VAR a, LOAD_(VAR|CONST) b, COMPARE_JUMP_IF_* with the register instructions %c = a cmp b,
+ * REG_JUMP_IF_* %c. The compare reads a raw numerical from the frame, where the LOAD_VAR would have boxed it.
+ * %c only holds the outcome until the jump, so a single register serves all compares.
+ */
+static int _fuse_register_compare(t_peephole *ph, int i1, int i2, int i3) {
+    if (i3 >= ph->len || ph->instr[i3].is_target) return 0;
+
+    t_peephole_instr *a = &ph->instr[i1], *b = &ph->instr[i2], *jump = &ph->instr[i3];
+
+    if (a->opcode != VM_LOAD_VAR) return 0;
+    if (b->opcode != VM_LOAD_VAR && b->opcode != VM_LOAD_CONST) return 0;
+    if (jump->opcode < VM_COMPARE_JUMP_IF_FALSE_EQ || jump->opcode > VM_COMPARE_JUMP_IF_TRUE_GE) return 0;
+    if (a->oparg > REG_MAX || b->oparg > REG_MAX || ph->bc->code_len > REG_JUMP_MAX) return 0;
+
+    int reg = bytecode_add_variable(ph->bc, "%c");
+    if (reg > REG_MAX) return 0;
+
+    int cmp = jump->opcode - VM_COMPARE_JUMP_IF_FALSE_EQ;
+    int jump_if_true = (cmp >= VM_COMPARE_JUMP_IF_TRUE_EQ - VM_COMPARE_JUMP_IF_FALSE_EQ);
+    if (jump_if_true) cmp -= VM_COMPARE_JUMP_IF_TRUE_EQ - VM_COMPARE_JUMP_IF_FALSE_EQ;
+
+    int src2 = (b->opcode == VM_LOAD_CONST) ? (b->oparg | REG_CONST) : b->oparg;
+    a->opcode = VM_REG_COMPARE_EQ + cmp;
+    a->oparg = REG_PACK(reg, a->oparg, src2);
+    b->opcode = VM_NOP;
+    jump->opcode = jump_if_true ? VM_REG_JUMP_IF_TRUE : VM_REG_JUMP_IF_FALSE;
+    jump->reg = reg;
+    return 1;
+}
+
+
+/**
+ * Turns stack arithmetic and compares on variables into register instructions, so the VM can keep numerical
+ * operands and results unboxed in the frame. Runs before the superinstructions are fused, so no
+ * superinstruction takes away one of their instructions.
+ */
+static void _fuse_registers(t_peephole *ph) {
+    for (int i1 = _next_live(ph, 0); i1 < ph->len; i1 = _next_live(ph, i1 + 1)) {
+        int i2 = _next_live(ph, i1 + 1);
+        if (i2 >= ph->len || ph->instr[i2].is_target) continue;
+        int i3 = _next_live(ph, i2 + 1);
+        if (! _fuse_register_operator(ph, i1, i2, i3)) {
+            _fuse_register_compare(ph, i1, i2, i3);
+        }
+    }
+}
+
+
+/**
+ * Fuses the count (2 or 3) instructions starting at i1 into a superinstruction. Returns 0 when there is no
+ * superinstruction for them, or when their operands do not fit into it.
+ */
+static int _fuse_superinstruction(t_peephole *ph, int *idx, int count) {
+    int opcodes[3], operands[2];
+    int operands_len = 0;
+
+    for (int i=0; i!=count; i++) {
+        t_peephole_instr *in = &ph->instr[idx[i]];
+        opcodes[i] = in->opcode;
+        if (in->opcode < HAVE_ARGUMENT) continue;
+
+        // Two operands are packed into 16 bits each
+        if (operands_len == 2 || in->oparg < 0 || in->oparg > 0xFFFF) return 0;
+        operands[operands_len++] = in->oparg;
+    }
+
+    int op = vm_superinstruction_find(opcodes, count);
+    if (! op) return 0;
+
+    t_peephole_instr *first = &ph->instr[idx[0]];
+    first->opcode = op;
+    if (operands_len == 2) {
+        first->oparg = operands[0] | (operands[1] << 16);
+    } else {
+        first->oparg = operands_len ? operands[0] : 0;
+    }
+    for (int i=1; i!=count; i++) {
+        ph->instr[idx[i]].opcode = VM_NOP;
+    }
+    return 1;
+}
+
+
+/**
+ * Replaces frequent instruction sequences with superinstructions (see vm_superinstructions.h). This runs after
+ * all other rewrites, as the patterns do not know about superinstructions.
+ */
+static void _fuse_superinstructions(t_peephole *ph) {
+    if (! bytecode_superinstructions) return;
+
+    for (int i1 = _next_live(ph, 0); i1 < ph->len; i1 = _next_live(ph, i1 + 1)) {
+        int i2 = _next_live(ph, i1 + 1);
+        if (i2 >= ph->len || ph->instr[i2].is_target) continue;
+        int i3 = _next_live(ph, i2 + 1);
+
+        // Three instructions save more dispatches than two
+        int idx[3] = { i1, i2, i3 };
+        if (i3 < ph->len && ! ph->instr[i3].is_target && _fuse_superinstruction(ph, idx, 3)) continue;
+        _fuse_superinstruction(ph, idx, 2);
+    }
+}
+
+
+/**
+ * Re-encodes the code with the shortest possible jump targets. Code that cannot be decoded is left alone.
+ */
+void bytecode_shrink(t_bytecode *bc) {
+    t_peephole ph;
+
+    ph.bc = bc;
+    if (! _decode(&ph)) return;
+
+    _encode(&ph);
+    smm_free(ph.instr);
+}
+
+
+/**
+ * Optimizes the bytecode and all the code constants inside it. Register instructions are only fused in when
+ * flags has BYTECODE_UNBOX.
+ */
+void bytecode_optimize(t_bytecode *bc, int flags) {
+    t_peephole ph;
+
+    for (int i=0; i!=bc->constants_len; i++) {
+        if (bc->constants[i]->type == BYTECODE_CONST_CODE) {
+            bytecode_optimize(bc->constants[i]->data.code, flags);
+        }
+    }
+
+    ph.bc = bc;
+    if (! _decode(&ph)) return;
+
+    // Keep going until nothing changes, as one rewrite can enable another one
+    int changed;
+    do {
+        changed = _thread_jumps(&ph);
+        changed |= _apply_patterns(&ph);
+    } while (changed);
+
+    if (flags & BYTECODE_UNBOX) {
+        _fuse_registers(&ph);
+    }
+    _fuse_superinstructions(&ph);
+
+    _encode(&ph);
+    smm_free(ph.instr);
+}
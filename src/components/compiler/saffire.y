@@ -279,6 +279,7 @@ jump_statement:
     |   T_CONTINUE ';'              { saffire_validate_continue(); TRACE $$ = ast_opr(T_CONTINUE, 0); }
     |   T_RETURN ';'                { saffire_validate_return(); TRACE $$ = ast_opr(T_RETURN, 0); }
     |   T_RETURN expression ';'     { saffire_validate_return(); TRACE $$ = ast_opr(T_RETURN, 1, $2); }
+    |   T_YIELD expression ';'      { saffire_validate_yield(); TRACE $$ = ast_opr(T_YIELD, 1, $2); }
     |   T_THROW expression ';'      { TRACE $$ = ast_opr(T_THROW, 1, $2); }
     |   T_GOTO T_IDENTIFIER ';'     { TRACE $$ = ast_opr(T_GOTO, 1, ast_string($2)); smm_free($2); }
     |   T_GOTO T_LNUM ';'           { TRACE $$ = ast_opr(T_GOTO, 1, ast_numerical($2)); }
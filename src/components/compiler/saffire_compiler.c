@@ -393,6 +393,16 @@ void saffire_validate_return() {
 }
 
 
+/**
+ * Make sure yield happens inside a method
+ */
+void saffire_validate_yield() {
+    if (global_table->in_method == 0) {
+        sfc_error("Cannot use yield outside a method");
+    }
+}
+
+
 /**
  * Make sure break happens inside a loop
  *
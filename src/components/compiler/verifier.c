@@ -0,0 +1,245 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include "compiler/bytecode.h"
+#include "vm/vm_opcodes.h"
+#include "objects/object.h"
+#include "general/smm.h"
+
+/*
+ * The verifier checks bytecode once, before the VM runs it. Every operand must point inside the constant or
+ * variable table, every jump must land on an instruction, the code may never run past its end and the stack
+ * must be at the same level every time an instruction is reached. Exception handlers must land on an instruction
+ * and may only cut the stack back to a level the instructions they cover actually have. Along the way it
+ * calculates the highest stack level, which becomes the stack size of the bytecode.
+ *
+ * The VM depends on this: it does not check any of these things by itself.
+ */
+
+#define LEVEL_NO_INSTRUCTION    -1      // Offset is not the start of an instruction
+#define LEVEL_NOT_REACHED       -2      // Instruction has not been reached (yet)
+
+
+/**
+ * Returns 1 when idx is a valid variable index
+ */
+static int _is_variable(t_bytecode *bc, unsigned int idx) {
+    return idx < (unsigned int)bc->variables_len;
+}
+
+
+/**
+ * Returns 1 when idx is a valid constant index
+ */
+static int _is_constant(t_bytecode *bc, unsigned int idx) {
+    return idx < (unsigned int)bc->constants_len;
+}
+
+
+/**
+ * Returns 1 when src is a valid source operand of a register instruction
+ */
+static int _is_source(t_bytecode *bc, unsigned int src) {
+    if (src & REG_CONST) return _is_constant(bc, src & REG_MAX);
+    return _is_variable(bc, src);
+}
+
+
+/**
+ * Returns 1 when the operand of the instruction is valid. Jump targets are checked later on.
+ */
+static int _check_operand(t_bytecode *bc, int opcode, int oparg) {
+    unsigned int arg = (unsigned int)oparg;
+
+    // Quickened opcodes take the same operands as their generic opcode
+    opcode = vm_opcode_generic(opcode);
+
+    // Superinstructions take the operands of their components
+    int opcodes[3], opargs[3];
+    int count = vm_superinstruction_split(opcode, oparg, opcodes, opargs);
+    if (count) {
+        for (int i=0; i!=count; i++) {
+            if (! _check_operand(bc, opcodes[i], opargs[i])) return 0;
+        }
+        return 1;
+    }
+
+    if ((opcode >= VM_REG_MOVE && opcode <= VM_REG_SHR) || (opcode >= VM_REG_COMPARE_EQ && opcode <= VM_REG_COMPARE_GE)) {
+        // A move only has a single source
+        return _is_variable(bc, REG_DST(arg)) && _is_source(bc, REG_SRC1(arg)) &&
+               (opcode == VM_REG_MOVE || _is_source(bc, REG_SRC2(arg)));
+    }
+
+    switch (opcode) {
+        case VM_LOAD_CONST :
+            return _is_constant(bc, arg);
+
+        case VM_STORE_VAR :
+        case VM_STORE_CONST :
+        case VM_STORE_PROPERTY :
+        case VM_STORE_METHOD :
+        case VM_LOAD_VAR :
+        case VM_LOAD_ATTRIB :
+        case VM_LOAD_METHOD :
+        case VM_IMPORT :
+        case VM_USE :
+            return _is_variable(bc, arg);
+
+        case VM_COMPARE_OP :
+            return (arg >= COMPARISON_EQ && arg <= COMPARISON_NI);
+
+        // There cannot be more arguments than instructions that pushed them
+        case VM_CALL_METHOD :
+        case VM_TAIL_CALL :
+            return arg < (unsigned int)bc->code_len;
+
+        case VM_REG_JUMP_IF_FALSE :
+        case VM_REG_JUMP_IF_TRUE :
+            return _is_variable(bc, REG_JUMP_REG(arg));
+    }
+
+    return 1;
+}
+
+
+/**
+ * Continues at the instruction at pos with the given stack level. Returns 0 when pos is not an instruction,
+ * or when the instruction was already reached with another stack level.
+ */
+static int _reach(int *level, int len, int *work, int *work_len, int pos, int stack_level) {
+    if (pos < 0 || pos >= len || level[pos] == LEVEL_NO_INSTRUCTION) return 0;
+
+    if (level[pos] == LEVEL_NOT_REACHED) {
+        level[pos] = stack_level;
+        work[(*work_len)++] = pos;
+        return 1;
+    }
+
+    return (level[pos] == stack_level);
+}
+
+
+/**
+ * Verifies the code of a single bytecode structure and sets its stack size. Returns 1 when the code is valid.
+ */
+static int _verify_code(t_bytecode *bc) {
+    const unsigned char *code = (const unsigned char *)bc->code;
+    int len = bc->code_len;
+    int opcode, oparg, needed, peak;
+    int max_level = 0;
+    int ret = 0;
+
+    // Stack level on entry of every instruction
+    int *level = smm_malloc((len + 1) * sizeof(int));
+    for (int i=0; i<=len; i++) level[i] = LEVEL_NO_INSTRUCTION;
+
+    // Every instruction is added at most once
+    int *work = smm_malloc((len + 1) * sizeof(int));
+    int work_len = 0;
+
+    // Decode all instructions and check their operands
+    for (int pos = 0; pos < len; ) {
+        int next = vm_decode_instruction(code, len, pos, &opcode, &oparg);
+        if (next == -1 || ! vm_opcode_name(opcode) || ! _check_operand(bc, opcode, oparg)) goto done;
+
+        level[pos] = LEVEL_NOT_REACHED;
+        pos = next;
+    }
+
+    // Follow every path through the code, starting with an empty stack. Handlers start with the exception on
+    // top of the level they cut the stack back to.
+    if (! _reach(level, len, work, &work_len, 0, 0)) goto done;
+    for (int i=0; i!=bc->handlers_len; i++) {
+        t_bytecode_handler *h = &bc->handlers[i];
+        if (h->start < 0 || h->start > h->end || h->end > len || h->stack_level < 0 || h->stack_level >= len) goto done;
+        if (! _reach(level, len, work, &work_len, h->handler, h->stack_level + 1)) goto done;
+    }
+
+    while (work_len) {
+        int pos = work[--work_len];
+        int next = vm_decode_instruction(code, len, pos, &opcode, &oparg);
+        int effect = vm_opcode_stack_effect(opcode, oparg, &needed, &peak);
+
+        if (level[pos] < needed) goto done;
+        if (level[pos] + peak > max_level) max_level = level[pos] + peak;
+
+        int stack_level = level[pos] + effect;
+
+        if (vm_opcode_is_jump(opcode)) {
+            int target = oparg;
+            if (opcode == VM_REG_JUMP_IF_FALSE || opcode == VM_REG_JUMP_IF_TRUE) target = REG_JUMP_TARGET(oparg);
+            int jump_level = level[pos] + vm_opcode_jump_stack_effect(opcode, oparg);
+            if (! _reach(level, len, work, &work_len, target, jump_level)) goto done;
+        }
+
+        // A frame that yields can be suspended, so the VM runs it as a generator
+        if (opcode == VM_YIELD_VALUE) bc->generator = 1;
+
+        // Everything else continues with the next instruction, which must exist
+        if (opcode == VM_JUMP_ABSOLUTE || opcode == VM_RETURN_VALUE || opcode == VM_TAIL_CALL || opcode == VM_STOP_CODE ||
+            opcode == VM_THROW) continue;
+        if (! _reach(level, len, work, &work_len, next, stack_level)) goto done;
+    }
+
+    // The VM pops the stack down to the level of the handler, so an instruction that throws may never have
+    // popped below it already
+    for (int i=0; i!=bc->handlers_len; i++) {
+        t_bytecode_handler *h = &bc->handlers[i];
+        for (int pos = h->start; pos < h->end; pos++) {
+            if (level[pos] < 0) continue;
+            vm_decode_instruction(code, len, pos, &opcode, &oparg);
+            vm_opcode_stack_effect(opcode, oparg, &needed, &peak);
+            if (level[pos] - needed < h->stack_level) goto done;
+        }
+    }
+
+    bc->stack_size = max_level;
+    ret = 1;
+
+done:
+    smm_free(work);
+    smm_free(level);
+    return ret;
+}
+
+
+/**
+ * Verifies the bytecode and all the code constants inside it. Returns 1 when the bytecode can be run safely.
+ */
+int bytecode_verify(t_bytecode *bc) {
+    if (bc->verified) return 1;
+
+    for (int i=0; i!=bc->constants_len; i++) {
+        if (bc->constants[i]->type != BYTECODE_CONST_CODE) continue;
+        if (! bytecode_verify(bc->constants[i]->data.code)) return 0;
+    }
+
+    if (! _verify_code(bc)) return 0;
+
+    bc->verified = 1;
+    return 1;
+}
@@ -0,0 +1,82 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include "general/crc32.h"
+
+static uint32_t crc32_table[256];
+static int crc32_table_initialized = 0;
+
+
+/**
+ * Creates the lookup table for the (reflected) CRC32 polynomial 0xEDB88320
+ */
+static void crc32_init(void) {
+    for (uint32_t i=0; i!=256; i++) {
+        uint32_t c = i;
+        for (int k=0; k!=8; k++) {
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : (c >> 1);
+        }
+        crc32_table[i] = c;
+    }
+    crc32_table_initialized = 1;
+}
+
+
+/**
+ * Updates a CRC32 with the given buffer. Start with a crc of 0.
+ */
+uint32_t crc32_calc(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = buf;
+
+    if (! crc32_table_initialized) crc32_init();
+
+    crc = crc ^ 0xFFFFFFFF;
+    while (len--) {
+        crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+
+/**
+ * Calculates the CRC32 of a complete file. Returns 0 when the file could not be read.
+ */
+int crc32_file(const char *filename, uint32_t *crc) {
+    char buf[8192];
+    size_t len;
+
+    FILE *f = fopen(filename, "rb");
+    if (! f) return 0;
+
+    *crc = 0;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+        *crc = crc32_calc(*crc, buf, len);
+    }
+    fclose(f);
+
+    return 1;
+}
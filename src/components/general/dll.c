@@ -169,8 +169,6 @@ t_dll_element *dll_insert_after(t_dll *dll, t_dll_element *after_element, void *
  * Remove an element from the linked list
  */
 int dll_remove(t_dll *dll, t_dll_element *element) {
-    t_dll_element *tmp;
-
     if (element == dll->head) {
         dll->head = dll->head->next;
     }
@@ -178,11 +176,11 @@ int dll_remove(t_dll *dll, t_dll_element *element) {
         dll->tail = dll->tail->prev;
     }
 
-    dll->size--;
+    // Unlink from our neighbours. The element itself keeps its pointers so iterations can continue.
+    if (element->prev) element->prev->next = element->next;
+    if (element->next) element->next->prev = element->prev;
 
-    tmp = element->next;
-    element->next = element->prev;
-    element->prev = tmp;
+    dll->size--;
 
     return 1;
 }
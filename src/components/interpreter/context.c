@@ -33,31 +33,6 @@
 #include "general/hashtable.h"
 #include "general/smm.h"
 
-/**
- * Like strstr but backwards search
- */
-char *strrstr(char *x,char *y) {
-    int m = strlen(x);
-    int n = strlen(y);
-    char *X = smm_malloc(m+1);
-    char *Y = smm_malloc(n+1);
-    int i;
-    for (i=0; i<m; i++) X[m-1-i] = x[i];
-    X[m] = 0;
-    for (i=0; i<n; i++) Y[n-1-i] = y[i];
-    Y[n] = 0;
-    char *Z = strstr(X,Y);
-    if (Z) {
-        int ro = Z-X;
-        int lo = ro+n-1;
-        int ol = m-1-lo;
-        Z = x+ol;
-    }
-    smm_free(X);
-    smm_free(Y);
-    return Z;
-}
-
 // These are our context separators
 #define NS_SEPARATOR "::"
 #define DOUBLE_NS_SEPARATOR NS_SEPARATOR NS_SEPARATOR
@@ -127,6 +102,9 @@ static t_ns_context *_si_create_ctx(const char *name, int aliased, t_ns_context
     // Populate new context
     new_ctx->name = smm_strdup(new_ctx_name);
     new_ctx->aliased = aliased;
+    new_ctx->slots = NULL;
+    new_ctx->slots_len = 0;
+    new_ctx->slots_size = 0;
     if (aliased) {
         new_ctx->data.alias = ctx;
     } else {
@@ -192,25 +170,23 @@ char *si_create_fqn(const char *var, t_ns_context *ctx) {
 
 
 /**
- * Splits a fully qualified variable name into context and variable separated.
+ * Returns the context registered under the fully qualified name, following aliases. Returns NULL when the
+ * context does not exist.
  */
-void si_split_var(t_ns_context *current_ctx, const char *var, char **fqn_ctx, char **fqn_var) {
-    char *fqn = si_create_fqn(var, current_ctx);
+static t_ns_context *_si_lookup_context(const char *name) {
+    t_ns_context *ctx = ht_find(ht_contexts, (char *)name);
+    if (! ctx) return NULL;
 
-    // We now have a fully qualified name. We now can split the variable from the name, and check for presence
-    char *ch = strrstr(fqn, NS_SEPARATOR);
-    if (ch == NULL) {
-        saffire_error("Cannot find last %s in fully qualified name '%s'!", NS_SEPARATOR, fqn);
+    // Check if context is aliased, if so, goto the alias
+    int i=10;
+    while (i--) {
+        if (! ctx->aliased) return ctx;
+        ctx = ctx->data.alias;
     }
 
-    // Strip context and variable
-    int len = ch - fqn;
-    if (len == 0) len = strlen(NS_SEPARATOR);
-    *fqn_var = smm_strdup(ch + strlen(NS_SEPARATOR));
-    *fqn_ctx = smm_strdup(fqn);
-    (*fqn_ctx)[len] = '\0';
-
-    smm_free(fqn);
+    // Prevent endless loops:    context1 -> context2 -> context1
+    saffire_error("Context nesting too deep!");
+    return NULL;
 }
 
 
@@ -219,28 +195,69 @@ void si_split_var(t_ns_context *current_ctx, const char *var, char **fqn_ctx, ch
  */
 t_ns_context *si_find_context(const char *name) {
     char *ctx_name = si_create_fqn(name, NULL);
+    t_ns_context *ctx = _si_lookup_context(ctx_name);
+    smm_free(ctx_name);
+    return ctx;
+}
 
-    t_ns_context *ctx = ht_find(ht_contexts, (char *)ctx_name);
-    if (!ctx) {
-        smm_free(ctx_name);
-        return NULL;
+
+/**
+ * Finds the context of a (qualified or unqualified) variable, and returns the name of the variable inside that
+ * context. When the context does not exist, it is NULL or an error is raised (when required is set). Unqualified
+ * variables are found without allocating.
+ */
+static const char *_si_var_context(const char *var, t_ns_context *cur_ctx, t_ns_context **ctx, int required) {
+    if (cur_ctx == NULL) {
+        cur_ctx = si_get_current_context();
     }
 
-    // Check if context is aliased, if so, goto the alias
-    int i=10;
-    while (i--) {
-        if (! ctx->aliased) {
-            smm_free(ctx_name);
-            return ctx;
+    // The name of the variable starts after the last separator
+    const char *sep = NULL;
+    for (const char *s = strstr(var, NS_SEPARATOR); s; s = strstr(s + 1, NS_SEPARATOR)) {
+        sep = s;
+    }
+
+    if (sep == NULL) {
+        *ctx = _si_lookup_context(cur_ctx->name);
+        if (*ctx == NULL && required) {
+            saffire_error("Unknown context '%s'", cur_ctx->name);
         }
-        ctx = ctx->data.alias;
+        return var;
     }
 
+    // Everything in front of the separator is the context, which could be relative to the current one
+    char *fqn = si_create_fqn(var, cur_ctx);
+    int len = strlen(fqn) - strlen(sep);
+    if (len == 0) len = strlen(NS_SEPARATOR);
+    fqn[len] = '\0';
 
-    // Prevent endless loops:    context1 -> context2 -> context1
-    smm_free(ctx_name);
-    saffire_error("Context nesting too deep!");
-    return NULL;
+    *ctx = _si_lookup_context(fqn);
+    if (*ctx == NULL && required) {
+        saffire_error("Unknown context '%s'", fqn);
+    }
+    smm_free(fqn);
+
+    return sep + strlen(NS_SEPARATOR);
+}
+
+
+/**
+ * Returns the slot of the variable inside the context. When the variable has no slot yet, an empty one is
+ * added when create is set, otherwise -1 is returned.
+ */
+static int _si_var_slot(t_ns_context *ctx, const char *name, int create) {
+    long slot = (long)ht_find(ctx->data.vars, (char *)name);
+    if (slot) return slot - 1;
+    if (! create) return -1;
+
+    if (ctx->slots_len == ctx->slots_size) {
+        ctx->slots_size = ctx->slots_size ? ctx->slots_size * 2 : 16;
+        ctx->slots = smm_realloc(ctx->slots, ctx->slots_size * sizeof(t_object *));
+    }
+    ctx->slots[ctx->slots_len] = NULL;
+    ht_add(ctx->data.vars, name, (void *)(long)(ctx->slots_len + 1));
+
+    return ctx->slots_len++;
 }
 
 
@@ -256,76 +273,62 @@ t_ns_context *si_get_context(const char *name) {
 }
 
 
+/**
+ * Binds the variable to the slot it uses inside its context, so it can be accessed by index from now on. The
+ * slot is added (empty) when the variable does not exist yet. Returns 0 when the context does not exist.
+ */
+int si_bind_var_in_context(const char *var, t_ns_context *cur_ctx, t_ns_context **ctx, int *slot) {
+    const char *name = _si_var_context(var, cur_ctx, ctx, 0);
+    if (*ctx == NULL) return 0;
+
+    *slot = _si_var_slot(*ctx, name, 1);
+    return 1;
+}
+
+
 /**
  *
  */
 int si_create_var_in_context(const char *var, t_ns_context *cur_ctx, t_object *obj, int mode) {
-    char *fqn_ctx, *fqn_var;
-
-    if (cur_ctx == NULL) {
-        cur_ctx = si_get_current_context();
-    }
+    t_ns_context *ctx;
 
-    // Create fqn from our variable
-    si_split_var(cur_ctx, var, &fqn_ctx, &fqn_var);
+    const char *name = _si_var_context(var, cur_ctx, &ctx, 1);
 
-    t_ns_context *ctx = si_get_context(fqn_ctx);
-    if (ctx == NULL) {
-        saffire_error("Cannot find context '%s'", fqn_ctx);
-    }
+    int slot = _si_var_slot(ctx, name, 1);
 
     // Check if var exists
-    int var_exists = ht_exists(ctx->data.vars, fqn_var);
+    int var_exists = (SI_SLOT(ctx, slot) != NULL);
 
     if (mode == CTX_CREATE_ONLY && var_exists) {
-        saffire_error("Variable %s already exists inside %s", fqn_var, ctx->name);
+        saffire_error("Variable %s already exists inside %s", name, ctx->name);
     }
 
     if (mode == CTX_UPDATE_ONLY && ! var_exists) {
-        saffire_error("Variable %s does not exist inside %s", fqn_var, ctx->name);
-    }
-
-    if (var_exists) {
-        ht_replace(ctx->data.vars, fqn_var, obj);
-    } else {
-        ht_add(ctx->data.vars, fqn_var, obj);
+        saffire_error("Variable %s does not exist inside %s", name, ctx->name);
     }
 
+    SI_SLOT(ctx, slot) = obj;
     return 1;
 }
 
 
 /**
- * Returns the bucket of the variable. Will take care of namespacing depending on the given context
+ * Returns the object of the variable, or NULL when it does not exist. Will take care of namespacing depending on
+ * the given context
  */
 t_object *si_find_var_in_context(const char *var, t_ns_context *cur_ctx) {
-    char *fqn_ctx, *fqn_var;
-
-    if (cur_ctx == NULL) {
-        cur_ctx = si_get_current_context();
-    }
-
-    // Create fqn from our variable
-    si_split_var(cur_ctx, var, &fqn_ctx, &fqn_var);
-
-    t_ns_context *ctx = si_get_context(fqn_ctx);
-    if (ctx == NULL) {
-        saffire_error("Cannot find context '%s'", fqn_ctx);
-    }
-
-    // Find variable in name
-    t_object *obj = ht_find(ctx->data.vars, fqn_var);
+    t_ns_context *ctx;
 
-    // Free temp vars
-    smm_free(fqn_var);
-    smm_free(fqn_ctx);
+    const char *name = _si_var_context(var, cur_ctx, &ctx, 1);
 
-    return obj;
+    int slot = _si_var_slot(ctx, name, 0);
+    return slot == -1 ? NULL : SI_SLOT(ctx, slot);
 }
 
 
 void si_context_add_object(t_ns_context *ctx, t_object *obj) {
-    ht_add(ctx->data.vars, obj->name, obj);
+    int slot = _si_var_slot(ctx, obj->name, 1);
+    SI_SLOT(ctx, slot) = obj;
 }
 
 
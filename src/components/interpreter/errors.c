@@ -29,27 +29,43 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include "interpreter/errors.h"
-#include "general/dll.h"
-
-extern t_dll *lineno_stack;
+#include "interpreter/interpreter.h"
+#include "vm/vm.h"
+#include "vm/vm_trace.h"
 
 #define STREAM_ERROR stderr
 #define STREAM_WARNING stderr
 
 
+/**
+ * Returns the line number of the code currently running, or 0 when it is not known. A node that is interpreted
+ * from inside the VM (a native method) is the innermost code, so the interpreter goes first.
+ */
+static int _current_lineno(void) {
+    int lineno = interpreter_lineno();
+    return lineno ? lineno : vm_lineno();
+}
+
+
 /**
  * Print out an error and exit
  */
 void saffire_error(char *str, ...) {
-    t_dll_element *e = DLL_TAIL(lineno_stack);
-    int lineno = (int)e->data;
+    int lineno = _current_lineno();
 
     va_list args;
     va_start(args, str);
-    fprintf(STREAM_ERROR, "Error in line %d: ", lineno);
+    if (lineno) {
+        fprintf(STREAM_ERROR, "Error in line %d: ", lineno);
+    } else {
+        fprintf(STREAM_ERROR, "Error: ");
+    }
     vfprintf(STREAM_ERROR, str, args);
     fprintf(STREAM_ERROR, "\n");
     va_end(args);
+
+    // Keep the last executed opcodes for post-mortem debugging
+    vm_trace_dump();
     exit(1);
 }
 
@@ -58,12 +74,15 @@ void saffire_error(char *str, ...) {
  * Print out an error and exit
  */
 void saffire_warning(char *str, ...) {
-    t_dll_element *e = DLL_TAIL(lineno_stack);
-    int lineno = (int)e->data;
+    int lineno = _current_lineno();
 
     va_list args;
     va_start(args, str);
-    fprintf(STREAM_WARNING, "Warning in line %d: ", lineno);
+    if (lineno) {
+        fprintf(STREAM_WARNING, "Warning in line %d: ", lineno);
+    } else {
+        fprintf(STREAM_WARNING, "Warning: ");
+    }
     vfprintf(STREAM_WARNING, str, args);
     fprintf(STREAM_WARNING, "\n");
     va_end(args);
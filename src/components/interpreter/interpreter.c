@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 #include "interpreter/interpreter.h"
 #include "interpreter/context.h"
 #include "interpreter/errors.h"
@@ -47,10 +48,10 @@
 #include "debug.h"
 
 extern char *get_token_string(int token);
-static t_snode *_interpreter(t_ast_element *p);
+static t_snode _interpreter(t_ast_element *p);
 
-// A stack maintained by the AST which holds the current line for the current AST
-t_dll *lineno_stack;
+// The node that is currently being interpreted. Its line number is only looked at when an error is raised.
+static t_ast_element *current_node = NULL;
 
 extern char *wctou8(const wchar_t *wstr, long len);
 #define OBJ2STR(_obj_) wctou8(((t_string_object *)_obj_)->value, ((t_string_object *)_obj_)->char_length)
@@ -85,9 +86,6 @@ extern t_hash_table *object_hash;
  *
  */
 static void si_init(void) {
-    // Create stack for linenumbers
-    lineno_stack = dll_init();
-
     // Initialize scope
     scope_stack = stack_init();
 
@@ -104,9 +102,6 @@ static void si_init(void) {
  *
  */
 static void si_fini(void) {
-    // @TODO: Something is wrong with freeing this DLL :(
-    //dll_free(lineno_stack);
-
     stack_free(scope_stack);
 }
 
@@ -121,16 +116,16 @@ static void si_fini(void) {
 static t_object *si_get_object(t_snode *node) {
     t_object *obj;
 
-    if (IS_OBJECT(node)) {
+    if (IS_OBJECT(*node)) {
         return node->data.obj;
     }
 
-    if (HAS_IDENTIFIER_OBJ(node)) {
+    if (HAS_IDENTIFIER_OBJ(*node)) {
         // Fetch object where this var references to, and add it to the destination var
         return node->data.id.obj;
     }
 
-    if (HAS_IDENTIFIER_ID(node)) {
+    if (HAS_IDENTIFIER_ID(*node)) {
         // Fetch object where this var references to, and add it to the destination var
         //t_hash_table_bucket *htb = si_find_in_context(node->data.id.id);
         char *key = node->data.id.id;
@@ -152,12 +147,12 @@ static t_object *si_get_object(t_snode *node) {
 static void si_set_object(t_snode *node, t_object *dst_obj) {
     t_object *src_obj = NULL;
 
-    if (! IS_IDENTIFIER(node)) {
+    if (! IS_IDENTIFIER(*node)) {
         saffire_error("Trying to set an object to a non-variable");
     }
 
     // Decrease source object reference count (if any object is present)
-    if (HAS_IDENTIFIER_OBJ(node)) {
+    if (HAS_IDENTIFIER_OBJ(*node)) {
         src_obj = si_get_object(node);
         if (src_obj != dst_obj) {
             // Only decrease when they are not equal (ie: when changing objects)
@@ -166,7 +161,11 @@ static void si_set_object(t_snode *node, t_object *dst_obj) {
     }
 
     // Add or replace the object
-    si_create_var_in_context(node->data.id.id, NULL, dst_obj, CTX_CREATE_OR_UPDATE);
+    if (node->data.id.context) {
+        SI_SLOT(node->data.id.context, node->data.id.slot) = dst_obj;
+    } else {
+        si_create_var_in_context(node->data.id.id, NULL, dst_obj, CTX_CREATE_OR_UPDATE);
+    }
 
     if (src_obj != dst_obj) {
         // Only increase when they are not equal (ie: when changed)
@@ -175,18 +174,60 @@ static void si_set_object(t_snode *node, t_object *dst_obj) {
 }
 
 
+/**
+ * Returns the built-in constant object (True, False or Null) for the name, or NULL when it is no built-in
+ */
+static t_object *si_builtin_constant(const char *name) {
+    if (strcasecmp(name, "True") == 0) return Object_True;
+    if (strcasecmp(name, "False") == 0) return Object_False;
+    if (strcasecmp(name, "Null") == 0) return Object_Null;
+    return NULL;
+}
+
+
+/**
+ * Returns the object for a string or numerical constant node. The object is created the first time the node is
+ * used, and is never freed afterwards, so every next evaluation is a plain pointer fetch.
+ */
+static t_object *si_literal(t_ast_element *p) {
+    t_object **literal = (p->type == typeAstString) ? &p->string.object : &p->numerical.object;
+    if (*literal) return *literal;
+
+    if (p->type == typeAstString) {
+        DEBUG_PRINT("new string object: '%s'\n", p->string.value);
+
+        // Convert the string to wchar, and create the string object
+        int len = strlen(p->string.value);
+        wchar_t *wchar_tmp = (wchar_t *)smm_malloc((len + 1) * sizeof(wchar_t));
+        memset(wchar_tmp, 0, (len + 1) * sizeof(wchar_t));
+        mbstowcs(wchar_tmp, p->string.value, len);
+
+        *literal = object_new(Object_String, wchar_tmp);
+        smm_free(wchar_tmp);
+    } else {
+        DEBUG_PRINT("new numerical object: %d\n", p->numerical.value);
+        *literal = object_new(Object_Numerical, (long)p->numerical.value);
+    }
+
+    (*literal)->flags |= OBJECT_FLAG_STATIC;
+    return *literal;
+}
+
+
 /**
  * Compare the objects according to the comparison (returns 0 or 1)
  */
-static t_snode *si_comparison(t_ast_element *p, int cmp) {
-    t_snode *node1 = SI0(p);
-    t_snode *node2 = SI1(p);
+static t_snode si_comparison(t_ast_element *p, int cmp) {
+    t_snode node1 = SI0(p);
+    t_snode node2 = SI1(p);
 
     // Check if the references are to the same object and we are doing a ==. If so, we are always true
-    if (IS_OBJECT(node1) && IS_OBJECT(node2) && cmp == COMPARISON_EQ && node1->data.obj == node2->data.obj) return 0;
+    if (IS_OBJECT(node1) && IS_OBJECT(node2) && cmp == COMPARISON_EQ && node1.data.obj == node2.data.obj) {
+        RETURN_SNODE_OBJECT(Object_True);
+    }
 
-    t_object *obj1 = si_get_object(node1);
-    t_object *obj2 = si_get_object(node2);
+    t_object *obj1 = si_get_object(&node1);
+    t_object *obj2 = si_get_object(&node2);
     if (obj1->type != obj2->type) {
         saffire_error("Types on comparison are not equal");
     }
@@ -200,17 +241,18 @@ static t_snode *si_comparison(t_ast_element *p, int cmp) {
 /**
  * Calls object's operator
  */
-static t_snode *si_operator(t_ast_element *p, int opr) {
-    t_snode *node1 = SI0(p);
-    t_snode *node2 = SI1(p);
+static t_snode si_operator(t_ast_element *p, int opr) {
+    t_snode node1 = SI0(p);
+    t_snode node2 = SI1(p);
 
-    t_object *obj1 = si_get_object(node1);
-    t_object *obj2 = si_get_object(node2);
+    t_object *obj1 = si_get_object(&node1);
+    t_object *obj2 = si_get_object(&node2);
     if (obj1->type != obj2->type) {
         saffire_error("Types on operator are not equal");
     }
 
-    t_object *obj = object_operator(obj1, opr, 0, 1, obj2);
+    if (! p->cache) p->cache = object_cache_new();
+    t_object *obj = object_operator_cached(obj1, opr, 0, obj2, p->cache);
     RETURN_SNODE_OBJECT(obj);
 }
 
@@ -262,19 +304,15 @@ t_object_funcs user_funcs = {
 /**
  *
  */
-static t_snode *_interpreter(t_ast_element *p) {
+static t_snode _interpret_node(t_ast_element *p) {
     t_object *obj, *obj1, *obj2, *obj3;
-    t_snode *node1, *node2, *node3;
+    t_snode node1, node2, node3;
     int initial_loop;
     t_ast_element *hte;
     char *ctx_name, *name;
-    wchar_t *wchar_tmp;
     t_dll *dll;
     t_scope *scope;
 
-    // Append to lineno
-    dll_append(lineno_stack, (void *)p->lineno);
-
     // No element found, return NULL object
     if (!p) {
         RETURN_SNODE_OBJECT(Object_Null);
@@ -290,47 +328,29 @@ static t_snode *_interpreter(t_ast_element *p) {
             RETURN_SNODE_NULL();
             break;
         case typeAstString :
-            DEBUG_PRINT("new string object: '%s'\n", p->string.value);
-
-            // Allocate enough room to hold string in wchar and convert
-            int len = strlen(p->string.value) * sizeof(wchar_t);
-            wchar_tmp = (wchar_t *)smm_malloc(len * sizeof(wchar_t));
-            memset(wchar_tmp, 0, len * sizeof(wchar_t));
-            mbstowcs(wchar_tmp, p->string.value, strlen(p->string.value));
-
-            // create string object
-            obj = object_new(Object_String, wchar_tmp);
-
-            // Free tmp wide string
-            smm_free(wchar_tmp);
-            RETURN_SNODE_OBJECT(obj);
-            break;
-
         case typeAstNumerical :
-            DEBUG_PRINT("new numerical object: %d\n", p->numerical.value);
-            // Create numerical object
-            obj = object_new(Object_Numerical, p->numerical.value);
-            RETURN_SNODE_OBJECT(obj);
+            RETURN_SNODE_OBJECT(si_literal(p));
             break;
 
         case typeAstIdentifier :
             // Do constant vars
-            if (strcasecmp(p->string.value, "True") == 0) {
-                //RETURN_SNODE_OBJECT(Object_True);
-                RETURN_SNODE_IDENTIFIER(NULL, Object_True);
+            if (p->identifier.object) {
+                RETURN_SNODE_IDENTIFIER(NULL, p->identifier.object);
             }
-            if (strcasecmp(p->string.value, "False") == 0) {
-                DEBUG_PRINT("Retuning false!");
-                //RETURN_SNODE_OBJECT(Object_False);
-                RETURN_SNODE_IDENTIFIER(NULL, Object_False);
+
+            if (p->identifier.context) {
+                obj = SI_SLOT(p->identifier.context, p->identifier.slot);
+                RETURN_SNODE_VARIABLE(p->identifier.name, obj, p->identifier.context, p->identifier.slot);
             }
-            if (strcasecmp(p->string.value, "Null") == 0) {
-                //RETURN_SNODE_OBJECT(Object_Null);
-                RETURN_SNODE_IDENTIFIER(NULL, Object_Null);
+
+            // Names that are not prepared (like variables of contexts created by "use") are resolved here
+            obj = si_builtin_constant(p->identifier.name);
+            if (obj) {
+                RETURN_SNODE_IDENTIFIER(NULL, obj);
             }
 
-            obj = si_find_var_in_context(p->string.value, NULL);
-            RETURN_SNODE_IDENTIFIER(p->string.value, obj);
+            obj = si_find_var_in_context(p->identifier.name, NULL);
+            RETURN_SNODE_IDENTIFIER(p->identifier.name, obj);
             break;
 
         case typeAstClass :
@@ -406,7 +426,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                 case T_IMPORT :
                     // Class to import
                     node1 = SI0(p);
-                    obj1 = si_get_object(node1);
+                    obj1 = si_get_object(&node1);
                     char *classname = OBJ2STR(obj1);
 
                     // Fetch alias
@@ -414,12 +434,12 @@ static t_snode *_interpreter(t_ast_element *p) {
                     if (IS_NULL(node2)) {
                         node2 = node1;  // Alias X as X if needed
                     }
-                    obj2 = si_get_object(node2);
+                    obj2 = si_get_object(&node2);
                     char *alias = OBJ2STR(obj2);
 
                     // context to import from
                     node3 = SI2(p);
-                    obj3 = si_get_object(node3);
+                    obj3 = si_get_object(&node3);
                     ctx_name = OBJ2STR(obj3);
 
 
@@ -446,7 +466,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                 case T_USE :
                     // Class to use
                     node1 = SI0(p);
-                    obj1 = si_get_object(node1);
+                    obj1 = si_get_object(&node1);
                     name = OBJ2STR(obj1);
 
                     if (OP_CNT(p) > 1) {
@@ -458,7 +478,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     } else {
                         node2 = node1;  // Alias X as X
                     }
-                    obj2 = si_get_object(node2);
+                    obj2 = si_get_object(&node2);
                     alias = OBJ2STR(obj2);
 
                     // Check if variable is free
@@ -483,10 +503,23 @@ static t_snode *_interpreter(t_ast_element *p) {
                     }
                     
                     node1 = SI0(p);
-                    obj = si_get_object(node1);
+                    obj = si_get_object(&node1);
                     RETURN_SNODE_OBJECT(obj);
                     break;
 
+                case T_YIELD :
+                case T_FOREACH :
+                    // Generators need frames that can be suspended, only the VM has those
+                    saffire_error("yield and foreach are only supported by the VM, run the script with --vm");
+                    break;
+
+                case T_TRY :
+                case T_FINALLY :
+                case T_THROW :
+                    // Unwinding uses the exception tables of the bytecode
+                    saffire_error("Exceptions are only supported by the VM, run the script with --vm");
+                    break;
+
                 case T_EXPRESSIONS :
                     // No expression, just return NULL
                     if (OP_CNT(p) == 0) {
@@ -523,8 +556,8 @@ static t_snode *_interpreter(t_ast_element *p) {
                     node3 = SI2(p);
 
                     // Get the object and store it
-                    obj1 = si_get_object(node3);
-                    si_set_object(node1, obj1);
+                    obj1 = si_get_object(&node3);
+                    si_set_object(&node1, obj1);
 
                     RETURN_SNODE_OBJECT(obj1);
                     break;
@@ -539,7 +572,7 @@ static t_snode *_interpreter(t_ast_element *p) {
 
                         // Check condition
                         node1 = SI1(p);
-                        obj1 = si_get_object(node1);
+                        obj1 = si_get_object(&node1);
                         // Check if it's already a boolean. If not, cast this object to boolean
                         if (! OBJECT_IS_BOOLEAN(obj1)) {
                             obj2 = object_find_method(obj1, "boolean");
@@ -560,7 +593,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     while (1) {
                         // Check condition first
                         node1 = SI0(p);
-                        obj1 = si_get_object(node1);
+                        obj1 = si_get_object(&node1);
                         // Check if it's already a boolean. If not, cast this object to boolean
                         if (! OBJECT_IS_BOOLEAN(obj1)) {
                             obj2 = object_find_method(obj1, "boolean");
@@ -591,7 +624,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     while (1) {
                         // Check condition first
                         node2 = SI1(p);
-                        obj1 = si_get_object(node2);
+                        obj1 = si_get_object(&node2);
                         // Check if it's already a boolean. If not, cast this object to boolean
                         if (! OBJECT_IS_BOOLEAN(obj1)) {
                             obj2 = object_find_method(obj1, "boolean");
@@ -618,7 +651,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                  */
                 case T_IF:
                     node1 = SI0(p);
-                    obj1 = si_get_object(node1);
+                    obj1 = si_get_object(&node1);
 
                     // Check if it's already a boolean. If not, cast this object to boolean
                     if (! OBJECT_IS_BOOLEAN(obj1)) {
@@ -639,7 +672,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     dll = dll_init();
                     for (int i=0; i!=OP_CNT(p); i++) {
                         node1 = _interpreter(p->opr.ops[i]);
-                        obj1 = si_get_object(node1);
+                        obj1 = si_get_object(&node1);
                         dll_append(dll, obj1);
                     }
                     RETURN_SNODE_DLL(dll);
@@ -647,18 +680,19 @@ static t_snode *_interpreter(t_ast_element *p) {
                 case T_METHOD_CALL :
                     // Get object
                     node1 = SI0(p);
-                    obj1 = IS_NULL(node1) ? NULL : si_get_object(node1);
+                    obj1 = IS_NULL(node1) ? NULL : si_get_object(&node1);
 
                     if (obj1 != NULL) {
                         hte = p->opr.ops[1];
-                        obj2 = object_find_method(obj1,  hte->identifier.name);
+                        if (! p->cache) p->cache = object_cache_new();
+                        obj2 = object_find_method_cached(obj1, hte->identifier.name, p->cache);
                         if (! obj2) {
                             saffire_error("Cannot find method or property named '%s' in '%s'", hte->identifier.name, obj1->name);
                         }
                     } else {
                         // Get object
                         node2 = SI1(p);
-                        obj2 = si_get_object(node2);
+                        obj2 = si_get_object(&node2);
                     }
 
 
@@ -667,7 +701,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     t_dll *dll = NULL;
                     node2 = SI2(p);
                     if (IS_DLL(node2)) {
-                        dll = node2->data.dll;
+                        dll = node2.data.dll;
                     } else if (IS_NULL(node2)) {
                         dll = NULL;
                     } else {
@@ -833,11 +867,11 @@ static t_snode *_interpreter(t_ast_element *p) {
                         saffire_error("Left hand side is not writable!");
                     }
 
-                    obj1 = si_get_object(node1);
+                    obj1 = si_get_object(&node1);
                     obj2 = object_new(Object_Numerical, 1);
                     obj3 = object_operator(obj1, OPERATOR_ADD, 0, 1, obj2);
 
-                    si_set_object(node1, obj3);
+                    si_set_object(&node1, obj3);
 
                     RETURN_SNODE_OBJECT(obj3);
                     break;
@@ -848,18 +882,18 @@ static t_snode *_interpreter(t_ast_element *p) {
                         saffire_error("Left hand side is not writable!");
                     }
 
-                    obj1 = si_get_object(node1);
+                    obj1 = si_get_object(&node1);
                     obj2 = object_new(Object_Numerical, 1);
                     obj3 = object_operator(obj1, OPERATOR_SUB, 0, 1, obj2);
 
-                    si_set_object(node1, obj3);
+                    si_set_object(&node1, obj3);
 
                     RETURN_SNODE_OBJECT(obj3);
                     break;
 
                 case '.' :
                     node1 = SI0(p);
-                    obj1 = si_get_object(node1);
+                    obj1 = si_get_object(&node1);
 
                     // get method name from object
                     hte = p->opr.ops[1];
@@ -891,7 +925,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     }
 
                     node2 = SI1(p);
-                    obj2 = si_get_object(node2);
+                    obj2 = si_get_object(&node2);
 
                     DEBUG_PRINT("Added constant %s to %s\n", hte->identifier.name, current_obj->name);
                     ht_add(current_obj->constants, hte->identifier.name, obj2);
@@ -913,7 +947,7 @@ static t_snode *_interpreter(t_ast_element *p) {
                     }
 
                     node2 = SI2(p);
-                    obj2 = si_get_object(node2);
+                    obj2 = si_get_object(&node2);
 
                     DEBUG_PRINT("Added property %s to %s\n", hte->identifier.name, current_obj->name);
                     ht_add(current_obj->properties, hte->identifier.name, obj2);
@@ -929,19 +963,186 @@ static t_snode *_interpreter(t_ast_element *p) {
 }
 
 
+/**
+ * Interprets a node, and keeps track of it so errors can report the line it was found on
+ */
+static t_snode _interpreter(t_ast_element *p) {
+    t_ast_element *parent_node = current_node;
+
+    if (p) current_node = p;
+    t_snode ret = _interpret_node(p);
+    current_node = parent_node;
+
+    return ret;
+}
+
+
+/**
+ * Returns the line number of the node that is currently interpreted, or 0 when no node is running
+ */
+int interpreter_lineno(void) {
+    return current_node ? current_node->lineno : 0;
+}
+
+
 /**
  * Interpret a leaf. Returns the last object encountered, or a NULL object.
  */
 t_object *interpreter_leaf(t_ast_element *p) {
-    t_snode *node = _interpreter(p);
+    t_snode node = _interpreter(p);
     if (IS_OBJECT(node)) {
-        RETURN_OBJECT(node->data.obj);
+        RETURN_OBJECT(node.data.obj);
     }
 
     RETURN_NULL;
 }
 
 
+/**
+ * Folds +, - and * on two numerical constants into a single numerical constant. The result must fit in a
+ * numerical node, otherwise the operator is left for runtime.
+ */
+static int si_fold_constants(t_ast_element *p) {
+    if (p->opr.nops != 2) return 0;
+
+    t_ast_element *l = p->opr.ops[0], *r = p->opr.ops[1];
+    if (! l || ! r || l->type != typeAstNumerical || r->type != typeAstNumerical) return 0;
+
+    long result;
+    switch (p->opr.oper) {
+        case '+' : result = (long)l->numerical.value + r->numerical.value; break;
+        case '-' : result = (long)l->numerical.value - r->numerical.value; break;
+        case '*' : result = (long)l->numerical.value * r->numerical.value; break;
+        default :
+            return 0;
+    }
+    if (result < INT_MIN || result > INT_MAX) return 0;
+
+    // Turn the operator into a numerical node, keeping its line number
+    ast_free_node(l);
+    ast_free_node(r);
+    smm_free(p->opr.ops);
+    if (p->cache) smm_free(p->cache);
+    p->cache = NULL;
+
+    p->type = typeAstNumerical;
+    p->numerical.value = (int)result;
+    p->numerical.object = NULL;
+    return 1;
+}
+
+
+/**
+ * Folds the constant arithmetic in the tree, bottom-up so nested operators fold into a single numerical node.
+ * This runs before any objects for the constants are created, so operands and intermediate results that are
+ * folded away never get an object.
+ */
+static void si_fold_tree(t_ast_element *p) {
+    if (! p) return;
+
+    switch (p->type) {
+        case typeAstClass :
+            si_fold_tree(p->class.body);
+            break;
+
+        case typeAstMethod :
+            si_fold_tree(p->method.body);
+            break;
+
+        case typeAstOpr :
+            for (int i=0; i!=OP_CNT(p); i++) {
+                si_fold_tree(p->opr.ops[i]);
+            }
+            si_fold_constants(p);
+            break;
+
+        default :
+            break;
+    }
+}
+
+
+/**
+ * Prepares the constants in the (folded) tree: creates the objects for string and numerical constants, and
+ * resolves the built-in True/False/Null names, so none of this is done while interpreting.
+ */
+static void si_prepare_constants(t_ast_element *p) {
+    if (! p) return;
+
+    switch (p->type) {
+        case typeAstString :
+        case typeAstNumerical :
+            si_literal(p);
+            break;
+
+        case typeAstIdentifier :
+            p->identifier.object = si_builtin_constant(p->identifier.name);
+            break;
+
+        case typeAstClass :
+            si_prepare_constants(p->class.body);
+            break;
+
+        case typeAstMethod :
+            si_prepare_constants(p->method.body);
+            break;
+
+        case typeAstOpr :
+            for (int i=0; i!=OP_CNT(p); i++) {
+                // Names of methods, properties and constants are no built-in constants
+                if (i == 1 && p->opr.oper == '.') continue;
+                if (i == 1 && p->opr.oper == T_METHOD_CALL && p->opr.ops[0] && p->opr.ops[0]->type != typeAstNull) continue;
+                if (i == 0 && p->opr.oper == T_CONST) continue;
+                if (i == 1 && p->opr.oper == T_PROPERTY) continue;
+                si_prepare_constants(p->opr.ops[i]);
+            }
+            break;
+
+        default :
+            break;
+    }
+}
+
+
+/**
+ * Binds the variables in the tree to their slots, so they are accessed by index while interpreting. Names that
+ * are no variables (method, property and constant names, and the built-in constants) are skipped, and so
+ * are variables of contexts that do not exist yet (contexts created by "use" while running). Those are looked up
+ * by name.
+ */
+static void si_bind_variables(t_ast_element *p) {
+    if (! p) return;
+
+    switch (p->type) {
+        case typeAstIdentifier :
+            if (p->identifier.object) return;
+            si_bind_var_in_context(p->identifier.name, NULL, &p->identifier.context, &p->identifier.slot);
+            break;
+
+        case typeAstClass :
+            si_bind_variables(p->class.body);
+            break;
+
+        case typeAstMethod :
+            si_bind_variables(p->method.body);
+            break;
+
+        case typeAstOpr :
+            for (int i=0; i!=OP_CNT(p); i++) {
+                if (i == 1 && p->opr.oper == '.') continue;
+                if (i == 1 && p->opr.oper == T_METHOD_CALL && p->opr.ops[0] && p->opr.ops[0]->type != typeAstNull) continue;
+                if (i == 0 && p->opr.oper == T_CONST) continue;
+                if (i == 1 && p->opr.oper == T_PROPERTY) continue;
+                si_bind_variables(p->opr.ops[i]);
+            }
+            break;
+
+        default :
+            break;
+    }
+}
+
+
 /**
  * Interpret a tree. Will deal with initialiazation etc
  */
@@ -949,6 +1150,9 @@ int interpreter(t_ast_element *p) {
     int ret = 0;
 
     si_init();
+    si_fold_tree(p);
+    si_prepare_constants(p);
+    si_bind_variables(p);
 
     t_object *obj = interpreter_leaf(p);
 
@@ -165,6 +165,7 @@ static t_object *obj_new(t_object *obj, va_list arg_list) {
 
     new_obj->p = va_arg(arg_list, t_ast_element *);
     new_obj->f = va_arg(arg_list, void *);
+    new_obj->bc = va_arg(arg_list, struct _bytecode *);
 
     // These are instances
     new_obj->flags &= ~OBJECT_TYPE_MASK;
@@ -198,5 +199,6 @@ t_object_funcs code_funcs = {
 t_code_object Object_Code_struct = {
     OBJECT_HEAD_INIT2("code", objectTypeCode, NULL, NULL, OBJECT_TYPE_CLASS, &code_funcs),
     NULL,
+    NULL,
     NULL
 };
\ No newline at end of file
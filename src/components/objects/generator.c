@@ -0,0 +1,148 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "objects/object.h"
+#include "objects/boolean.h"
+#include "objects/null.h"
+#include "objects/method.h"
+#include "objects/generator.h"
+#include "vm/vm.h"
+#include "general/smm.h"
+#include "debug.h"
+
+
+/* ======================================================================
+ *   Object methods
+ * ======================================================================
+ */
+
+
+/**
+ * Saffire method: returns the next value of the generator, or null when it has finished
+ */
+SAFFIRE_METHOD(generator, next) {
+    t_object *obj = self->value ? self->value : vm_generator_resume(self);
+    self->value = NULL;
+
+    if (! obj) {
+        RETURN_NULL;
+    }
+    RETURN_OBJECT(obj);
+}
+
+/**
+ * Saffire method: returns true when the generator has another value. Runs the generator up to its next
+ * yield, the value is kept until next() asks for it.
+ */
+SAFFIRE_METHOD(generator, valid) {
+    if (! self->value) {
+        self->value = vm_generator_resume(self);
+    }
+
+    if (self->value) {
+        RETURN_TRUE;
+    }
+    RETURN_FALSE;
+}
+
+
+/* ======================================================================
+ *   Global object management functions and data
+ * ======================================================================
+ */
+
+/**
+ * Initializes methods and properties, these are used
+ */
+void object_generator_init(void) {
+    Object_Generator_struct.methods = ht_create();
+    object_add_internal_method(&Object_Generator_struct, "next", METHOD_NO_FLAGS, METHOD_VISIBILITY_PUBLIC, object_generator_method_next);
+    object_add_internal_method(&Object_Generator_struct, "valid?", METHOD_NO_FLAGS, METHOD_VISIBILITY_PUBLIC, object_generator_method_valid);
+    object_add_internal_method(&Object_Generator_struct, "boolean", METHOD_NO_FLAGS, METHOD_VISIBILITY_PUBLIC, object_generator_method_valid);
+
+    Object_Generator_struct.properties = ht_create();
+}
+
+/**
+ * Frees memory for a generator object
+ */
+void object_generator_fini(void) {
+    ht_destroy(Object_Generator_struct.methods);
+    ht_destroy(Object_Generator_struct.properties);
+}
+
+
+/**
+ * Frees the frame of a generator that did not finish
+ */
+static void obj_free(t_object *obj) {
+    if (! obj) return;
+
+    vm_generator_close((t_generator_object *)obj);
+}
+
+
+static t_object *obj_new(t_object *obj, va_list arg_list) {
+    t_generator_object *new_obj = smm_malloc(sizeof(t_generator_object));
+    memcpy(new_obj, Object_Generator, sizeof(t_generator_object));
+
+    new_obj->frame = va_arg(arg_list, struct _vm_context *);
+    new_obj->value = NULL;
+
+    // These are instances
+    new_obj->flags &= ~OBJECT_TYPE_MASK;
+    new_obj->flags |= OBJECT_TYPE_INSTANCE;
+
+    return (t_object *)new_obj;
+}
+
+
+#ifdef __DEBUG
+static char *obj_debug(t_object *obj) {
+    return ((t_generator_object *)obj)->frame ? "generator" : "generator (finished)";
+}
+#endif
+
+
+// Generator object management functions
+t_object_funcs generator_funcs = {
+        obj_new,              // Allocate a new generator object
+        obj_free,             // Free a generator object
+        NULL,                 // Clone a generator object
+#ifdef __DEBUG
+        obj_debug
+#endif
+};
+
+// Intial object
+t_generator_object Object_Generator_struct = {
+    OBJECT_HEAD_INIT2("generator", objectTypeGenerator, NULL, NULL, OBJECT_TYPE_CLASS, &generator_funcs),
+    NULL,
+    NULL
+};
@@ -45,7 +45,7 @@
 // Offset calculations
 #define NUMERICAL_CACHE_OFF     abs(NUMERICAL_CACHED_MIN)
 // Max storage
-#define NUMERICAL_CACHED_CNT    NUMERICAL_CACHED_MAX + NUMERICAL_CACHED_MIN + 1
+#define NUMERICAL_CACHED_CNT    (NUMERICAL_CACHED_MAX - NUMERICAL_CACHED_MIN + 1)
 
 t_numerical_object *numerical_cache[NUMERICAL_CACHED_CNT];
 
@@ -38,10 +38,12 @@
 #include "objects/regex.h"
 #include "objects/method.h"
 #include "objects/code.h"
+#include "objects/generator.h"
 #include "general/smm.h"
 #include "general/dll.h"
 #include "interpreter/errors.h"
 #include "interpreter/interpreter.h"
+#include "vm/vm.h"
 #include "debug.h"
 
 
@@ -52,8 +54,11 @@
 #endif
 
 
+// Incremented whenever methods are added, so inline caches know their entries are stale
+unsigned long object_methods_epoch = 1;
+
 // Object type string constants
-const char *objectTypeNames[10] = { "object", "code", "method", "base", "boolean", "null", "numerical", "regex", "string" };
+const char *objectTypeNames[11] = { "object", "code", "method", "base", "boolean", "null", "numerical", "regex", "string", "generator" };
 
 
 int object_is_immutable(t_object *obj) {
@@ -107,6 +112,68 @@ t_object *object_find_method(t_object *obj, char *method_name) {
     return method;
 }
 
+
+/**
+ * Allocates a new and empty inline cache
+ */
+t_inline_cache *object_cache_new(void) {
+    t_inline_cache *ic = (t_inline_cache *)smm_malloc(sizeof(t_inline_cache));
+    ic->epoch = 0;
+    ic->count = 0;
+    ic->next = 0;
+    ic->misses = 0;
+    return ic;
+}
+
+/**
+ * Returns the cached value for the receiver, or NULL when the cache does not know it (yet)
+ */
+static void *_cache_find(t_inline_cache *ic, void *key, void *parent) {
+    if (ic->epoch != object_methods_epoch) {
+        // Methods have been changed since this cache was filled
+        ic->epoch = object_methods_epoch;
+        ic->count = 0;
+        ic->next = 0;
+        return NULL;
+    }
+
+    for (int i=0; i!=ic->count; i++) {
+        t_inline_cache_entry *entry = &ic->entries[i];
+        if (entry->key == key && entry->parent == parent) return entry->value;
+    }
+    return NULL;
+}
+
+/**
+ * Stores a value for the receiver in the cache. Replaces the oldest entry when the cache is full.
+ */
+static void _cache_store(t_inline_cache *ic, void *key, void *parent, void *value) {
+    t_inline_cache_entry *entry;
+
+    if (ic->count < IC_ENTRIES) {
+        entry = &ic->entries[ic->count++];
+    } else {
+        entry = &ic->entries[ic->next];
+        ic->next = (ic->next + 1) % IC_ENTRIES;
+    }
+
+    entry->key = key;
+    entry->parent = parent;
+    entry->value = value;
+}
+
+/**
+ * Finds a method like object_find_method(), but remembers the result in the inline cache of the call site
+ */
+t_object *object_find_method_cached(t_object *obj, char *method_name, t_inline_cache *ic) {
+    t_object *method = _cache_find(ic, obj->methods, obj->parent);
+    if (method) return method;
+
+    method = _find_method(obj, method_name);
+    if (method) _cache_store(ic, obj->methods, obj->parent, method);
+    return method;
+}
+
 /**
  * Calls a method from specified object, but with a argument list. Returns NULL when method is not found.
  */
@@ -145,6 +212,9 @@ t_object *object_call_args(t_object *self, t_object *method_obj, t_dll *args) {
         // External function found in AST
         // @TODO: How do we send our arguments?
         ret = interpreter_leaf(code->p);
+    } else if (code->bc) {
+        // External function found in bytecode
+        ret = vm_call(code->bc, self, args);
     } else {
         saffire_error("Sanity error: code object has no code");
     }
@@ -175,11 +245,10 @@ t_object *object_call(t_object *self, t_object *method_obj, int arg_count, ...)
 
 
 /**
- * Calls a method from specified object. Returns NULL when method is not found.
+ * Returns the function that handles the operator for this object (might be found in the base classes!)
  */
-t_object *object_operator(t_object *obj, int opr, int in_place, int arg_count, ...) {
+static t_object *(*_find_operator(t_object *obj, int opr))(t_object *, t_dll *, int) {
     t_object *cur_obj = obj;
-    va_list arg_list;
     t_object *(*func)(t_object *, t_dll *dll, int in_place) = NULL;
 
     // Try and find the correct operator (might be found of the base classes!)
@@ -209,9 +278,21 @@ t_object *object_operator(t_object *obj, int opr, int in_place, int arg_count, .
     if (!func) {
         // No comparison found for this method
         saffire_error("Cannot find operator method");
-        return Object_False;
     }
 
+    return func;
+}
+
+
+/**
+ * Calls a method from specified object. Returns NULL when method is not found.
+ */
+t_object *object_operator(t_object *obj, int opr, int in_place, int arg_count, ...) {
+    va_list arg_list;
+    t_object *(*func)(t_object *, t_dll *dll, int in_place) = _find_operator(obj, opr);
+
+    if (!func) return Object_False;
+
     DEBUG_PRINT(">>> Calling operator %d on object %s\n", opr, obj->name);
 
     // Add all arguments to a DLL
@@ -231,6 +312,30 @@ t_object *object_operator(t_object *obj, int opr, int in_place, int arg_count, .
     return ret;
 }
 
+
+/**
+ * Calls a binary operator like object_operator(), but remembers the operator function in the inline
+ * cache of the call site. Every call site uses a single operator, so it is not part of the key.
+ */
+t_object *object_operator_cached(t_object *obj, int opr, int in_place, t_object *other, t_inline_cache *ic) {
+    t_object *(*func)(t_object *, t_dll *dll, int in_place);
+
+    func = (t_object *(*)(t_object *, t_dll *, int))_cache_find(ic, obj->operators, obj->parent);
+    if (! func) {
+        func = _find_operator(obj, opr);
+        if (! func) return Object_False;
+        _cache_store(ic, obj->operators, obj->parent, (void *)func);
+    }
+
+    t_dll *dll = dll_init();
+    dll_append(dll, other);
+
+    t_object *ret = func(obj, dll, in_place);
+
+    dll_free(dll);
+    return ret;
+}
+
 /**
  * Calls an comparison function. Returns true or false
  */
@@ -392,6 +497,7 @@ void object_init() {
     object_regex_init();
     object_code_init();
     object_method_init();
+    object_generator_init();
 
 #ifdef __DEBUG
     char addr[10];
@@ -420,6 +526,7 @@ void object_fini() {
     object_regex_fini();
     object_code_fini();
     object_method_fini();
+    object_generator_fini();
 }
 
 
@@ -515,10 +622,11 @@ done:
 void object_add_external_method(void *obj, char *method_name, int flags, int visibility, t_ast_element *p) {
     t_object *the_obj = (t_object *)obj;
 
-    t_code_object *code = (t_code_object *)object_new(Object_Code, p, NULL);
+    t_code_object *code = (t_code_object *)object_new(Object_Code, p, NULL, NULL);
     t_method_object *method = (t_method_object *)object_new(Object_Method, flags, visibility, obj, code);
 
     ht_add(the_obj->methods, method_name, method);
+    object_methods_changed();
 }
 
 
@@ -528,8 +636,9 @@ void object_add_external_method(void *obj, char *method_name, int flags, int vis
 void object_add_internal_method(void *obj, char *method_name, int flags, int visibility, void *func) {
     t_object *the_obj = (t_object *)obj;
 
-    t_code_object *code = (t_code_object *)object_new(Object_Code, NULL, func);
+    t_code_object *code = (t_code_object *)object_new(Object_Code, NULL, func, NULL);
     t_method_object *method = (t_method_object *)object_new(Object_Method, flags, visibility, obj, code);
 
     ht_add(the_obj->methods, method_name, method);
+    object_methods_changed();
 }
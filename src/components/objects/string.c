@@ -297,13 +297,13 @@ SAFFIRE_COMPARISON_METHOD(string, lt) {
     t_string_object *self = (t_string_object *)_self;
     t_string_object *other = (t_string_object *)_other;
 
-    return (wcscmp(self->value, other->value) == -1);
+    return (wcscmp(self->value, other->value) < 0);
 }
 SAFFIRE_COMPARISON_METHOD(string, gt) {
     t_string_object *self = (t_string_object *)_self;
     t_string_object *other = (t_string_object *)_other;
 
-    return (wcscmp(self->value, other->value) == 1);
+    return (wcscmp(self->value, other->value) > 0);
 }
 SAFFIRE_COMPARISON_METHOD(string, le) {
     t_string_object *self = (t_string_object *)_self;
@@ -0,0 +1,283 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm/jit.h"
+#include "vm/vm_opcodes.h"
+#include "general/smm.h"
+
+#if VM_JIT
+#include <sys/mman.h>
+#endif
+
+/*
+ * Baseline JIT. Every instruction of a code object is turned into a small machine code template that
+ * calls the helper of its opcode. Jumps become native jumps, so the dispatch of the interpreter (fetching
+ * and decoding opcodes and operands, and the indirect jumps) is gone. The helpers themselves are provided
+ * by the VM and share their implementation with the interpreter.
+ *
+ * The generated function is called as code(ctx, entry). It keeps the frame in rbx and jumps to the entry,
+ * which is the template of the instruction to start with. It returns the object returned by the frame,
+ * or NULL when it had to leave the native code. In that case ctx->ip tells where to continue interpreting.
+ */
+
+int vm_jit_enabled = 1;
+
+#if VM_JIT
+
+// Maximum number of bytes a single instruction template can take
+#define TEMPLATE_MAX    40
+
+typedef struct _jit_buffer {
+    unsigned char *code;        // Start of the buffer
+    unsigned char *pos;         // Current write position
+} t_jit_buffer;
+
+typedef struct _jit_fixup {
+    unsigned char *pos;         // Position of the rel32 to patch
+    int target;                 // Code offset the jump should land on
+} t_jit_fixup;
+
+
+static void emit8(t_jit_buffer *buf, unsigned char b) {
+    *buf->pos++ = b;
+}
+
+static void emit32(t_jit_buffer *buf, uint32_t v) {
+    memcpy(buf->pos, &v, sizeof(v));
+    buf->pos += sizeof(v);
+}
+
+static void emit64(t_jit_buffer *buf, uint64_t v) {
+    memcpy(buf->pos, &v, sizeof(v));
+    buf->pos += sizeof(v);
+}
+
+/**
+ * Emits helper(ctx, oparg, pc)
+ */
+static void emit_call(t_jit_buffer *buf, t_jit_helper helper, int oparg, int pc) {
+    emit8(buf, 0x48); emit8(buf, 0x89); emit8(buf, 0xDF);          // mov rdi, rbx
+    emit8(buf, 0xBE); emit32(buf, (uint32_t)oparg);                // mov esi, oparg
+    emit8(buf, 0xBA); emit32(buf, (uint32_t)pc);                   // mov edx, pc
+    emit8(buf, 0x48); emit8(buf, 0xB8); emit64(buf, (uint64_t)(uintptr_t)helper);   // mov rax, helper
+    emit8(buf, 0xFF); emit8(buf, 0xD0);                            // call rax
+}
+
+/**
+ * Emits a jump with a 32 bit displacement to an absolute address
+ */
+static void emit_jump_to(t_jit_buffer *buf, unsigned char *target) {
+    emit8(buf, 0xE9);                                              // jmp rel32
+    emit32(buf, (uint32_t)(target - (buf->pos + 4)));
+}
+
+
+/**
+ * Compiles the bytecode into native code. Instructions whose template is JIT_EXIT call the exit helper,
+ * which makes the native code return to the interpreter. Returns NULL when compiling is not possible.
+ */
+t_jit_code *jit_compile(t_bytecode *bc, const t_jit_template *templates, t_jit_helper exit_helper) {
+    const unsigned char *code = (const unsigned char *)bc->code;
+    int len = bc->code_len;
+
+    // Find the start of all instructions, so we know which jump targets are valid
+    char *is_instr = smm_malloc(len + 1);
+    memset(is_instr, 0, len + 1);
+    int instr_count = 0;
+    for (int i=0, opcode, oparg; i >= 0 && i < len; i = vm_decode_instruction(code, len, i, &opcode, &oparg)) {
+        is_instr[i] = 1;
+        instr_count++;
+    }
+    is_instr[len] = 1;
+
+    size_t size = 64 + (size_t)(instr_count + 1) * TEMPLATE_MAX;
+    unsigned char *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        smm_free(is_instr);
+        return NULL;
+    }
+
+    t_jit_code *jit = smm_malloc(sizeof(t_jit_code));
+    jit->code = mem;
+    jit->size = size;
+    jit->code_len = len;
+    jit->labels = smm_malloc((len + 1) * sizeof(unsigned char *));
+    memset(jit->labels, 0, (len + 1) * sizeof(unsigned char *));
+
+    t_jit_fixup *fixups = smm_malloc((instr_count + 1) * sizeof(t_jit_fixup));
+    int fixup_count = 0;
+
+    t_jit_buffer buf = { mem, mem };
+
+    // Prologue: keep the frame in rbx (this also aligns the stack for our calls) and go to the entry
+    emit8(&buf, 0x53);                                             // push rbx
+    emit8(&buf, 0x48); emit8(&buf, 0x89); emit8(&buf, 0xFB);       // mov rbx, rdi
+    emit8(&buf, 0xFF); emit8(&buf, 0xE6);                          // jmp rsi
+
+    // Returning to the interpreter after a helper that stored where to continue
+    unsigned char *bail = buf.pos;
+    emit8(&buf, 0x31); emit8(&buf, 0xC0);                          // xor eax, eax
+
+    // Epilogue: the result is already in rax
+    unsigned char *epilogue = buf.pos;
+    emit8(&buf, 0x5B);                                             // pop rbx
+    emit8(&buf, 0xC3);                                             // ret
+
+    for (int i=0; i <= len; ) {
+        int opcode = VM_STOP_CODE;
+        int oparg = 0;
+        int next = vm_decode_instruction(code, len, i, &opcode, &oparg);
+        int kind = templates[opcode].kind;
+        int target = 0;
+
+        jit->labels[i] = buf.pos;
+
+        if (next == -1) {
+            // Running off the end (or a truncated operand) is left to the interpreter
+            kind = JIT_EXIT;
+            next = len + 1;
+        }
+
+        if (kind == JIT_JUMP || kind == JIT_BRANCH) {
+            target = oparg;
+        } else if (kind == JIT_REG_BRANCH) {
+            target = (int)REG_JUMP_TARGET(oparg);
+        }
+        if ((kind == JIT_JUMP || kind == JIT_BRANCH || kind == JIT_REG_BRANCH) && (target < 0 || target > len || ! is_instr[target])) {
+            // The interpreter will complain about this jump
+            kind = JIT_EXIT;
+        }
+
+        switch (kind) {
+            case JIT_SKIP :
+                break;
+
+            case JIT_CALL :
+                emit_call(&buf, templates[opcode].helper, oparg, next);
+                break;
+
+            case JIT_CALL_CHECKED :
+                emit_call(&buf, templates[opcode].helper, oparg, next);
+                emit8(&buf, 0x48); emit8(&buf, 0x85); emit8(&buf, 0xC0);   // test rax, rax
+                emit8(&buf, 0x0F); emit8(&buf, 0x85);                      // jnz bail
+                emit32(&buf, (uint32_t)(bail - (buf.pos + 4)));
+                break;
+
+            case JIT_JUMP :
+                emit8(&buf, 0xE9);                                 // jmp rel32
+                fixups[fixup_count].pos = buf.pos;
+                fixups[fixup_count++].target = target;
+                emit32(&buf, 0);
+                break;
+
+            case JIT_BRANCH :
+            case JIT_REG_BRANCH :
+                emit_call(&buf, templates[opcode].helper, oparg, next);
+                emit8(&buf, 0x48); emit8(&buf, 0x85); emit8(&buf, 0xC0);   // test rax, rax
+                emit8(&buf, 0x0F); emit8(&buf, 0x88);                      // js bail
+                emit32(&buf, (uint32_t)(bail - (buf.pos + 4)));
+                emit8(&buf, 0x0F); emit8(&buf, 0x85);                      // jnz rel32
+                fixups[fixup_count].pos = buf.pos;
+                fixups[fixup_count++].target = target;
+                emit32(&buf, 0);
+                break;
+
+            case JIT_RETURN :
+                emit_call(&buf, templates[opcode].helper, oparg, next);
+                emit_jump_to(&buf, epilogue);
+                break;
+
+            case JIT_EXIT :
+            default :
+                // The exit helper stores where to continue and returns NULL
+                emit_call(&buf, exit_helper, 0, i);
+                emit_jump_to(&buf, epilogue);
+                break;
+        }
+
+        i = next;
+    }
+
+    // Now all labels are known, patch the jumps
+    for (int i=0; i!=fixup_count; i++) {
+        uint32_t rel = (uint32_t)(jit->labels[fixups[i].target] - (fixups[i].pos + 4));
+        memcpy(fixups[i].pos, &rel, sizeof(rel));
+    }
+
+    smm_free(fixups);
+    smm_free(is_instr);
+
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        jit_free(jit);
+        return NULL;
+    }
+
+    return jit;
+}
+
+
+/**
+ * Runs the native code, starting at the instruction at offset ip. Returns the object returned by the
+ * frame, or NULL when the interpreter has to continue at ctx->ip. The caller must have stored ip in
+ * ctx->ip already.
+ */
+void *jit_enter(t_jit_code *jit, void *ctx, int ip) {
+    void *(*func)(void *, void *) = (void *(*)(void *, void *))jit->code;
+
+    // Not the start of an instruction, so keep interpreting
+    if (ip < 0 || ip > jit->code_len || ! jit->labels[ip]) return NULL;
+
+    return func(ctx, jit->labels[ip]);
+}
+
+
+/**
+ * Releases the native code
+ */
+void jit_free(t_jit_code *jit) {
+    if (! jit) return;
+    munmap(jit->code, jit->size);
+    smm_free(jit->labels);
+    smm_free(jit);
+}
+
+#else
+
+t_jit_code *jit_compile(t_bytecode *bc, const t_jit_template *templates, t_jit_helper exit_helper) {
+    return NULL;
+}
+
+void *jit_enter(t_jit_code *jit, void *ctx, int ip) {
+    return NULL;
+}
+
+void jit_free(t_jit_code *jit) {
+}
+
+#endif
@@ -24,351 +24,2189 @@
  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <stdlib.h>
 #include <string.h>
-#include "compiler/bytecode.h"
+#include <wchar.h>
+#include "vm/vm.h"
 #include "vm/vm_opcodes.h"
+#include "vm/vm_profile.h"
+#include "vm/vm_trace.h"
+#include "vm/jit.h"
+#include "compiler/bytecode.h"
+#include "interpreter/context.h"
+#include "interpreter/errors.h"
 #include "general/dll.h"
+#include "general/hashtable.h"
 #include "general/smm.h"
 #include "objects/object.h"
 #include "objects/string.h"
 #include "objects/numerical.h"
-#include "interpreter/errors.h"
+#include "objects/boolean.h"
+#include "objects/null.h"
+#include "objects/base.h"
+#include "objects/code.h"
+#include "objects/method.h"
+#include "objects/generator.h"
+#include "debug.h"
+
+extern char *wctou8(const wchar_t *wstr, long len);
+extern t_object_funcs user_funcs;
+
+/*
+ * GCC and clang support "labels as values", which lets every opcode handler jump directly to the
+ * handler of the next opcode. This gives the branch predictor one indirect jump per handler instead
+ * of a single shared one. Other compilers fall back to a plain switch.
+ */
+#if defined(__GNUC__) && ! defined(VM_NO_COMPUTED_GOTO)
+    #define VM_COMPUTED_GOTO 1
+#else
+    #define VM_COMPUTED_GOTO 0
+#endif
+
+/*
+ * All frames share a single value stack. A frame is a window into this stack that holds the local
+ * variables of the frame, directly followed by its temporaries. The stack is made out of chunks that
+ * never move, so a frame stays valid while deeper frames are pushed. Only when a chunk is full, a new
+ * chunk is started. Pushing and popping a frame is normally nothing more than moving the top.
+ */
+#define VM_STACK_CHUNK_SIZE     16384   // Number of slots in a (default) chunk
 
-#define NOT_IMPLEMENTED  printf("opcode %d is not implemented yet", opcode); exit(1); break;
+typedef struct _vm_stack_chunk {
+    struct _vm_stack_chunk *prev;   // Previous chunk (or NULL)
+    int size;                       // Number of slots in this chunk
+    int top;                        // Number of slots in use
+    t_object *slots[];
+} t_vm_stack_chunk;
 
 typedef struct _vm_context {
+    struct _vm_context *prev;   // Calling frame (or NULL)
     t_bytecode *bc;             // Global bytecode array
     int ip;                     // Instruction pointer
 
     t_object **stack;           // Local context stack
-    int sp;                     // Stack pointer
-    t_object **variables;       // Local variables
+    int sp;                     // Stack pointer (number of items on the stack)
+    t_object **variables;       // Local variables (start of the window on the value stack)
+
+    t_generator_object *generator;  // Generator that owns this frame (or NULL)
+    int suspended;              // 1 when the generator frame stopped at a yield
+    int exit;                   // Where the consumer continues when the generator finishes inside its loop
 } t_vm_context;
 
-t_dll *contexts;
+/*
+ * A variable slot can hold a raw numerical value instead of an object. The raw values live in a window right
+ * after the variables, and the slot itself holds VM_UNBOXED. Register arithmetic on numericals stores raw
+ * values, so a counting loop does not allocate a numerical on every iteration. A raw value is boxed as soon as
+ * it escapes (it is loaded onto the stack, or used by an instruction that needs an object). The box is kept in
+ * the slot until the next raw value is stored.
+ */
+static t_object vm_unboxed_marker;
+#define VM_UNBOXED                  (&vm_unboxed_marker)
+
+#define VM_NUMBER_SLOTS(bc)         (((bc)->variables_len * sizeof(long) + sizeof(t_object *) - 1) / sizeof(t_object *))
+#define VM_NUMBERS(bc, variables)   ((long *)((variables) + (bc)->variables_len))
+#define VM_FRAME_SLOTS(bc)          ((bc)->variables_len + VM_NUMBER_SLOTS(bc) + (bc)->stack_size)
+#define VM_FRAME_STACK(bc, variables)   ((variables) + (bc)->variables_len + VM_NUMBER_SLOTS(bc))
+
+static t_vm_stack_chunk *vm_stack = NULL;       // Chunk that holds the current frame
+static t_vm_stack_chunk *vm_stack_spare = NULL; // Empty chunk, kept so a call on a chunk boundary does not malloc
+static t_vm_context *current_context = NULL;    // Frame that is currently executed
+static int frame_depth = 0;                     // Number of frames on the stack
+static t_object *vm_exception = NULL;           // Thrown object that has not been caught yet (or NULL)
+static t_object *vm_exception_thrown = NULL;    // Object of the last THROW, to recognize it when it is thrown again
+static t_bytecode *vm_exception_bc = NULL;      // Bytecode of the last THROW
+static int vm_exception_offset = 0;             // Code offset of the last THROW
+
+
+/**
+ * Reserves a window of slots on the value stack
+ */
+static t_object **vm_stack_push(int slots) {
+    if (vm_stack == NULL || vm_stack->top + slots > vm_stack->size) {
+        t_vm_stack_chunk *chunk;
+
+        if (vm_stack_spare && vm_stack_spare->size >= slots) {
+            chunk = vm_stack_spare;
+        } else {
+            if (vm_stack_spare) smm_free(vm_stack_spare);
+            int size = slots > VM_STACK_CHUNK_SIZE ? slots : VM_STACK_CHUNK_SIZE;
+            chunk = smm_malloc(sizeof(t_vm_stack_chunk) + size * sizeof(t_object *));
+            chunk->size = size;
+        }
+        vm_stack_spare = NULL;
+
+        chunk->top = 0;
+        chunk->prev = vm_stack;
+        vm_stack = chunk;
+    }
+
+    t_object **window = vm_stack->slots + vm_stack->top;
+    vm_stack->top += slots;
+    return window;
+}
+
+/**
+ * Releases a window (and everything above it) from the value stack
+ */
+static void vm_stack_pop(t_object **window) {
+    if (window == vm_stack->slots && vm_stack->prev) {
+        // The chunk is empty, keep it around for the next time we cross this boundary
+        if (vm_stack_spare) smm_free(vm_stack_spare);
+        vm_stack_spare = vm_stack;
+        vm_stack = vm_stack->prev;
+        return;
+    }
+    vm_stack->top = window - vm_stack->slots;
+}
+
+
+/**
+ * Sets up the frame to run the bytecode from the start
+ */
+static void init_context(t_vm_context *ctx, t_bytecode *bc) {
+    ctx->bc = bc;
+    ctx->ip = 0;
 
-static void push_context(t_vm_context *ctx) {
-    dll_append(contexts, ctx);
+    // Locals, raw numericals and temporaries are placed next to each other, only the locals need to be cleared
+    ctx->variables = vm_stack_push(VM_FRAME_SLOTS(bc));
+    memset(ctx->variables, 0, bc->variables_len * sizeof(t_object *));
+    ctx->stack = VM_FRAME_STACK(bc, ctx->variables);
+    ctx->sp = 0;
 }
 
-static void pop_context(void) {
-    t_dll_element *e = DLL_TAIL(contexts);
-    dll_remove(contexts, e);
+
+/**
+ * Pushes a new frame for the bytecode. The frame itself lives on the C stack of the caller.
+ */
+static void push_context(t_vm_context *ctx, t_bytecode *bc) {
+    init_context(ctx, bc);
+
+    // Frames on the value stack never belong to a generator
+    ctx->generator = NULL;
+    ctx->suspended = 0;
+    ctx->exit = 0;
+
+    ctx->prev = current_context;
+    current_context = ctx;
+    frame_depth++;
 }
 
-static t_vm_context *get_current_vm_context(void) {
-    t_dll_element *e = DLL_TAIL(contexts);
-    return e->data;
+static void pop_context(t_vm_context *ctx) {
+    vm_stack_pop(ctx->variables);
+    current_context = ctx->prev;
+    frame_depth--;
+}
+
+
+/**
+ * Replaces the frame with a frame for the bytecode (for a tail call). The new frame takes over the window of
+ * the old frame on the value stack.
+ */
+static void replace_context(t_vm_context *ctx, t_bytecode *bc) {
+    vm_stack_pop(ctx->variables);
+    init_context(ctx, bc);
 }
 
 
-static t_vm_context *create_context(t_bytecode *bc) {
+/**
+ * Creates the frame of a generator. It is not placed on the value stack, since it must survive while the
+ * generator is suspended and other frames come and go. The frame starts out suspended.
+ */
+static t_vm_context *generator_context_new(t_bytecode *bc) {
     t_vm_context *ctx = smm_malloc(sizeof(t_vm_context));
 
+    ctx->prev = NULL;
     ctx->bc = bc;
     ctx->ip = 0;
+    ctx->variables = smm_malloc(VM_FRAME_SLOTS(bc) * sizeof(t_object *));
+    memset(ctx->variables, 0, bc->variables_len * sizeof(t_object *));
+    ctx->stack = VM_FRAME_STACK(bc, ctx->variables);
+    ctx->sp = 0;
+    ctx->generator = NULL;
+    ctx->suspended = 0;
+    ctx->exit = 0;
 
-    //
-    ctx->stack = smm_malloc(bc->stack_size * sizeof(t_object *));
-    bzero(ctx->stack, bc->stack_size * sizeof(t_object *));
-    ctx->sp = bc->stack_size-1;
+    return ctx;
+}
 
-    // Variables
-    ctx->variables = smm_malloc(bc->variables_len * sizeof(t_object *));
-    bzero(ctx->variables, bc->variables_len * sizeof(t_object *));
 
-    return ctx;
+/**
+ * Fatal VM error. Only happens on corrupt bytecode.
+ */
+static void vm_fatal(const char *msg) {
+    vm_trace_dump();
+    printf("%s\n", msg);
+    exit(1);
 }
 
 
-static char get_next_opcode(void) {
-    t_vm_context *ctx = get_current_vm_context();
+/*
+ * Bytecode is verified before it runs (see bytecode_verify()), so operand indexes, jump targets and stack
+ * levels are known to be valid. Only debug builds check them again.
+ */
+#ifdef __DEBUG
+    #define VM_CHECK(cond, msg)     { if (cond) vm_fatal(msg); }
+#else
+    #define VM_CHECK(cond, msg)     { }
+#endif
+
+
+/**
+ * Converts a bytecode constant into an object
+ */
+static t_object *materialize_constant(t_bytecode_constant *c) {
+    t_object *obj;
+    wchar_t *wchar_tmp;
+
+    switch (c->type) {
+        case BYTECODE_CONST_STRING :
+            // Allocate enough room to hold string in wchar and convert
+            wchar_tmp = (wchar_t *)smm_malloc((c->len + 1) * sizeof(wchar_t));
+            memset(wchar_tmp, 0, (c->len + 1) * sizeof(wchar_t));
+            mbstowcs(wchar_tmp, c->data.s, c->len);
+
+            obj = object_new(Object_String, wchar_tmp);
+            smm_free(wchar_tmp);
+            return obj;
+
+        case BYTECODE_CONST_NUMERICAL :
+            return object_new(Object_Numerical, c->data.l);
+
+        case BYTECODE_CONST_NULL :
+            return Object_Null;
+
+        case BYTECODE_CONST_BOOLEAN :
+            return c->data.l ? Object_True : Object_False;
+
+        case BYTECODE_CONST_CODE :
+            return object_new(Object_Code, NULL, NULL, c->data.code);
 
-    if (ctx->ip < 0 || ctx->ip > ctx->bc->code_len) {
-        printf("Trying to reach outside code length!");
-        exit(1);
+        default :
+            printf("Cannot convert constant type %d to an object\n", c->type);
+            exit(1);
     }
+}
+
 
-    if (ctx->ip == ctx->bc->code_len) {
-        return VM_STOP_CODE;
+/**
+ * Returns the object for a constant. The object is created the first time the constant is used, and is
+ * never freed afterwards, so every next load is a plain pointer fetch.
+ */
+static t_object *get_constant(t_bytecode *bc, int idx) {
+    VM_CHECK(idx < 0 || idx >= bc->constants_len, "Trying to fetch from outside constant range");
+
+    t_bytecode_constant *c = bc->constants[idx];
+    if (! c->object) {
+        c->object = materialize_constant(c);
+        c->object->flags |= OBJECT_FLAG_STATIC;
     }
+    return c->object;
+}
+
 
-    char op = ctx->bc->code[ctx->ip];
-    ctx->ip++;
+/**
+ * Returns the name of a variable, property, constant or method
+ */
+static char *get_name(t_bytecode *bc, int idx) {
+    VM_CHECK(idx < 0 || idx >= bc->variables_len, "Trying to fetch from outside variable range");
+    return bc->variables[idx]->s;
+}
 
-    return op;
+
+/**
+ * Boxes the raw numerical inside a variable slot. The box replaces the raw value in the slot.
+ */
+static t_object *box_variable(t_bytecode *bc, t_object **variables, int idx) {
+    t_object *obj = object_new(Object_Numerical, VM_NUMBERS(bc, variables)[idx]);
+    object_inc_ref(obj);
+    variables[idx] = obj;
+    return obj;
 }
 
-static int get_operand(void) {
-    t_vm_context *ctx = get_current_vm_context();
 
-    // Read operand
-    char *ptr = ctx->bc->code + ctx->ip;
+/**
+ * Returns the object inside a register, or the constant when the operand refers to a constant
+ */
+static t_object *get_register(t_bytecode *bc, t_object **variables, int src) {
+    if (src & REG_CONST) {
+        return get_constant(bc, src & REG_MAX);
+    }
 
-    uint32_t ret = *ptr;
-    ctx->ip += sizeof(uint32_t);
+    VM_CHECK(src >= bc->variables_len, "Trying to fetch from outside variable range");
 
-    int tmp = ret;
-    return tmp;
+    t_object *obj = variables[src];
+    if (obj == VM_UNBOXED) {
+        return box_variable(bc, variables, src);
+    }
+    if (! obj) {
+        // Not a local variable, try the classes and imports from the current context
+        obj = si_find_var_in_context(get_name(bc, src), NULL);
+        if (! obj) {
+            saffire_error("This variable is not initialized!");
+        }
+    }
+    return obj;
 }
 
 
-static t_object *stack_pop(void) {
-    t_vm_context *ctx = get_current_vm_context();
+/**
+ * Reads the numerical value of a register (or constant) without boxing it. Returns 0 when it does not hold
+ * a numerical.
+ */
+static inline int get_register_number(t_bytecode *bc, t_object **variables, int src, long *value) {
+    t_object *obj;
+
+    if (src & REG_CONST) {
+        obj = get_constant(bc, src & REG_MAX);
+    } else {
+        obj = variables[src];
+        if (obj == VM_UNBOXED) {
+            *value = VM_NUMBERS(bc, variables)[src];
+            return 1;
+        }
+        if (! obj) return 0;
+    }
 
-    printf("STACK POP(%d)\n", ctx->sp);
+    if (! OBJECT_IS_NUMERICAL(obj)) return 0;
+    *value = ((t_numerical_object *)obj)->value;
+    return 1;
+}
 
-    if (ctx->sp == ctx->bc->stack_size) {
-        printf("Trying to pop from an empty stack");
-        exit(1);
+
+/**
+ * Returns the inline cache for the call site at the given code offset. Caches are only created once a
+ * site is actually executed.
+ */
+static t_inline_cache *get_site_cache(t_bytecode *bc, int offset) {
+    if (! bc->caches) {
+        bc->caches = (t_inline_cache **)smm_malloc((bc->code_len + 1) * sizeof(t_inline_cache *));
+        memset(bc->caches, 0, (bc->code_len + 1) * sizeof(t_inline_cache *));
     }
-    t_object *ret = ctx->stack[ctx->sp];
-    ctx->sp++;
+    if (! bc->caches[offset]) {
+        bc->caches[offset] = object_cache_new();
+    }
+    return bc->caches[offset];
+}
 
-    return ret;
+
+/**
+ * Compares two numerical values with one of the COMPARISON_EQ to COMPARISON_GE comparisons
+ */
+static inline int vm_compare_values(long a, int cmp, long b) {
+    switch (cmp) {
+        case COMPARISON_EQ : return a == b;
+        case COMPARISON_NE : return a != b;
+        case COMPARISON_LT : return a < b;
+        case COMPARISON_GT : return a > b;
+        case COMPARISON_LE : return a <= b;
+    }
+    return a >= b;
 }
 
 
-static void stack_push(t_object *obj) {
-    t_vm_context *ctx = get_current_vm_context();
+/**
+ * Returns the object as a boolean, calling the boolean() method when it is not a boolean already
+ */
+static t_object *vm_boolean(t_object *obj) {
+    if (OBJECT_IS_BOOLEAN(obj)) return obj;
+
+    t_object *method = object_find_method(obj, "boolean");
+    return object_call(obj, method, 0);
+}
 
-    printf("STACK PUSH(%d)\n", ctx->sp);
 
-    if (ctx->sp < 0) {
-        printf("Trying to push to a full stack");
-        exit(1);
+/**
+ * Compares two objects with one of the COMPARISON_EQ to COMPARISON_GE comparisons and returns the outcome as
+ * a C truth value. Numericals and strings are compared directly, without creating a boolean object.
+ */
+static int vm_compare_objects(t_object *a, int cmp, t_object *b) {
+    if (OBJECT_IS_NUMERICAL(a) && OBJECT_IS_NUMERICAL(b)) {
+        return vm_compare_values(((t_numerical_object *)a)->value, cmp, ((t_numerical_object *)b)->value);
     }
-    ctx->sp--;
-    ctx->stack[ctx->sp] = obj;
+    if (OBJECT_IS_STRING(a) && OBJECT_IS_STRING(b)) {
+        int diff = wcscmp(((t_string_object *)a)->value, ((t_string_object *)b)->value);
+        return vm_compare_values(diff, cmp, 0);
+    }
+
+    // References to the same object are always equal
+    if (a == b && cmp == COMPARISON_EQ) return 1;
 
+    if (a->type != b->type) {
+        saffire_error("Types on comparison are not equal");
+    }
+    return object_comparison(a, cmp, b) == Object_True;
 }
 
 
-static t_object *stack_fetch_top(void) {
-    t_vm_context *ctx = get_current_vm_context();
+/**
+ * Returns 1 when the thrown object is the class itself, an instance of it or derived from it
+ */
+static int vm_exception_matches(t_object *exc, t_object *class_obj) {
+    for (t_object *obj = exc; obj; obj = obj->parent) {
+        // Instances share the methods of their class
+        if (obj == class_obj || (class_obj->methods && obj->methods == class_obj->methods)) return 1;
+    }
+    return 0;
+}
+
 
-    return ctx->stack[ctx->sp];
+/**
+ * Returns the first entry of the exception table that covers the code offset, or NULL when there is none
+ */
+static t_bytecode_handler *vm_find_handler(t_bytecode *bc, int offset) {
+    for (int i=0; i!=bc->handlers_len; i++) {
+        t_bytecode_handler *handler = &bc->handlers[i];
+        if (offset >= handler->start && offset < handler->end) return handler;
+    }
+    return NULL;
 }
 
 
-static t_object *stack_fetch(int idx) {
-    t_vm_context *ctx = get_current_vm_context();
+/**
+ * Creates a new (user) class
+ */
+static t_object *vm_build_class(const char *name) {
+    t_object *obj = (t_object *)smm_malloc(sizeof(t_object));
+    obj->ref_count = 0;
+    obj->type = objectTypeAny;
+    obj->name = smm_strdup(name);
+    obj->flags = OBJECT_TYPE_CLASS;
+    obj->implement_count = 0;
+    obj->implements = NULL;
+    obj->methods = ht_create();
+    obj->properties = ht_create();
+    obj->constants = ht_create();
+    obj->operators = NULL;
+    obj->comparisons = NULL;
+    obj->funcs = &user_funcs;
+
+    // @TODO: Add modifier flags to obj->flags
+
+    // Check extends
+    obj->parent = Object_Base;
+
+    return obj;
+}
+
 
-    if (idx < 0 || idx >= ctx->bc->stack_size) {
-        printf("Trying to fetch from outside stack range");
-        exit(1);
+/**
+ * Lots of method checks before we can actually call a method
+ */
+static void vm_check_method_call(t_object *self, t_method_object *method) {
+    if (METHOD_IS_CONSTRUCTOR(method)) {
+        saffire_error("Cannot call constructor");
+    }
+    if (METHOD_IS_DESTRUCTOR(method)) {
+        saffire_error("Cannot call destructor");
+    }
+    if (OBJECT_TYPE_IS_ABSTRACT(self)) {
+        saffire_error("Cannot call an abstract class");
+    }
+    if (OBJECT_TYPE_IS_INTERFACE(self)) {
+        saffire_error("Cannot call an interface");
+    }
+    if (OBJECT_TYPE_IS_INSTANCE(self) && METHOD_IS_STATIC(method)) {
+        saffire_error("Cannot call a static method from an instance. Hint: use %s.%s()", self->name, ((t_object *)method)->name);
     }
+    if (OBJECT_TYPE_IS_CLASS(self) && ! METHOD_IS_STATIC(method)) {
+        saffire_error("Cannot call a non-static method directly from a class. Hint: instantiate first");
+    }
+}
+
+
+/**
+ * Returns the bytecode a tail call of the callable can run in the current frame, or NULL when the callable
+ * does not run bytecode and has to be called the regular way.
+ */
+static t_bytecode *vm_tail_call_bytecode(t_object *self, t_object *callable) {
+    if (! OBJECT_IS_METHOD(callable)) return NULL;
 
-    return ctx->stack[idx];
+    t_code_object *code = (t_code_object *)((t_method_object *)callable)->code;
+    if (! code || code->f || code->p || ! code->bc || code->bc->generator) return NULL;
+
+    vm_check_method_call(self, (t_method_object *)callable);
+    return code->bc;
 }
 
 
 /**
-  *
-  */
-static t_object *get_constant(int idx) {
-    t_vm_context *ctx = get_current_vm_context();
+ * Calls a method or instantiates a class
+ */
+static t_object *vm_call_object(t_object *self, t_object *callable, t_dll *args) {
+    t_object *ret = NULL;
 
-    if (idx < 0 || idx >= ctx->bc->constants_len) {
-        printf("Trying to fetch from outside constant range");
-        exit(1);
-    }
+    if (OBJECT_IS_METHOD(callable)) {
+        vm_check_method_call(self, (t_method_object *)callable);
 
-    t_bytecode_constant *c = ctx->bc->constants[idx];
-    switch (c->type) {
-        case BYTECODE_CONST_STRING :
-            RETURN_STRING(ctx->bc->constants[idx]->data.s);
-            break;
+        DEBUG_PRINT("+++ Calling method %s \n", callable->name);
+        ret = object_call_args(self, callable, args);
 
-        case BYTECODE_CONST_NUMERICAL :
-            RETURN_NUMERICAL(ctx->bc->constants[idx]->data.l);
-            break;
+    } else if (OBJECT_TYPE_IS_CLASS(callable)) {
+        DEBUG_PRINT("+++ Instantiating a new class for %s\n", callable->name);
+        ret = object_new(callable, args);
+        if (! ret) {
+            saffire_error("Cannot instantiate class %s", callable->name);
+        }
 
-        default :
-            printf("Cannot convert constant type %d to an object\n", idx);
-            exit(1);
+    } else {
+        saffire_error("Cannot call or instantiate %s", callable->name);
     }
 
+    return ret ? ret : Object_Null;
 }
 
 
-static void set_variable(int idx, t_object *obj) {
-    t_vm_context *ctx = get_current_vm_context();
+/**
+ * Imports a class from a context into the current context under an alias
+ */
+static void vm_import(t_object *class_obj, t_object *ctx_obj, const char *alias) {
+    if (! OBJECT_IS_STRING(ctx_obj)) {
+        saffire_error("Cannot find context to import %s from", alias);
+    }
+
+    char *classname = wctou8(((t_string_object *)class_obj)->value, ((t_string_object *)class_obj)->char_length);
+    char *ctx_name = wctou8(((t_string_object *)ctx_obj)->value, ((t_string_object *)ctx_obj)->char_length);
 
-    if (idx < 0 || idx >= ctx->bc->variables_len) {
-        printf("Trying to fetch from outside variable range");
-        exit(1);
+    // Check if variable is free
+    if (si_find_var_in_context(alias, NULL)) {
+        saffire_error("A variable named %s is already present or imported.", alias);
+    }
+
+    // Find class in context
+    t_ns_context *ctx = si_get_context(ctx_name);
+    if (ctx == NULL) {
+        saffire_error("Cannot find context: %s", ctx_name);
+    }
+    t_object *obj = si_find_var_in_context(classname, ctx);
+    if (! obj) {
+        saffire_error("Cannot find class %s inside context: %s", classname, ctx_name);
     }
 
-    ctx->variables[idx] = obj;
+    // Add the object to the current context as the alias variable
+    si_create_var_in_context(alias, NULL, obj, CTX_CREATE_ONLY);
+
+    DEBUG_PRINT("Imported class %s as %s from %s into %s\n", classname, alias, ctx_name, ctx->name);
+    smm_free(classname);
+    smm_free(ctx_name);
 }
 
 
 /**
-  *
-  */
-static t_object *get_variable(int idx) {
-    t_vm_context *ctx = get_current_vm_context();
+ * Aliases a context
+ */
+static void vm_use(t_object *name_obj, const char *alias) {
+    char *name = wctou8(((t_string_object *)name_obj)->value, ((t_string_object *)name_obj)->char_length);
+
+    // Check if variable is free
+    t_ns_context *ctx = si_find_context(alias);
+    if (ctx != NULL) {
+        saffire_error("A context named %s is already present or imported.", alias);
+    }
 
-    if (idx < 0 || idx >= ctx->bc->variables_len) {
-        printf("Trying to fetch from outside variable range");
-        exit(1);
+    ctx = si_find_context(name);
+    if (ctx == NULL) {
+        saffire_error("Context %s was not found.", name);
     }
-    return ctx->variables[idx];
+
+    si_create_context_alias(alias, ctx);
+    smm_free(name);
 }
 
-/**
-  *
-  */
-static t_object *get_name(int idx) {
-    t_vm_context *ctx = get_current_vm_context();
 
-    if (idx < 0 || idx >= ctx->bc->variables_len) {
-        printf("Trying to fetch from outside variable range");
-        exit(1);
+/*
+ * The instruction pointer, stack pointer and the frame's stack and variable bases live in local
+ * variables for the whole dispatch loop. They are only written back to the context when we leave
+ * the current frame.
+ */
+
+// Reads the next opcode
+#define NEXT_OPCODE()       (*ip++)
+
+// Reads the next operand. Most operands fit into a single byte, so that case is handled inline.
+#define NEXT_OPERAND()      (*ip < 0x80 ? (int)*ip++ : (int)vm_read_operand((const unsigned char **)&ip))
+
+// Reads the two operands of a superinstruction and packs them into the low and high 16 bits
+#define NEXT_OPERAND_PAIR() { oparg = NEXT_OPERAND(); \
+                              oparg = (int)((unsigned int)oparg | ((unsigned int)NEXT_OPERAND() << 16)); }
+
+// Reads the operands of a register instruction and packs them like REG_PACK() does
+#define NEXT_REG_OPERANDS() { int _dst = NEXT_OPERAND(); \
+                              int _src1 = NEXT_OPERAND(); \
+                              oparg = REG_PACK(_dst, _src1, NEXT_OPERAND()); }
+
+// Reads the target and register of a register jump and packs them like REG_JUMP_PACK() does
+#define NEXT_REG_JUMP_OPERANDS() { int _target = NEXT_OPERAND(); \
+                                   oparg = REG_JUMP_PACK(NEXT_OPERAND(), _target); }
+
+#define JUMP_TO(target)     { VM_CHECK((target) < 0 || (target) >= bc->code_len, "Trying to jump outside the code"); \
+                              ip = code + (target); }
+
+#define STACK_LEVEL()       (sp - stack)
+#define STACK_TOP()         (sp[-1])
+#define STACK_PUSH(obj)     { VM_CHECK(sp >= stack + bc->stack_size, "Trying to push to a full stack"); *sp++ = (obj); }
+#define STACK_POP()         (VM_CHECK_POP(), *--sp)
+
+#ifdef __DEBUG
+    #define VM_CHECK_POP()  (sp <= stack ? vm_fatal("Trying to pop from an empty stack") : (void)0)
+#else
+    #define VM_CHECK_POP()  ((void)0)
+#endif
+
+#define CHECK_VARIABLE(idx) VM_CHECK((idx) < 0 || (idx) >= bc->variables_len, "Trying to fetch from outside variable range")
+
+// Stores an object into a register
+#define REG_STORE(idx, obj) { CHECK_VARIABLE(idx); \
+                              object_inc_ref(obj); \
+                              if (variables[idx] && variables[idx] != VM_UNBOXED) object_dec_ref(variables[idx]); \
+                              variables[idx] = (obj); }
+
+// Stores a raw numerical into a register
+#define REG_STORE_NUMBER(idx, value) { CHECK_VARIABLE(idx); \
+                              if (variables[idx] && variables[idx] != VM_UNBOXED) object_dec_ref(variables[idx]); \
+                              variables[idx] = VM_UNBOXED; \
+                              VM_NUMBERS(bc, variables)[idx] = (value); }
+
+// Operands of superinstructions are packed into the low and high 16 bits
+#define OPERAND_LOW(arg)    ((arg) & 0xFFFF)
+#define OPERAND_HIGH(arg)   (((unsigned int)(arg) >> 16) & 0xFFFF)
+
+/*
+ * The line of an error is looked up from the offset in the frame, which we normally only write when leaving the
+ * frame. Instructions that can raise an error (or call into other code) store it first.
+ */
+#define SAVE_IP()           (ctx->ip = ip - code)
+
+/*
+ * Handler bodies that are shared between the regular opcodes and the superinstructions
+ */
+#define DO_LOAD_CONST(idx)  { obj1 = get_constant(bc, idx); \
+                              object_inc_ref(obj1); \
+                              STACK_PUSH(obj1); }
+
+#define DO_LOAD_VAR(idx)    { CHECK_VARIABLE(idx); \
+                              obj1 = variables[idx]; \
+                              if (obj1 == VM_UNBOXED) { \
+                                  obj1 = box_variable(bc, variables, idx); \
+                              } else if (! obj1) { \
+                                  /* Not a local variable, try the classes and imports from the current context */ \
+                                  obj1 = si_find_var_in_context(get_name(bc, idx), NULL); \
+                                  if (! obj1) { \
+                                      SAVE_IP(); \
+                                      saffire_error("This variable is not initialized!"); \
+                                  } \
+                              } \
+                              object_inc_ref(obj1); \
+                              STACK_PUSH(obj1); }
+
+// Inline cache of the instruction that is currently executed
+#define SITE_CACHE()        get_site_cache(bc, ip - code)
+
+#define DO_LOAD_METHOD(idx) { obj1 = STACK_TOP(); \
+                              obj2 = object_find_method_cached(obj1, get_name(bc, idx), SITE_CACHE()); \
+                              if (! obj2) { \
+                                  SAVE_IP(); \
+                                  saffire_error("Cannot find method or property named '%s' in '%s'", get_name(bc, idx), obj1->name); \
+                              } \
+                              object_inc_ref(obj2); \
+                              STACK_PUSH(obj2); }
+
+// Calls the method with argc arguments from the stack. The result is left in obj3.
+#define DO_CALL_METHOD(argc) { VM_CHECK(STACK_LEVEL() < (argc) + 2, "Trying to pop from an empty stack"); \
+                              /* Arguments are pushed in order, so they are found in order on the stack */ \
+                              dll = dll_init(); \
+                              for (int i=0; i!=(argc); i++) { \
+                                  dll_append(dll, sp[i - (argc)]); \
+                              } \
+                              sp -= (argc); \
+                              obj2 = STACK_POP(); \
+                              obj1 = STACK_POP(); \
+                              SAVE_IP(); \
+                              obj3 = vm_call_object(obj1, obj2, dll); \
+                              dll_free(dll); }
+
+#define DO_STORE_VAR(idx)   { CHECK_VARIABLE(idx); \
+                              obj1 = STACK_POP(); \
+                              obj2 = variables[idx]; \
+                              if (obj2 && obj2 != obj1 && obj2 != VM_UNBOXED) { \
+                                  object_dec_ref(obj2); \
+                              } \
+                              variables[idx] = obj1; }
+
+#define DO_LOAD_ATTRIB(idx) { obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              obj2 = ht_find(obj1->properties, get_name(bc, idx)); \
+                              if (obj2 == NULL) { \
+                                  obj2 = ht_find(obj1->constants, get_name(bc, idx)); \
+                                  if (obj2 == NULL) { \
+                                      SAVE_IP(); \
+                                      saffire_error("Cannot find constant or property '%s' from '%s'", get_name(bc, idx), obj1->name); \
+                                  } \
+                              } \
+                              object_inc_ref(obj2); \
+                              STACK_PUSH(obj2); }
+
+#define DO_BINARY_OP(opr)   { SAVE_IP(); \
+                              obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              obj2 = STACK_POP(); \
+                              object_dec_ref(obj2); \
+                              if (obj1->type != obj2->type) { \
+                                  saffire_error("Types on operator are not equal"); \
+                              } \
+                              obj3 = object_operator_cached(obj2, opr, 0, obj1, SITE_CACHE()); \
+                              object_inc_ref(obj3); \
+                              STACK_PUSH(obj3); }
+
+#define DO_COMPARE_OP(cmp)  { obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              obj2 = STACK_POP(); \
+                              object_dec_ref(obj2); \
+                              if (obj1 == obj2 && (cmp) == COMPARISON_EQ) { \
+                                  /* References to the same object are always equal */ \
+                                  obj3 = Object_True; \
+                              } else { \
+                                  SAVE_IP(); \
+                                  if (obj1->type != obj2->type) { \
+                                      saffire_error("Types on comparison are not equal"); \
+                                  } \
+                                  obj3 = object_comparison(obj2, cmp, obj1); \
+                              } \
+                              object_inc_ref(obj3); \
+                              STACK_PUSH(obj3); }
+
+/*
+ * Quickening: an operator that sees two numericals rewrites its own opcode into the quickened form, which works
+ * on the values directly. When the quickened form meets other types, it rewrites itself back (deoptimizes). A
+ * site that deoptimized VM_QUICKEN_MISSES times stays generic.
+ */
+#define VM_QUICKEN_MISSES   4
+
+#define NUMERICAL_PAIR(a, b)    (OBJECT_IS_NUMERICAL(a) && OBJECT_IS_NUMERICAL(b))
+#define NUMERICAL_VALUE(obj)    (((t_numerical_object *)(obj))->value)
+
+// Quickens the instruction at instr when the two operands on top of the stack are numericals
+#define QUICKEN()           { if (NUMERICAL_PAIR(sp[-2], sp[-1]) && SITE_CACHE()->misses < VM_QUICKEN_MISSES) { \
+                                  *instr = vm_opcode_quickened(*instr); \
+                              } }
+
+// Rewrites the quickened instruction at instr back into its generic opcode
+#define DEOPTIMIZE()        { *instr = vm_opcode_generic(*instr); \
+                              SITE_CACHE()->misses++; }
+
+#define DO_BINARY_NUM(op)   { obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              obj2 = STACK_POP(); \
+                              object_dec_ref(obj2); \
+                              obj3 = object_new(Object_Numerical, NUMERICAL_VALUE(obj2) op NUMERICAL_VALUE(obj1)); \
+                              object_inc_ref(obj3); \
+                              STACK_PUSH(obj3); }
+
+#define DO_COMPARE_NUM(cmp) { obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              obj2 = STACK_POP(); \
+                              object_dec_ref(obj2); \
+                              obj3 = vm_compare_values(NUMERICAL_VALUE(obj2), cmp, NUMERICAL_VALUE(obj1)) ? Object_True : Object_False; \
+                              object_inc_ref(obj3); \
+                              STACK_PUSH(obj3); }
+
+// Pops the two operands and sets result to the outcome of the comparison
+#define DO_COMPARE_JUMP(cmp, result) { \
+                              obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              obj2 = STACK_POP(); \
+                              object_dec_ref(obj2); \
+                              SAVE_IP(); \
+                              result = vm_compare_objects(obj2, cmp, obj1); }
+
+// Pops the class and sets result to 1 when the exception below it matches
+#define DO_MATCH_EXCEPTION(result) { \
+                              obj1 = STACK_POP(); \
+                              object_dec_ref(obj1); \
+                              result = vm_exception_matches(STACK_TOP(), obj1); }
+
+#define DO_REG_OPERATOR(arg, opr) { \
+                              SAVE_IP(); \
+                              obj1 = get_register(bc, variables, REG_SRC1(arg)); \
+                              obj2 = get_register(bc, variables, REG_SRC2(arg)); \
+                              if (obj1->type != obj2->type) { \
+                                  saffire_error("Types on operator are not equal"); \
+                              } \
+                              obj3 = object_operator_cached(obj1, opr, 0, obj2, SITE_CACHE()); \
+                              REG_STORE(REG_DST(arg), obj3); }
+
+// Register arithmetic on two numericals stores a raw numerical, other types use the operator
+#define DO_REG_NUMERICAL(arg, op, opr) { \
+                              long _l, _r; \
+                              if (get_register_number(bc, variables, REG_SRC1(arg), &_l) && \
+                                  get_register_number(bc, variables, REG_SRC2(arg), &_r)) { \
+                                  REG_STORE_NUMBER(REG_DST(arg), _l op _r); \
+                              } else { \
+                                  DO_REG_OPERATOR(arg, opr); \
+                              } }
+
+#define DO_REG_MOVE(arg)    { if (! (REG_SRC1(arg) & REG_CONST) && variables[REG_SRC1(arg)] == VM_UNBOXED) { \
+                                  REG_STORE_NUMBER(REG_DST(arg), VM_NUMBERS(bc, variables)[REG_SRC1(arg)]); \
+                              } else { \
+                                  SAVE_IP(); \
+                                  obj1 = get_register(bc, variables, REG_SRC1(arg)); \
+                                  REG_STORE(REG_DST(arg), obj1); \
+                              } }
+
+#define DO_REG_COMPARE(arg, cmp) { \
+                              long _l, _r; \
+                              if (get_register_number(bc, variables, REG_SRC1(arg), &_l) && \
+                                  get_register_number(bc, variables, REG_SRC2(arg), &_r)) { \
+                                  obj3 = vm_compare_values(_l, cmp, _r) ? Object_True : Object_False; \
+                              } else { \
+                                  SAVE_IP(); \
+                                  obj1 = get_register(bc, variables, REG_SRC1(arg)); \
+                                  obj2 = get_register(bc, variables, REG_SRC2(arg)); \
+                                  if (obj1 == obj2 && (cmp) == COMPARISON_EQ) { \
+                                      /* References to the same object are always equal */ \
+                                      obj3 = Object_True; \
+                                  } else { \
+                                      if (obj1->type != obj2->type) { \
+                                          saffire_error("Types on comparison are not equal"); \
+                                      } \
+                                      obj3 = object_comparison(obj1, cmp, obj2); \
+                                  } \
+                              } \
+                              REG_STORE(REG_DST(arg), obj3); }
+
+// Returns the truth value of a register. A raw numerical is true when it is not 0.
+#define REG_TRUTH(reg)      (variables[reg] == VM_UNBOXED ? VM_NUMBERS(bc, variables)[reg] != 0 : \
+                             (SAVE_IP(), vm_boolean(get_register(bc, variables, reg))) == Object_True)
+
+
+/*
+ * Superinstructions are generated (see vm_superinstructions.h). A superinstruction runs the handler bodies of its
+ * components one after another, the components are constants so the compiler drops all other bodies. Like the
+ * optimizer, these only know how to run the components that tools/gen_superinstructions.py accepts.
+ */
+#define SUPER_HAS_OPERAND(op)   ((op) >= HAVE_ARGUMENT)
+#define SUPER_OPERANDS(a, b, c) (SUPER_HAS_OPERAND(a) + SUPER_HAS_OPERAND(b) + SUPER_HAS_OPERAND(c))
+
+// Operand of a component that has n components with an operand before it. Only two operands are packed.
+#define SUPER_OPERAND(a, b, c, n)   (SUPER_OPERANDS(a, b, c) != 2 ? oparg : (n) == 0 ? (int)OPERAND_LOW(oparg) : (int)OPERAND_HIGH(oparg))
+#define SUPER_OPERAND_A(a, b, c)    SUPER_OPERAND(a, b, c, 0)
+#define SUPER_OPERAND_B(a, b, c)    SUPER_OPERAND(a, b, c, SUPER_HAS_OPERAND(a))
+#define SUPER_OPERAND_C(a, b, c)    SUPER_OPERAND(a, b, c, SUPER_HAS_OPERAND(a) + SUPER_HAS_OPERAND(b))
+
+// Last component, and whether it has a quickened form
+#define SUPER_LAST(b, c)        ((c) ? (c) : (b))
+#define SUPER_QUICKENS(op)      ((op) == VM_BINARY_ADD || (op) == VM_BINARY_SUBTRACT || (op) == VM_BINARY_MULTIPLY)
+#define SUPER_CALLS(a, b, c)    ((a) == VM_CALL_METHOD || (b) == VM_CALL_METHOD || (c) == VM_CALL_METHOD)
+
+// Runs a single component (nothing for 0). CHECK leaves the handler when a call threw.
+#define SUPER_STEP(op, arg, CHECK) { \
+                              if ((op) == VM_LOAD_CONST) DO_LOAD_CONST(arg) \
+                              else if ((op) == VM_LOAD_VAR) DO_LOAD_VAR(arg) \
+                              else if ((op) == VM_LOAD_ATTRIB) DO_LOAD_ATTRIB(arg) \
+                              else if ((op) == VM_LOAD_METHOD) DO_LOAD_METHOD(arg) \
+                              else if ((op) == VM_STORE_VAR) DO_STORE_VAR(arg) \
+                              else if ((op) == VM_DUP_TOP) { \
+                                  obj1 = STACK_TOP(); \
+                                  object_inc_ref(obj1); \
+                                  STACK_PUSH(obj1); \
+                              } else if ((op) == VM_POP_TOP) { \
+                                  obj1 = STACK_POP(); \
+                                  object_dec_ref(obj1); \
+                              } else if ((op) == VM_CALL_METHOD) { \
+                                  DO_CALL_METHOD(arg); \
+                                  CHECK(); \
+                                  object_inc_ref(obj3); \
+                                  STACK_PUSH(obj3); \
+                              } else if ((op) >= VM_BINARY_ADD && (op) <= VM_BINARY_SHR) { \
+                                  DO_BINARY_OP((op) - VM_BINARY_ADD + OPERATOR_ADD); \
+                              } }
+
+// Runs the quickened form of the last component on two numericals
+#define SUPER_STEP_NUM(op)  { if ((op) == VM_BINARY_ADD) DO_BINARY_NUM(+) \
+                              else if ((op) == VM_BINARY_SUBTRACT) DO_BINARY_NUM(-) \
+                              else DO_BINARY_NUM(*) }
+
+// Runs all components but the last one
+#define SUPER_STEPS_BUT_LAST(a, b, c, CHECK) { \
+                              SUPER_STEP(a, SUPER_OPERAND_A(a, b, c), CHECK); \
+                              SUPER_STEP((c) ? (b) : 0, SUPER_OPERAND_B(a, b, c), CHECK); }
+
+#define SUPER_STEP_LAST(a, b, c, CHECK) \
+                              SUPER_STEP(SUPER_LAST(b, c), (c) ? SUPER_OPERAND_C(a, b, c) : SUPER_OPERAND_B(a, b, c), CHECK)
+
+#if VM_JIT
+/*
+ * JIT helpers. The native code calls one of these for every instruction. They load the frame from the
+ * context, run the same handler body as the interpreter and write the stack pointer back.
+ */
+#define JIT_UNUSED          __attribute__((unused))
+
+#define JIT_HELPER(name)    static intptr_t jit_##name(void *_ctx, int oparg, int pc)
+
+#define JIT_FRAME_ENTER     t_vm_context *ctx = (t_vm_context *)_ctx; \
+                            t_bytecode *bc = ctx->bc; \
+                            unsigned char *code JIT_UNUSED = (unsigned char *)bc->code; \
+                            unsigned char *ip JIT_UNUSED = code + pc; \
+                            t_object **stack = ctx->stack; \
+                            t_object **sp JIT_UNUSED = stack + ctx->sp; \
+                            t_object **variables JIT_UNUSED = ctx->variables; \
+                            t_object *obj1 JIT_UNUSED, *obj2 JIT_UNUSED, *obj3 JIT_UNUSED, *obj4 JIT_UNUSED; \
+                            t_dll *dll JIT_UNUSED;
+
+#define JIT_FRAME_LEAVE     ctx->sp = sp - stack;
+
+// A call threw: leave the native code, the interpreter unwinds from the instruction before pc
+#define JIT_CHECK_EXCEPTION()   { if (vm_exception) { ctx->ip = pc; JIT_FRAME_LEAVE return 1; } }
+
+// The same for conditional jumps, which leave the native code by returning a negative value
+#define JIT_BRANCH_CHECK_EXCEPTION()    { if (vm_exception) { ctx->ip = pc; JIT_FRAME_LEAVE return -1; } }
+
+// Leaves the native code, the interpreter continues at pc
+JIT_HELPER(exit) {
+    t_vm_context *ctx = (t_vm_context *)_ctx;
+    ctx->ip = pc;
+    return 0;
+}
+
+JIT_HELPER(pop_top) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    object_dec_ref(obj1);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(rot_two) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    obj2 = STACK_POP();
+    STACK_PUSH(obj1);
+    STACK_PUSH(obj2);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(rot_three) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    obj2 = STACK_POP();
+    obj3 = STACK_POP();
+    STACK_PUSH(obj1);
+    STACK_PUSH(obj2);
+    STACK_PUSH(obj3);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(rot_four) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    obj2 = STACK_POP();
+    obj3 = STACK_POP();
+    obj4 = STACK_POP();
+    STACK_PUSH(obj1);
+    STACK_PUSH(obj2);
+    STACK_PUSH(obj3);
+    STACK_PUSH(obj4);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(dup_top) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_TOP();
+    object_inc_ref(obj1);
+    STACK_PUSH(obj1);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(load_const) {
+    JIT_FRAME_ENTER
+    DO_LOAD_CONST(oparg);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(load_var) {
+    JIT_FRAME_ENTER
+    DO_LOAD_VAR(oparg);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(store_var) {
+    JIT_FRAME_ENTER
+    DO_STORE_VAR(oparg);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(load_attrib) {
+    JIT_FRAME_ENTER
+    DO_LOAD_ATTRIB(oparg);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(load_method) {
+    JIT_FRAME_ENTER
+    DO_LOAD_METHOD(oparg);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+JIT_HELPER(call_method) {
+    JIT_FRAME_ENTER
+    DO_CALL_METHOD(oparg);
+    JIT_CHECK_EXCEPTION();
+    object_inc_ref(obj3);
+    STACK_PUSH(obj3);
+    JIT_FRAME_LEAVE
+    return 0;
+}
+
+#define JIT_BINARY_HELPER(name, opr) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        DO_BINARY_OP(opr); \
+        JIT_FRAME_LEAVE \
+        return 0; \
     }
-    RETURN_STRING(ctx->bc->variables[idx]->s);
+
+JIT_BINARY_HELPER(binary_add, OPERATOR_ADD)
+JIT_BINARY_HELPER(binary_subtract, OPERATOR_SUB)
+JIT_BINARY_HELPER(binary_multiply, OPERATOR_MUL)
+JIT_BINARY_HELPER(binary_divide, OPERATOR_DIV)
+JIT_BINARY_HELPER(binary_modulo, OPERATOR_MOD)
+JIT_BINARY_HELPER(binary_and, OPERATOR_AND)
+JIT_BINARY_HELPER(binary_or, OPERATOR_OR)
+JIT_BINARY_HELPER(binary_xor, OPERATOR_XOR)
+JIT_BINARY_HELPER(binary_shl, OPERATOR_SHL)
+JIT_BINARY_HELPER(binary_shr, OPERATOR_SHR)
+
+JIT_HELPER(compare_op) {
+    JIT_FRAME_ENTER
+    DO_COMPARE_OP(oparg);
+    JIT_FRAME_LEAVE
+    return 0;
 }
 
-/**
- *
+/*
+ * Quickened instructions in native code cannot be rewritten anymore. On other types, they just run the generic
+ * handler body.
  */
-int vm_execute(t_bytecode *source_bc) {
-    int opcode, oparg;
+#define JIT_BINARY_NUM_HELPER(name, op, opr) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        if (NUMERICAL_PAIR(sp[-2], sp[-1])) { \
+            DO_BINARY_NUM(op); \
+        } else { \
+            DO_BINARY_OP(opr); \
+        } \
+        JIT_FRAME_LEAVE \
+        return 0; \
+    }
+
+JIT_BINARY_NUM_HELPER(binary_add_num, +, OPERATOR_ADD)
+JIT_BINARY_NUM_HELPER(binary_subtract_num, -, OPERATOR_SUB)
+JIT_BINARY_NUM_HELPER(binary_multiply_num, *, OPERATOR_MUL)
 
-    contexts = dll_init();
-    t_vm_context *tmp = create_context(source_bc);
-    push_context(tmp);
+JIT_HELPER(compare_op_num) {
+    JIT_FRAME_ENTER
+    if (oparg <= COMPARISON_GE && NUMERICAL_PAIR(sp[-2], sp[-1])) {
+        DO_COMPARE_NUM(oparg);
+    } else {
+        DO_COMPARE_OP(oparg);
+    }
+    JIT_FRAME_LEAVE
+    return 0;
+}
 
-    t_object *obj1, *obj2, *obj3, *obj4;
+// Conditional jumps return 1 when the jump must be taken, and -1 when a boolean() method threw
+JIT_HELPER(pop_jump_if_false) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    object_dec_ref(obj1);
+    JIT_FRAME_LEAVE
+    obj2 = vm_boolean(obj1);
+    JIT_BRANCH_CHECK_EXCEPTION();
+    return obj2 == Object_False;
+}
 
+JIT_HELPER(pop_jump_if_true) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    object_dec_ref(obj1);
+    JIT_FRAME_LEAVE
+    obj2 = vm_boolean(obj1);
+    JIT_BRANCH_CHECK_EXCEPTION();
+    return obj2 == Object_True;
+}
 
-    while (1) {
-        // Room for some other stuff
-dispatch:
+#define JIT_COMPARE_JUMP_HELPER(name, cmp, taken) \
+    JIT_HELPER(name) { \
+        int outcome; \
+        JIT_FRAME_ENTER \
+        DO_COMPARE_JUMP(cmp, outcome); \
+        JIT_FRAME_LEAVE \
+        return outcome == taken; \
+    }
 
-        // Get opcode and additional argument
-        opcode = get_next_opcode();
-        if (opcode  == VM_STOP_CODE) break;
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_false_eq, COMPARISON_EQ, 0)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_false_ne, COMPARISON_NE, 0)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_false_lt, COMPARISON_LT, 0)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_false_gt, COMPARISON_GT, 0)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_false_le, COMPARISON_LE, 0)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_false_ge, COMPARISON_GE, 0)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_true_eq, COMPARISON_EQ, 1)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_true_ne, COMPARISON_NE, 1)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_true_lt, COMPARISON_LT, 1)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_true_gt, COMPARISON_GT, 1)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_true_le, COMPARISON_LE, 1)
+JIT_COMPARE_JUMP_HELPER(compare_jump_if_true_ge, COMPARISON_GE, 1)
+
+JIT_HELPER(match_exception) {
+    int matched;
+    JIT_FRAME_ENTER
+    DO_MATCH_EXCEPTION(matched);
+    JIT_FRAME_LEAVE
+    return ! matched;
+}
 
-        oparg = (opcode >= HAVE_ARGUMENT) ? get_operand() : 0;
-        printf("Opcode: %02X (%02X)\n", opcode, oparg);
+JIT_HELPER(reg_move) {
+    JIT_FRAME_ENTER
+    DO_REG_MOVE(oparg);
+    return 0;
+}
 
-        switch (opcode) {
-            // @TODO: DEBUG OPCODES
-            case VM_PRINT_VAR :
-                obj1 = stack_pop();
-                obj2 = object_find_method(obj1, "print");
-                object_call(obj1, obj2, 0);
-                goto dispatch;
-                break;
+#define JIT_REG_OPERATOR_HELPER(name, opr) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        DO_REG_OPERATOR(oparg, opr); \
+        return 0; \
+    }
 
-            case VM_POP_TOP :
-                obj1 = stack_pop();
-                object_dec_ref(obj1);
-                goto dispatch;
-                break;
-
-            case VM_ROT_TWO :
-                obj1 = stack_pop();
-                obj2 = stack_pop();
-                stack_push(obj1);
-                stack_push(obj2);
-                goto dispatch;
-                break;
-
-            case VM_ROT_THREE :
-                obj1 = stack_pop();
-                obj2 = stack_pop();
-                obj3 = stack_pop();
-                stack_push(obj1);
-                stack_push(obj2);
-                stack_push(obj3);
-                goto dispatch;
-                break;
-
-            case VM_DUP_TOP :
-                obj1 = stack_fetch_top();
-                object_inc_ref(obj1);
-                stack_push(obj1);
-                goto dispatch;
-                break;
-
-            case VM_ROT_FOUR :
-                obj1 = stack_fetch_top();
-                obj2 = stack_fetch_top();
-                obj3 = stack_fetch_top();
-                obj4 = stack_fetch_top();
-                stack_push(obj1);
-                stack_push(obj2);
-                stack_push(obj3);
-                stack_push(obj4);
-                goto dispatch;
-                break;
-
-            case VM_NOP :
-                goto dispatch;
-                break;
-
-            case VM_LOAD_CONST :
-                obj1 = get_constant(oparg);
-                object_inc_ref(obj1);
-                stack_push(obj1);
-                goto dispatch;
-                break;
-
-            case VM_STORE_VAR :
-                obj1 = stack_pop();
-                object_dec_ref(obj1);
-                set_variable(oparg, obj1);
-                goto dispatch;
-                break;
-                // @TODO: If string(obj1) exists in local store it there, otherwise, store in global
-
-            case VM_LOAD_VAR :
-                obj1 = get_variable(oparg);
-                object_inc_ref(obj1);
-                stack_push(obj1);
-                goto dispatch;
-                break;
-
-            case VM_BINARY_ADD :
-                obj1 = stack_pop();
-                object_dec_ref(obj1);
-                obj2 = stack_pop();
-                object_dec_ref(obj2);
+#define JIT_REG_NUMERICAL_HELPER(name, op, opr) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        DO_REG_NUMERICAL(oparg, op, opr); \
+        return 0; \
+    }
 
-                if (obj1->type != obj2->type) {
-                    saffire_error("Can only add equal types :/");
-                }
-                obj3 = object_operator(obj2, OPERATOR_ADD, 0, 1, obj1);
+JIT_REG_NUMERICAL_HELPER(reg_add, +, OPERATOR_ADD)
+JIT_REG_NUMERICAL_HELPER(reg_subtract, -, OPERATOR_SUB)
+JIT_REG_NUMERICAL_HELPER(reg_multiply, *, OPERATOR_MUL)
+JIT_REG_OPERATOR_HELPER(reg_divide, OPERATOR_DIV)
+JIT_REG_OPERATOR_HELPER(reg_modulo, OPERATOR_MOD)
+JIT_REG_OPERATOR_HELPER(reg_and, OPERATOR_AND)
+JIT_REG_OPERATOR_HELPER(reg_or, OPERATOR_OR)
+JIT_REG_OPERATOR_HELPER(reg_xor, OPERATOR_XOR)
+JIT_REG_OPERATOR_HELPER(reg_shl, OPERATOR_SHL)
+JIT_REG_OPERATOR_HELPER(reg_shr, OPERATOR_SHR)
+
+#define JIT_REG_COMPARE_HELPER(name, cmp) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        DO_REG_COMPARE(oparg, cmp); \
+        return 0; \
+    }
 
-                object_inc_ref(obj3);
-                stack_push(obj3);
-                goto dispatch;
-                break;
+JIT_REG_COMPARE_HELPER(reg_compare_eq, COMPARISON_EQ)
+JIT_REG_COMPARE_HELPER(reg_compare_ne, COMPARISON_NE)
+JIT_REG_COMPARE_HELPER(reg_compare_lt, COMPARISON_LT)
+JIT_REG_COMPARE_HELPER(reg_compare_gt, COMPARISON_GT)
+JIT_REG_COMPARE_HELPER(reg_compare_le, COMPARISON_LE)
+JIT_REG_COMPARE_HELPER(reg_compare_ge, COMPARISON_GE)
+
+JIT_HELPER(reg_jump_if_false) {
+    JIT_FRAME_ENTER
+    int taken = ! REG_TRUTH(REG_JUMP_REG(oparg));
+    JIT_BRANCH_CHECK_EXCEPTION();
+    return taken;
+}
 
-            case VM_BINARY_SUBTRACT :
-                obj1 = stack_pop();
-                object_dec_ref(obj1);
-                obj2 = stack_pop();
-                object_dec_ref(obj2);
+JIT_HELPER(reg_jump_if_true) {
+    JIT_FRAME_ENTER
+    int taken = REG_TRUTH(REG_JUMP_REG(oparg));
+    JIT_BRANCH_CHECK_EXCEPTION();
+    return taken;
+}
 
-                if (obj1->type != obj2->type) {
-                    saffire_error("Can only sub equal types :/");
-                }
-                obj3 = object_operator(obj2, OPERATOR_SUB, 0, 1, obj1);
+// Superinstructions, and their quickened forms that cannot be rewritten anymore in native code
+#define JIT_SUPERINSTRUCTION_HELPER(name, opcode, a, b, c) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        SUPER_STEPS_BUT_LAST(a, b, c, JIT_CHECK_EXCEPTION); \
+        SUPER_STEP_LAST(a, b, c, JIT_CHECK_EXCEPTION); \
+        JIT_FRAME_LEAVE \
+        return 0; \
+    }
 
+#define JIT_SUPERINSTRUCTION_NUM_HELPER(name, opcode, generic, a, b, c) \
+    JIT_HELPER(name) { \
+        JIT_FRAME_ENTER \
+        SUPER_STEPS_BUT_LAST(a, b, c, JIT_CHECK_EXCEPTION); \
+        if (NUMERICAL_PAIR(sp[-2], sp[-1])) { \
+            SUPER_STEP_NUM(SUPER_LAST(b, c)); \
+        } else { \
+            SUPER_STEP_LAST(a, b, c, JIT_CHECK_EXCEPTION); \
+        } \
+        JIT_FRAME_LEAVE \
+        return 0; \
+    }
+
+VM_SUPERINSTRUCTIONS(JIT_SUPERINSTRUCTION_HELPER)
+VM_SUPERINSTRUCTIONS_NUM(JIT_SUPERINSTRUCTION_NUM_HELPER)
+
+JIT_HELPER(return_value) {
+    JIT_FRAME_ENTER
+    obj1 = STACK_POP();
+    JIT_FRAME_LEAVE
+    return (intptr_t)obj1;
+}
+
+JIT_HELPER(stop_code) {
+    return (intptr_t)Object_Null;
+}
+
+#define JIT_SUPERINSTRUCTION_TEMPLATE(name, opcode, a, b, c) \
+    [VM_##name] = { SUPER_CALLS(a, b, c) ? JIT_CALL_CHECKED : JIT_CALL, jit_##name },
+#define JIT_SUPERINSTRUCTION_NUM_TEMPLATE(name, opcode, generic, a, b, c) \
+    [VM_##name] = { SUPER_CALLS(a, b, c) ? JIT_CALL_CHECKED : JIT_CALL, jit_##name },
+
+// Templates for every opcode. Opcodes that are not listed make the native code return to the interpreter.
+static const t_jit_template jit_templates[256] = {
+    [VM_STOP_CODE]              = { JIT_RETURN, jit_stop_code },
+    [VM_POP_TOP]                = { JIT_CALL, jit_pop_top },
+    [VM_ROT_TWO]                = { JIT_CALL, jit_rot_two },
+    [VM_ROT_THREE]              = { JIT_CALL, jit_rot_three },
+    [VM_DUP_TOP]                = { JIT_CALL, jit_dup_top },
+    [VM_ROT_FOUR]               = { JIT_CALL, jit_rot_four },
+    [VM_NOP]                    = { JIT_SKIP, NULL },
+    [VM_BINARY_ADD]             = { JIT_CALL, jit_binary_add },
+    [VM_BINARY_SUBTRACT]        = { JIT_CALL, jit_binary_subtract },
+    [VM_BINARY_MULTIPLY]        = { JIT_CALL, jit_binary_multiply },
+    [VM_BINARY_DIVIDE]          = { JIT_CALL, jit_binary_divide },
+    [VM_BINARY_MODULO]          = { JIT_CALL, jit_binary_modulo },
+    [VM_BINARY_AND]             = { JIT_CALL, jit_binary_and },
+    [VM_BINARY_OR]              = { JIT_CALL, jit_binary_or },
+    [VM_BINARY_XOR]             = { JIT_CALL, jit_binary_xor },
+    [VM_BINARY_SHL]             = { JIT_CALL, jit_binary_shl },
+    [VM_BINARY_SHR]             = { JIT_CALL, jit_binary_shr },
+    [VM_BINARY_ADD_NUM]         = { JIT_CALL, jit_binary_add_num },
+    [VM_BINARY_SUBTRACT_NUM]    = { JIT_CALL, jit_binary_subtract_num },
+    [VM_BINARY_MULTIPLY_NUM]    = { JIT_CALL, jit_binary_multiply_num },
+    [VM_RETURN_VALUE]           = { JIT_RETURN, jit_return_value },
+    [VM_STORE_VAR]              = { JIT_CALL, jit_store_var },
+    [VM_LOAD_CONST]             = { JIT_CALL, jit_load_const },
+    [VM_LOAD_VAR]               = { JIT_CALL, jit_load_var },
+    [VM_LOAD_ATTRIB]            = { JIT_CALL, jit_load_attrib },
+    [VM_LOAD_METHOD]            = { JIT_CALL, jit_load_method },
+    [VM_COMPARE_OP]             = { JIT_CALL, jit_compare_op },
+    [VM_COMPARE_OP_NUM]         = { JIT_CALL, jit_compare_op_num },
+    [VM_JUMP_ABSOLUTE]          = { JIT_JUMP, NULL },
+    [VM_POP_JUMP_IF_FALSE]      = { JIT_BRANCH, jit_pop_jump_if_false },
+    [VM_POP_JUMP_IF_TRUE]       = { JIT_BRANCH, jit_pop_jump_if_true },
+    [VM_COMPARE_JUMP_IF_FALSE_EQ]= { JIT_BRANCH, jit_compare_jump_if_false_eq },
+    [VM_COMPARE_JUMP_IF_FALSE_NE]= { JIT_BRANCH, jit_compare_jump_if_false_ne },
+    [VM_COMPARE_JUMP_IF_FALSE_LT]= { JIT_BRANCH, jit_compare_jump_if_false_lt },
+    [VM_COMPARE_JUMP_IF_FALSE_GT]= { JIT_BRANCH, jit_compare_jump_if_false_gt },
+    [VM_COMPARE_JUMP_IF_FALSE_LE]= { JIT_BRANCH, jit_compare_jump_if_false_le },
+    [VM_COMPARE_JUMP_IF_FALSE_GE]= { JIT_BRANCH, jit_compare_jump_if_false_ge },
+    [VM_COMPARE_JUMP_IF_TRUE_EQ]= { JIT_BRANCH, jit_compare_jump_if_true_eq },
+    [VM_COMPARE_JUMP_IF_TRUE_NE]= { JIT_BRANCH, jit_compare_jump_if_true_ne },
+    [VM_COMPARE_JUMP_IF_TRUE_LT]= { JIT_BRANCH, jit_compare_jump_if_true_lt },
+    [VM_COMPARE_JUMP_IF_TRUE_GT]= { JIT_BRANCH, jit_compare_jump_if_true_gt },
+    [VM_COMPARE_JUMP_IF_TRUE_LE]= { JIT_BRANCH, jit_compare_jump_if_true_le },
+    [VM_COMPARE_JUMP_IF_TRUE_GE]= { JIT_BRANCH, jit_compare_jump_if_true_ge },
+    [VM_MATCH_EXCEPTION]        = { JIT_BRANCH, jit_match_exception },
+    [VM_CALL_METHOD]            = { JIT_CALL_CHECKED, jit_call_method },
+    VM_SUPERINSTRUCTIONS(JIT_SUPERINSTRUCTION_TEMPLATE)
+    VM_SUPERINSTRUCTIONS_NUM(JIT_SUPERINSTRUCTION_NUM_TEMPLATE)
+    [VM_REG_MOVE]               = { JIT_CALL, jit_reg_move },
+    [VM_REG_ADD]                = { JIT_CALL, jit_reg_add },
+    [VM_REG_SUBTRACT]           = { JIT_CALL, jit_reg_subtract },
+    [VM_REG_MULTIPLY]           = { JIT_CALL, jit_reg_multiply },
+    [VM_REG_DIVIDE]             = { JIT_CALL, jit_reg_divide },
+    [VM_REG_MODULO]             = { JIT_CALL, jit_reg_modulo },
+    [VM_REG_AND]                = { JIT_CALL, jit_reg_and },
+    [VM_REG_OR]                 = { JIT_CALL, jit_reg_or },
+    [VM_REG_XOR]                = { JIT_CALL, jit_reg_xor },
+    [VM_REG_SHL]                = { JIT_CALL, jit_reg_shl },
+    [VM_REG_SHR]                = { JIT_CALL, jit_reg_shr },
+    [VM_REG_COMPARE_EQ]         = { JIT_CALL, jit_reg_compare_eq },
+    [VM_REG_COMPARE_NE]         = { JIT_CALL, jit_reg_compare_ne },
+    [VM_REG_COMPARE_LT]         = { JIT_CALL, jit_reg_compare_lt },
+    [VM_REG_COMPARE_GT]         = { JIT_CALL, jit_reg_compare_gt },
+    [VM_REG_COMPARE_LE]         = { JIT_CALL, jit_reg_compare_le },
+    [VM_REG_COMPARE_GE]         = { JIT_CALL, jit_reg_compare_ge },
+    [VM_REG_JUMP_IF_FALSE]      = { JIT_REG_BRANCH, jit_reg_jump_if_false },
+    [VM_REG_JUMP_IF_TRUE]       = { JIT_REG_BRANCH, jit_reg_jump_if_true },
+};
+
+/**
+ * Compiles the bytecode to native code. When this fails, we will not try again.
+ */
+static void vm_jit_compile(t_bytecode *bc) {
+    bc->jit = jit_compile(bc, jit_templates, jit_exit);
+    if (! bc->jit) bc->jit_failed = 1;
+}
+
+#define JIT_IS_HOT(bc, counter, threshold) \
+                            (vm_jit_enabled && ! (bc)->jit && ! (bc)->jit_failed && ++(bc)->counter >= (threshold))
+
+// Continues the frame in native code. When the native code returns to the interpreter, our locals are reloaded.
+#define JIT_ENTER()         { ctx->ip = ip - code; \
+                              ctx->sp = sp - stack; \
+                              ret = jit_enter(bc->jit, ctx, ctx->ip); \
+                              if (ret) goto vm_return; \
+                              ip = code + ctx->ip; \
+                              sp = stack + ctx->sp; \
+                              if (vm_exception) goto vm_unwind; }
+#else
+#define vm_jit_compile(bc)                  ((void)(bc))
+#define JIT_IS_HOT(bc, counter, threshold)  0
+#define JIT_ENTER()                         { }
+#endif
+
+// Jumps to the target. A backward jump closes a loop: it counts towards compiling the bytecode, and once
+// compiled, the rest of the frame runs natively.
+#define JUMP_LOOP(target)   { if (code + (target) < ip && (bc->jit || JIT_IS_HOT(bc, jit_backedges, JIT_BACKEDGE_THRESHOLD))) { \
+                                  if (! bc->jit) vm_jit_compile(bc); \
+                                  JUMP_TO(target); \
+                                  if (bc->jit) JIT_ENTER(); \
+                              } else { \
+                                  JUMP_TO(target); \
+                              } }
+
+// Calls return NULL when they threw. Only then the exception table is searched.
+#define CHECK_EXCEPTION()   { if (vm_exception) goto vm_unwind; }
+
+
+// Loads the frame into our locals
+#define LOAD_FRAME()        { bc = ctx->bc; \
+                              code = (unsigned char *)bc->code; \
+                              ip = code + ctx->ip; \
+                              stack = ctx->stack; \
+                              sp = stack + ctx->sp; \
+                              variables = ctx->variables; }
+
+#if VM_COMPUTED_GOTO
+    #define TARGET(op)      case op: _target_##op:
+    #define DISPATCH()      { VM_CHECK(ip >= code + bc->code_len, "Running past the end of the code"); \
+                              opcode = NEXT_OPCODE(); \
+                              goto *dispatch[opcode]; }
+#else
+    #define TARGET(op)      case op:
+    #define DISPATCH()      goto dispatch
+#endif
+
+
+/**
+ * Executes a single frame until it returns
+ */
+static t_object *_vm_execute(t_vm_context *ctx) {
+    t_vm_context *entry = ctx;
+    unsigned char *ip;
+    register t_object **sp;
+    t_object **stack, **variables;
+    unsigned char *code;
+    t_bytecode *bc;
+    int opcode, oparg, taken;
+    unsigned char *instr;
+    t_dll *dll;
+
+    t_object *obj1, *obj2, *obj3, *obj4, *ret;
+
+#if VM_COMPUTED_GOTO
+    static void *dispatch_table[256] = {
+        [0 ... 255]             = &&_unknown_opcode,
+        [VM_STOP_CODE]          = &&_target_VM_STOP_CODE,
+        [VM_PRINT_VAR]          = &&_target_VM_PRINT_VAR,
+        [VM_POP_TOP]            = &&_target_VM_POP_TOP,
+        [VM_ROT_TWO]            = &&_target_VM_ROT_TWO,
+        [VM_ROT_THREE]          = &&_target_VM_ROT_THREE,
+        [VM_DUP_TOP]            = &&_target_VM_DUP_TOP,
+        [VM_ROT_FOUR]           = &&_target_VM_ROT_FOUR,
+        [VM_NOP]                = &&_target_VM_NOP,
+        [VM_BINARY_ADD]         = &&_target_VM_BINARY_ADD,
+        [VM_BINARY_SUBTRACT]    = &&_target_VM_BINARY_SUBTRACT,
+        [VM_BINARY_MULTIPLY]    = &&_target_VM_BINARY_MULTIPLY,
+        [VM_BINARY_DIVIDE]      = &&_target_VM_BINARY_DIVIDE,
+        [VM_BINARY_MODULO]      = &&_target_VM_BINARY_MODULO,
+        [VM_BINARY_AND]         = &&_target_VM_BINARY_AND,
+        [VM_BINARY_OR]          = &&_target_VM_BINARY_OR,
+        [VM_BINARY_XOR]         = &&_target_VM_BINARY_XOR,
+        [VM_BINARY_SHL]         = &&_target_VM_BINARY_SHL,
+        [VM_BINARY_SHR]         = &&_target_VM_BINARY_SHR,
+        [VM_BINARY_ADD_NUM]     = &&_target_VM_BINARY_ADD_NUM,
+        [VM_BINARY_SUBTRACT_NUM]= &&_target_VM_BINARY_SUBTRACT_NUM,
+        [VM_BINARY_MULTIPLY_NUM]= &&_target_VM_BINARY_MULTIPLY_NUM,
+        [VM_BUILD_CLASS]        = &&_target_VM_BUILD_CLASS,
+        [VM_STORE_CLASS]        = &&_target_VM_STORE_CLASS,
+        [VM_RETURN_VALUE]       = &&_target_VM_RETURN_VALUE,
+        [VM_YIELD_VALUE]        = &&_target_VM_YIELD_VALUE,
+        [VM_THROW]              = &&_target_VM_THROW,
+        [VM_STORE_VAR]          = &&_target_VM_STORE_VAR,
+        [VM_STORE_CONST]        = &&_target_VM_STORE_CONST,
+        [VM_STORE_PROPERTY]     = &&_target_VM_STORE_PROPERTY,
+        [VM_STORE_METHOD]       = &&_target_VM_STORE_METHOD,
+        [VM_LOAD_CONST]         = &&_target_VM_LOAD_CONST,
+        [VM_LOAD_VAR]           = &&_target_VM_LOAD_VAR,
+        [VM_LOAD_ATTRIB]        = &&_target_VM_LOAD_ATTRIB,
+        [VM_LOAD_METHOD]        = &&_target_VM_LOAD_METHOD,
+        [VM_COMPARE_OP]         = &&_target_VM_COMPARE_OP,
+        [VM_COMPARE_OP_NUM]     = &&_target_VM_COMPARE_OP_NUM,
+        [VM_IMPORT]             = &&_target_VM_IMPORT,
+        [VM_USE]                = &&_target_VM_USE,
+        [VM_JUMP_ABSOLUTE]      = &&_target_VM_JUMP_ABSOLUTE,
+        [VM_POP_JUMP_IF_FALSE]  = &&_target_VM_POP_JUMP_IF_FALSE,
+        [VM_POP_JUMP_IF_TRUE]   = &&_target_VM_POP_JUMP_IF_TRUE,
+        [VM_FOR_ITER]           = &&_target_VM_FOR_ITER,
+        [VM_COMPARE_JUMP_IF_FALSE_EQ]   = &&_target_VM_COMPARE_JUMP_IF_FALSE_EQ,
+        [VM_COMPARE_JUMP_IF_FALSE_NE]   = &&_target_VM_COMPARE_JUMP_IF_FALSE_NE,
+        [VM_COMPARE_JUMP_IF_FALSE_LT]   = &&_target_VM_COMPARE_JUMP_IF_FALSE_LT,
+        [VM_COMPARE_JUMP_IF_FALSE_GT]   = &&_target_VM_COMPARE_JUMP_IF_FALSE_GT,
+        [VM_COMPARE_JUMP_IF_FALSE_LE]   = &&_target_VM_COMPARE_JUMP_IF_FALSE_LE,
+        [VM_COMPARE_JUMP_IF_FALSE_GE]   = &&_target_VM_COMPARE_JUMP_IF_FALSE_GE,
+        [VM_COMPARE_JUMP_IF_TRUE_EQ]    = &&_target_VM_COMPARE_JUMP_IF_TRUE_EQ,
+        [VM_COMPARE_JUMP_IF_TRUE_NE]    = &&_target_VM_COMPARE_JUMP_IF_TRUE_NE,
+        [VM_COMPARE_JUMP_IF_TRUE_LT]    = &&_target_VM_COMPARE_JUMP_IF_TRUE_LT,
+        [VM_COMPARE_JUMP_IF_TRUE_GT]    = &&_target_VM_COMPARE_JUMP_IF_TRUE_GT,
+        [VM_COMPARE_JUMP_IF_TRUE_LE]    = &&_target_VM_COMPARE_JUMP_IF_TRUE_LE,
+        [VM_COMPARE_JUMP_IF_TRUE_GE]    = &&_target_VM_COMPARE_JUMP_IF_TRUE_GE,
+        [VM_MATCH_EXCEPTION]    = &&_target_VM_MATCH_EXCEPTION,
+        [VM_CALL_METHOD]        = &&_target_VM_CALL_METHOD,
+        [VM_TAIL_CALL]          = &&_target_VM_TAIL_CALL,
+
+#define SUPERINSTRUCTION_TARGET(name, opcode, ...)  [VM_##name] = &&_target_VM_##name,
+        VM_SUPERINSTRUCTIONS(SUPERINSTRUCTION_TARGET)
+        VM_SUPERINSTRUCTIONS_NUM(SUPERINSTRUCTION_TARGET)
+
+        [VM_REG_MOVE]           = &&_target_VM_REG_MOVE,
+        [VM_REG_ADD]            = &&_target_VM_REG_ADD,
+        [VM_REG_SUBTRACT]       = &&_target_VM_REG_SUBTRACT,
+        [VM_REG_MULTIPLY]       = &&_target_VM_REG_MULTIPLY,
+        [VM_REG_DIVIDE]         = &&_target_VM_REG_DIVIDE,
+        [VM_REG_MODULO]         = &&_target_VM_REG_MODULO,
+        [VM_REG_AND]            = &&_target_VM_REG_AND,
+        [VM_REG_OR]             = &&_target_VM_REG_OR,
+        [VM_REG_XOR]            = &&_target_VM_REG_XOR,
+        [VM_REG_SHL]            = &&_target_VM_REG_SHL,
+        [VM_REG_SHR]            = &&_target_VM_REG_SHR,
+        [VM_REG_COMPARE_EQ]     = &&_target_VM_REG_COMPARE_EQ,
+        [VM_REG_COMPARE_NE]     = &&_target_VM_REG_COMPARE_NE,
+        [VM_REG_COMPARE_LT]     = &&_target_VM_REG_COMPARE_LT,
+        [VM_REG_COMPARE_GT]     = &&_target_VM_REG_COMPARE_GT,
+        [VM_REG_COMPARE_LE]     = &&_target_VM_REG_COMPARE_LE,
+        [VM_REG_COMPARE_GE]     = &&_target_VM_REG_COMPARE_GE,
+        [VM_REG_JUMP_IF_FALSE]  = &&_target_VM_REG_JUMP_IF_FALSE,
+        [VM_REG_JUMP_IF_TRUE]   = &&_target_VM_REG_JUMP_IF_TRUE,
+    };
+
+    // When profiling or tracing, every opcode passes the profiler first. Otherwise this costs nothing.
+    static void *profile_table[256] = {
+        [0 ... 255]             = &&_profile_opcode,
+    };
+    void **dispatch = (vm_profiling() || vm_trace_enabled) ? profile_table : dispatch_table;
+#endif
+
+    LOAD_FRAME();
+
+    // Hot code runs natively
+    if (bc->jit) JIT_ENTER();
+
+#if VM_COMPUTED_GOTO
+    // Jump straight into the first handler, every handler dispatches the next one itself
+    DISPATCH();
+
+_profile_opcode:
+    if (vm_trace_enabled) vm_trace_record(ip - 1 - code, opcode, sp - stack, frame_depth);
+    vm_profile_record(opcode);
+    goto *dispatch_table[opcode];
+#else
+dispatch:
+    VM_CHECK(ip >= code + bc->code_len, "Running past the end of the code");
+
+    // Get opcode
+    opcode = NEXT_OPCODE();
+
+    if (vm_trace_enabled) {
+        vm_trace_record(ip - 1 - code, opcode, sp - stack, frame_depth);
+    }
+    if (vm_profiling()) {
+        vm_profile_record(opcode);
+    }
+#endif
+
+    switch (opcode) {
+        TARGET(VM_STOP_CODE)
+            goto vm_stop;
+
+        // @TODO: DEBUG OPCODES
+        TARGET(VM_PRINT_VAR)
+            obj1 = STACK_POP();
+            obj2 = object_find_method(obj1, "print");
+            object_call(obj1, obj2, 0);
+            DISPATCH();
+
+        TARGET(VM_POP_TOP)
+            obj1 = STACK_POP();
+            object_dec_ref(obj1);
+            DISPATCH();
+
+        TARGET(VM_ROT_TWO)
+            obj1 = STACK_POP();
+            obj2 = STACK_POP();
+            STACK_PUSH(obj1);
+            STACK_PUSH(obj2);
+            DISPATCH();
+
+        TARGET(VM_ROT_THREE)
+            obj1 = STACK_POP();
+            obj2 = STACK_POP();
+            obj3 = STACK_POP();
+            STACK_PUSH(obj1);
+            STACK_PUSH(obj2);
+            STACK_PUSH(obj3);
+            DISPATCH();
+
+        TARGET(VM_DUP_TOP)
+            obj1 = STACK_TOP();
+            object_inc_ref(obj1);
+            STACK_PUSH(obj1);
+            DISPATCH();
+
+        TARGET(VM_ROT_FOUR)
+            obj1 = STACK_POP();
+            obj2 = STACK_POP();
+            obj3 = STACK_POP();
+            obj4 = STACK_POP();
+            STACK_PUSH(obj1);
+            STACK_PUSH(obj2);
+            STACK_PUSH(obj3);
+            STACK_PUSH(obj4);
+            DISPATCH();
+
+        TARGET(VM_NOP)
+            DISPATCH();
+
+        TARGET(VM_LOAD_CONST)
+            oparg = NEXT_OPERAND();
+            DO_LOAD_CONST(oparg);
+            DISPATCH();
+
+        TARGET(VM_STORE_VAR)
+            oparg = NEXT_OPERAND();
+            DO_STORE_VAR(oparg);
+            DISPATCH();
+
+        TARGET(VM_LOAD_VAR)
+            oparg = NEXT_OPERAND();
+            DO_LOAD_VAR(oparg);
+            DISPATCH();
+
+        TARGET(VM_LOAD_ATTRIB)
+            oparg = NEXT_OPERAND();
+            DO_LOAD_ATTRIB(oparg);
+            DISPATCH();
+
+        TARGET(VM_LOAD_METHOD)
+            oparg = NEXT_OPERAND();
+            DO_LOAD_METHOD(oparg);
+            DISPATCH();
+
+        TARGET(VM_CALL_METHOD)
+            oparg = NEXT_OPERAND();
+            DO_CALL_METHOD(oparg);
+            CHECK_EXCEPTION();
+            object_inc_ref(obj3);
+            STACK_PUSH(obj3);
+            DISPATCH();
+
+        TARGET(VM_TAIL_CALL)
+            // Stack holds: self, method, arguments
+            oparg = NEXT_OPERAND();
+            // A generator frame does not live on the value stack, so it cannot be handed over
+            SAVE_IP();
+            t_bytecode *callee = ctx->generator ? NULL : vm_tail_call_bytecode(sp[-(oparg + 2)], sp[-(oparg + 1)]);
+            if (! callee) {
+                // Not bytecode, so call it and return its result
+                DO_CALL_METHOD(oparg);
+                CHECK_EXCEPTION();
                 object_inc_ref(obj3);
-                stack_push(obj3);
-                goto dispatch;
-                break;
+                ret = obj3;
+                goto vm_return;
+            }
+
+            // Arguments are not passed to bytecode (just like vm_call() does), the callee takes over our frame
+            replace_context(ctx, callee);
+            if (vm_profile_sequences) vm_profile_sequences_reset();
+            if (JIT_IS_HOT(callee, jit_calls, JIT_CALL_THRESHOLD)) {
+                vm_jit_compile(callee);
+            }
+
+            LOAD_FRAME();
+            if (bc->jit) JIT_ENTER();
+            DISPATCH();
+
+#define SUPERINSTRUCTION_HANDLER(name, opcode, a, b, c) \
+        TARGET(VM_##name) \
+            instr = ip - 1; \
+            if (SUPER_OPERANDS(a, b, c) == 2) NEXT_OPERAND_PAIR() \
+            else if (SUPER_OPERANDS(a, b, c) == 1) oparg = NEXT_OPERAND(); \
+            SUPER_STEPS_BUT_LAST(a, b, c, CHECK_EXCEPTION); \
+            if (SUPER_QUICKENS(SUPER_LAST(b, c))) QUICKEN(); \
+            SUPER_STEP_LAST(a, b, c, CHECK_EXCEPTION); \
+            DISPATCH();
+
+        VM_SUPERINSTRUCTIONS(SUPERINSTRUCTION_HANDLER)
+
+        TARGET(VM_BINARY_ADD)
+        TARGET(VM_BINARY_SUBTRACT)
+        TARGET(VM_BINARY_MULTIPLY)
+            instr = ip - 1;
+            QUICKEN();
+            goto vm_binary_generic;
+
+        TARGET(VM_BINARY_DIVIDE)
+        TARGET(VM_BINARY_MODULO)
+        TARGET(VM_BINARY_AND)
+        TARGET(VM_BINARY_OR)
+        TARGET(VM_BINARY_XOR)
+        TARGET(VM_BINARY_SHL)
+        TARGET(VM_BINARY_SHR)
+vm_binary_generic:
+            DO_BINARY_OP(opcode - VM_BINARY_ADD + OPERATOR_ADD);
+            DISPATCH();
+
+        TARGET(VM_BINARY_ADD_NUM)
+        TARGET(VM_BINARY_SUBTRACT_NUM)
+        TARGET(VM_BINARY_MULTIPLY_NUM)
+            if (! NUMERICAL_PAIR(sp[-2], sp[-1])) {
+                instr = ip - 1;
+                DEOPTIMIZE();
+                opcode = *instr;
+                goto vm_binary_generic;
+            }
+            if (opcode == VM_BINARY_ADD_NUM) {
+                DO_BINARY_NUM(+);
+            } else if (opcode == VM_BINARY_SUBTRACT_NUM) {
+                DO_BINARY_NUM(-);
+            } else {
+                DO_BINARY_NUM(*);
+            }
+            DISPATCH();
+
+// A quickened superinstruction that meets other types deoptimizes and runs the generic operator
+#define SUPERINSTRUCTION_NUM_HANDLER(name, opcode, generic, a, b, c) \
+        TARGET(VM_##name) \
+            instr = ip - 1; \
+            if (SUPER_OPERANDS(a, b, c) == 2) NEXT_OPERAND_PAIR() \
+            else if (SUPER_OPERANDS(a, b, c) == 1) oparg = NEXT_OPERAND(); \
+            SUPER_STEPS_BUT_LAST(a, b, c, CHECK_EXCEPTION); \
+            if (NUMERICAL_PAIR(sp[-2], sp[-1])) { \
+                SUPER_STEP_NUM(SUPER_LAST(b, c)); \
+            } else { \
+                DEOPTIMIZE(); \
+                SUPER_STEP_LAST(a, b, c, CHECK_EXCEPTION); \
+            } \
+            DISPATCH();
+
+        VM_SUPERINSTRUCTIONS_NUM(SUPERINSTRUCTION_NUM_HANDLER)
+
+        TARGET(VM_COMPARE_OP)
+            instr = ip - 1;
+            oparg = NEXT_OPERAND();
+            if (oparg <= COMPARISON_GE) QUICKEN();
+vm_compare_generic:
+            DO_COMPARE_OP(oparg);
+            DISPATCH();
+
+        TARGET(VM_COMPARE_OP_NUM)
+            instr = ip - 1;
+            oparg = NEXT_OPERAND();
+            if (oparg > COMPARISON_GE || ! NUMERICAL_PAIR(sp[-2], sp[-1])) {
+                DEOPTIMIZE();
+                goto vm_compare_generic;
+            }
+            DO_COMPARE_NUM(oparg);
+            DISPATCH();
+
+        TARGET(VM_JUMP_ABSOLUTE)
+            oparg = NEXT_OPERAND();
+            JUMP_LOOP(oparg);
+            DISPATCH();
+
+        TARGET(VM_POP_JUMP_IF_FALSE)
+            oparg = NEXT_OPERAND();
+            obj1 = STACK_POP();
+            object_dec_ref(obj1);
+            SAVE_IP();
+            obj2 = vm_boolean(obj1);
+            CHECK_EXCEPTION();
+            if (obj2 == Object_False) {
+                JUMP_LOOP(oparg);
+            }
+            DISPATCH();
+
+        TARGET(VM_POP_JUMP_IF_TRUE)
+            oparg = NEXT_OPERAND();
+            obj1 = STACK_POP();
+            object_dec_ref(obj1);
+            SAVE_IP();
+            obj2 = vm_boolean(obj1);
+            CHECK_EXCEPTION();
+            if (obj2 == Object_True) {
+                JUMP_LOOP(oparg);
+            }
+            DISPATCH();
+
+        TARGET(VM_COMPARE_JUMP_IF_FALSE_EQ)
+        TARGET(VM_COMPARE_JUMP_IF_FALSE_NE)
+        TARGET(VM_COMPARE_JUMP_IF_FALSE_LT)
+        TARGET(VM_COMPARE_JUMP_IF_FALSE_GT)
+        TARGET(VM_COMPARE_JUMP_IF_FALSE_LE)
+        TARGET(VM_COMPARE_JUMP_IF_FALSE_GE)
+            oparg = NEXT_OPERAND();
+            DO_COMPARE_JUMP(opcode - VM_COMPARE_JUMP_IF_FALSE_EQ + COMPARISON_EQ, taken);
+            if (! taken) {
+                JUMP_LOOP(oparg);
+            }
+            DISPATCH();
+
+        TARGET(VM_COMPARE_JUMP_IF_TRUE_EQ)
+        TARGET(VM_COMPARE_JUMP_IF_TRUE_NE)
+        TARGET(VM_COMPARE_JUMP_IF_TRUE_LT)
+        TARGET(VM_COMPARE_JUMP_IF_TRUE_GT)
+        TARGET(VM_COMPARE_JUMP_IF_TRUE_LE)
+        TARGET(VM_COMPARE_JUMP_IF_TRUE_GE)
+            oparg = NEXT_OPERAND();
+            DO_COMPARE_JUMP(opcode - VM_COMPARE_JUMP_IF_TRUE_EQ + COMPARISON_EQ, taken);
+            if (taken) {
+                JUMP_LOOP(oparg);
+            }
+            DISPATCH();
+
+        TARGET(VM_MATCH_EXCEPTION)
+            oparg = NEXT_OPERAND();
+            DO_MATCH_EXCEPTION(taken);
+            if (! taken) {
+                JUMP_TO(oparg);
+            }
+            DISPATCH();
+
+        /*
+         * Register instructions. These never touch the stack.
+         */
+        TARGET(VM_REG_MOVE)
+            NEXT_REG_OPERANDS();
+            DO_REG_MOVE(oparg);
+            DISPATCH();
+
+        TARGET(VM_REG_ADD)
+            NEXT_REG_OPERANDS();
+            DO_REG_NUMERICAL(oparg, +, OPERATOR_ADD);
+            DISPATCH();
+
+        TARGET(VM_REG_SUBTRACT)
+            NEXT_REG_OPERANDS();
+            DO_REG_NUMERICAL(oparg, -, OPERATOR_SUB);
+            DISPATCH();
+
+        TARGET(VM_REG_MULTIPLY)
+            NEXT_REG_OPERANDS();
+            DO_REG_NUMERICAL(oparg, *, OPERATOR_MUL);
+            DISPATCH();
+
+        TARGET(VM_REG_DIVIDE)
+        TARGET(VM_REG_MODULO)
+        TARGET(VM_REG_AND)
+        TARGET(VM_REG_OR)
+        TARGET(VM_REG_XOR)
+        TARGET(VM_REG_SHL)
+        TARGET(VM_REG_SHR)
+            NEXT_REG_OPERANDS();
+            DO_REG_OPERATOR(oparg, opcode - VM_REG_ADD + OPERATOR_ADD);
+            DISPATCH();
+
+        TARGET(VM_REG_COMPARE_EQ)
+        TARGET(VM_REG_COMPARE_NE)
+        TARGET(VM_REG_COMPARE_LT)
+        TARGET(VM_REG_COMPARE_GT)
+        TARGET(VM_REG_COMPARE_LE)
+        TARGET(VM_REG_COMPARE_GE)
+            NEXT_REG_OPERANDS();
+            DO_REG_COMPARE(oparg, opcode - VM_REG_COMPARE_EQ + COMPARISON_EQ);
+            DISPATCH();
+
+        TARGET(VM_REG_JUMP_IF_FALSE)
+            NEXT_REG_JUMP_OPERANDS();
+            taken = ! REG_TRUTH(REG_JUMP_REG(oparg));
+            CHECK_EXCEPTION();
+            if (taken) {
+                JUMP_LOOP((int)REG_JUMP_TARGET(oparg));
+            }
+            DISPATCH();
+
+        TARGET(VM_REG_JUMP_IF_TRUE)
+            NEXT_REG_JUMP_OPERANDS();
+            taken = REG_TRUTH(REG_JUMP_REG(oparg));
+            CHECK_EXCEPTION();
+            if (taken) {
+                JUMP_LOOP((int)REG_JUMP_TARGET(oparg));
+            }
+            DISPATCH();
+
+        TARGET(VM_BUILD_CLASS)
+            obj1 = STACK_POP();
+            object_dec_ref(obj1);
+
+            char *name = wctou8(((t_string_object *)obj1)->value, ((t_string_object *)obj1)->char_length);
+            obj2 = vm_build_class(name);
+            smm_free(name);
+
+            object_inc_ref(obj2);
+            STACK_PUSH(obj2);
+            DISPATCH();
+
+        TARGET(VM_STORE_CLASS)
+            // Add the class to the current context
+            obj1 = STACK_POP();
+            si_context_add_object(si_get_current_context(), obj1);
+            DISPATCH();
+
+        TARGET(VM_STORE_CONST)
+            oparg = NEXT_OPERAND();
+            obj1 = STACK_POP();
+            obj2 = STACK_TOP();
+            DEBUG_PRINT("Added constant %s to %s\n", get_name(bc, oparg), obj2->name);
+            ht_add(obj2->constants, get_name(bc, oparg), obj1);
+            DISPATCH();
+
+        TARGET(VM_STORE_PROPERTY)
+            oparg = NEXT_OPERAND();
+            obj1 = STACK_POP();
+            obj2 = STACK_TOP();
+            DEBUG_PRINT("Added property %s to %s\n", get_name(bc, oparg), obj2->name);
+            ht_add(obj2->properties, get_name(bc, oparg), obj1);
+            DISPATCH();
+
+        TARGET(VM_STORE_METHOD)
+            // Stack holds: class, code, flags, visibility
+            oparg = NEXT_OPERAND();
+            obj3 = STACK_POP();
+            obj2 = STACK_POP();
+            obj1 = STACK_POP();
+            obj4 = STACK_TOP();
+
+            DEBUG_PRINT("Adding method: %s to %s\n", get_name(bc, oparg), obj4->name);
+            obj1 = object_new(Object_Method, (int)((t_numerical_object *)obj2)->value, (int)((t_numerical_object *)obj3)->value, obj4, obj1);
+            ht_add(obj4->methods, get_name(bc, oparg), obj1);
+            object_methods_changed();
+            DISPATCH();
+
+        TARGET(VM_IMPORT)
+            oparg = NEXT_OPERAND();
+            obj2 = STACK_POP();
+            obj1 = STACK_POP();
+            SAVE_IP();
+            vm_import(obj1, obj2, get_name(bc, oparg));
+            DISPATCH();
+
+        TARGET(VM_USE)
+            oparg = NEXT_OPERAND();
+            obj1 = STACK_POP();
+            SAVE_IP();
+            vm_use(obj1, get_name(bc, oparg));
+            DISPATCH();
+
+        TARGET(VM_RETURN_VALUE)
+            ret = STACK_POP();
+            goto vm_return;
+
+        TARGET(VM_THROW)
+            // The reference the stack held now belongs to the pending exception
+            vm_exception = STACK_POP();
+
+            // An exception that no catch block matched is thrown again, it keeps the line it was thrown in
+            if (vm_exception != vm_exception_thrown) {
+                if (vm_exception_thrown) object_dec_ref(vm_exception_thrown);
+                object_inc_ref(vm_exception);
+                vm_exception_thrown = vm_exception;
+                vm_exception_bc = bc;
+                vm_exception_offset = ip - code - 1;
+            }
+            goto vm_unwind;
+
+        TARGET(VM_YIELD_VALUE)
+            ret = STACK_POP();
+            ctx->ip = ip - code;
+            ctx->sp = sp - stack;
+            ctx->suspended = 1;
+
+            if (ctx == entry) {
+                // Resumed by vm_generator_resume(), which suspends the frame
+                return ret;
+            }
+
+            // Resumed by a FOR_ITER in the frame below, which continues with the value on its stack
+            current_context = ctx->prev;
+            frame_depth--;
+            ctx->prev = NULL;
+            ctx = current_context;
+            LOAD_FRAME();
+            STACK_PUSH(ret);
+            DISPATCH();
+
+        TARGET(VM_FOR_ITER)
+            oparg = NEXT_OPERAND();
+            obj1 = STACK_TOP();
+
+            if (OBJECT_IS_GENERATOR(obj1)) {
+                t_generator_object *gen = (t_generator_object *)obj1;
+
+                if (gen->value) {
+                    // A value was fetched already (by valid?)
+                    STACK_PUSH(gen->value);
+                    gen->value = NULL;
+                    DISPATCH();
+                }
+                if (! gen->frame) {
+                    obj1 = STACK_POP();
+                    object_dec_ref(obj1);
+                    JUMP_TO(oparg);
+                    DISPATCH();
+                }
+                if (gen->frame->prev) {
+                    SAVE_IP();
+                    saffire_error("Generator is already running");
+                }
+
+                // Switch to the generator frame without leaving the dispatch loop. When it yields, we continue after
+                // this instruction with the value on the stack. When it finishes, we continue at the target.
+                ctx->ip = ip - code;
+                ctx->sp = sp - stack;
+                gen->frame->prev = ctx;
+                gen->frame->suspended = 0;
+                gen->frame->exit = oparg;
+                current_context = gen->frame;
+                frame_depth++;
+
+                ctx = gen->frame;
+                LOAD_FRAME();
+                if (bc->jit) JIT_ENTER();
+                DISPATCH();
+            }
+
+            // Any other object must implement the iterator protocol: valid?() and next()
+            SAVE_IP();
+            obj2 = object_find_method(obj1, "valid?");
+            obj3 = object_find_method(obj1, "next");
+            if (! obj2 || ! obj3) {
+                saffire_error("Cannot iterate over %s", obj1->name);
+            }
+
+            obj4 = vm_call_object(obj1, obj2, NULL);
+            CHECK_EXCEPTION();
+            obj4 = vm_boolean(obj4);
+            CHECK_EXCEPTION();
+            if (obj4 == Object_True) {
+                obj4 = vm_call_object(obj1, obj3, NULL);
+                CHECK_EXCEPTION();
+                object_inc_ref(obj4);
+                STACK_PUSH(obj4);
+            } else {
+                obj1 = STACK_POP();
+                object_dec_ref(obj1);
+                JUMP_TO(oparg);
+            }
+            DISPATCH();
 
+        default :
+#if VM_COMPUTED_GOTO
+_unknown_opcode:
+#endif
+            printf("opcode %d is not implemented yet\n", opcode);
+            exit(1);
+    }
 
+vm_unwind:
+    /*
+     * An exception is pending, thrown by the instruction that ends right before ip. Find the handler that covers
+     * it, in this frame or in the frames of the generators we resumed inline. Without one, our caller gets NULL
+     * and continues unwinding.
+     */
+    for (;;) {
+        t_bytecode_handler *handler = vm_find_handler(bc, ip - code - 1);
+        int level = handler ? handler->stack_level : 0;
+
+        while (sp > stack + level) {
+            obj1 = STACK_POP();
+            object_dec_ref(obj1);
         }
 
+        if (handler) {
+            STACK_PUSH(vm_exception);
+            vm_exception = NULL;
+            JUMP_TO(handler->handler);
+            DISPATCH();
+        }
+
+        if (ctx == entry) break;
+
+        // The generator ends, the exception continues at the FOR_ITER that resumed it
+        t_vm_context *consumer = ctx->prev;
+        vm_generator_close(ctx->generator);
+        current_context = consumer;
+        frame_depth--;
+
+        ctx = consumer;
+        LOAD_FRAME();
     }
 
-    // @TODO: We should return "something"
-    return 0;
-}
\ No newline at end of file
+    ctx->ip = ip - code;
+    ctx->sp = sp - stack;
+    return NULL;
+
+vm_stop:
+    ret = Object_Null;
+
+vm_return:
+    // Write our locals back into the frame before leaving it
+    ctx->ip = ip - code;
+    ctx->sp = sp - stack;
+
+    if (ctx->generator && ctx != entry) {
+        // A generator that was resumed by FOR_ITER has finished. Its return value is dropped, the frame below pops
+        // the iterator and leaves its loop.
+        t_vm_context *consumer = ctx->prev;
+        int exit = ctx->exit;
+
+        vm_generator_close(ctx->generator);
+        current_context = consumer;
+        frame_depth--;
+
+        ctx = consumer;
+        LOAD_FRAME();
+        obj1 = STACK_POP();
+        object_dec_ref(obj1);
+        JUMP_TO(exit);
+        DISPATCH();
+    }
+
+    return ret;
+}
+
+
+/**
+ * Resumes a generator until it yields its next value. Returns NULL when the generator has finished.
+ */
+t_object *vm_generator_resume(t_generator_object *gen) {
+    t_vm_context *ctx = gen->frame;
+
+    if (! ctx) return NULL;
+    if (ctx->prev) {
+        saffire_error("Generator is already running");
+    }
+
+    ctx->prev = current_context;
+    ctx->suspended = 0;
+    current_context = ctx;
+    frame_depth++;
+
+    t_object *ret = _vm_execute(ctx);
+
+    current_context = ctx->prev;
+    frame_depth--;
+    ctx->prev = NULL;
+
+    if (ctx->suspended) return ret;
+
+    vm_generator_close(gen);
+    return NULL;
+}
+
+
+/**
+ * Releases the frame of a generator. The generator is finished afterwards.
+ */
+void vm_generator_close(t_generator_object *gen) {
+    t_vm_context *ctx = gen->frame;
+    if (! ctx) return;
+
+    for (int i=0; i!=ctx->bc->variables_len; i++) {
+        if (ctx->variables[i] && ctx->variables[i] != VM_UNBOXED) object_dec_ref(ctx->variables[i]);
+    }
+    smm_free(ctx->variables);
+    smm_free(ctx);
+    gen->frame = NULL;
+}
+
+
+/**
+ * Executes bytecode in a new frame and returns the object it returned. Calling bytecode that yields returns a
+ * generator instead, the code runs when values are asked from the generator.
+ */
+t_object *vm_call(t_bytecode *bc, t_object *self, t_dll *args) {
+    t_vm_context ctx;
+
+    if (bc->generator) {
+        t_vm_context *frame = generator_context_new(bc);
+        t_generator_object *gen = (t_generator_object *)object_new(Object_Generator, frame);
+        frame->generator = gen;
+        return (t_object *)gen;
+    }
+
+    if (JIT_IS_HOT(bc, jit_calls, JIT_CALL_THRESHOLD)) {
+        vm_jit_compile(bc);
+    }
+
+    push_context(&ctx, bc);
+    if (vm_profile_sequences) vm_profile_sequences_reset();
+    int previous_opcode = vm_profile_opcodes ? vm_profile_opcodes_enter() : -1;
+    t_object *ret = _vm_execute(&ctx);
+    if (vm_profile_opcodes) vm_profile_opcodes_leave(previous_opcode);
+    if (vm_profile_sequences) vm_profile_sequences_reset();
+    pop_context(&ctx);
+
+    return ret;
+}
+
+
+/**
+ * Returns the source line of the instruction that is executed by the current frame, or 0 when no bytecode is
+ * running (or the line is not known)
+ */
+int vm_lineno(void) {
+    if (! current_context) return 0;
+    return bytecode_lineno(current_context->bc, current_context->ip - 1);
+}
+
+
+/**
+ *
+ */
+int vm_execute(t_bytecode *source_bc) {
+    int ret = 0;
+
+    // Loaded bytecode is verified already, freshly generated bytecode is verified here
+    if (! bytecode_verify(source_bc)) {
+        vm_fatal("Bytecode did not pass verification");
+    }
+
+    t_object *obj = vm_call(source_bc, NULL, NULL);
+    if (vm_exception) {
+        saffire_error("Uncaught exception: %s (thrown in line %d)", vm_exception->name, bytecode_lineno(vm_exception_bc, vm_exception_offset));
+    }
+    if (OBJECT_IS_NUMERICAL(obj)) {
+        ret = ((t_numerical_object *)obj)->value;
+    }
+
+    // All frames are gone, release the value stack
+    if (vm_stack_spare) smm_free(vm_stack_spare);
+    if (vm_stack) smm_free(vm_stack);
+    vm_stack_spare = NULL;
+    vm_stack = NULL;
+
+    return ret;
+}
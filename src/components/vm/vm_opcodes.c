@@ -0,0 +1,475 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include "vm/vm_opcodes.h"
+
+/*
+ * Opcode names, used when reporting on bytecode (profiles, traces and errors)
+ */
+static const char *opcode_names[256] = {
+    [VM_STOP_CODE]          = "STOP_CODE",
+    [VM_PRINT_VAR]          = "PRINT_VAR",
+    [VM_POP_TOP]            = "POP_TOP",
+    [VM_ROT_TWO]            = "ROT_TWO",
+    [VM_ROT_THREE]          = "ROT_THREE",
+    [VM_DUP_TOP]            = "DUP_TOP",
+    [VM_ROT_FOUR]           = "ROT_FOUR",
+    [VM_NOP]                = "NOP",
+    [VM_BINARY_ADD]         = "BINARY_ADD",
+    [VM_BINARY_SUBTRACT]    = "BINARY_SUBTRACT",
+    [VM_BINARY_MULTIPLY]    = "BINARY_MULTIPLY",
+    [VM_BINARY_DIVIDE]      = "BINARY_DIVIDE",
+    [VM_BINARY_MODULO]      = "BINARY_MODULO",
+    [VM_BINARY_AND]         = "BINARY_AND",
+    [VM_BINARY_OR]          = "BINARY_OR",
+    [VM_BINARY_XOR]         = "BINARY_XOR",
+    [VM_BINARY_SHL]         = "BINARY_SHL",
+    [VM_BINARY_SHR]         = "BINARY_SHR",
+    [VM_BINARY_ADD_NUM]     = "BINARY_ADD_NUM",
+    [VM_BINARY_SUBTRACT_NUM]= "BINARY_SUBTRACT_NUM",
+    [VM_BINARY_MULTIPLY_NUM]= "BINARY_MULTIPLY_NUM",
+    [VM_BUILD_CLASS]        = "BUILD_CLASS",
+    [VM_STORE_CLASS]        = "STORE_CLASS",
+    [VM_RETURN_VALUE]       = "RETURN_VALUE",
+    [VM_YIELD_VALUE]        = "YIELD_VALUE",
+    [VM_THROW]              = "THROW",
+    [VM_STORE_VAR]          = "STORE_VAR",
+    [VM_STORE_CONST]        = "STORE_CONST",
+    [VM_STORE_PROPERTY]     = "STORE_PROPERTY",
+    [VM_STORE_METHOD]       = "STORE_METHOD",
+    [VM_LOAD_CONST]         = "LOAD_CONST",
+    [VM_LOAD_VAR]           = "LOAD_VAR",
+    [VM_LOAD_ATTRIB]        = "LOAD_ATTRIB",
+    [VM_LOAD_METHOD]        = "LOAD_METHOD",
+    [VM_COMPARE_OP]         = "COMPARE_OP",
+    [VM_IMPORT]             = "IMPORT",
+    [VM_USE]                = "USE",
+    [VM_COMPARE_OP_NUM]     = "COMPARE_OP_NUM",
+    [VM_JUMP_ABSOLUTE]      = "JUMP_ABSOLUTE",
+    [VM_POP_JUMP_IF_FALSE]  = "POP_JUMP_IF_FALSE",
+    [VM_POP_JUMP_IF_TRUE]   = "POP_JUMP_IF_TRUE",
+    [VM_FOR_ITER]           = "FOR_ITER",
+    [VM_COMPARE_JUMP_IF_FALSE_EQ]   = "COMPARE_JUMP_IF_FALSE_EQ",
+    [VM_COMPARE_JUMP_IF_FALSE_NE]   = "COMPARE_JUMP_IF_FALSE_NE",
+    [VM_COMPARE_JUMP_IF_FALSE_LT]   = "COMPARE_JUMP_IF_FALSE_LT",
+    [VM_COMPARE_JUMP_IF_FALSE_GT]   = "COMPARE_JUMP_IF_FALSE_GT",
+    [VM_COMPARE_JUMP_IF_FALSE_LE]   = "COMPARE_JUMP_IF_FALSE_LE",
+    [VM_COMPARE_JUMP_IF_FALSE_GE]   = "COMPARE_JUMP_IF_FALSE_GE",
+    [VM_COMPARE_JUMP_IF_TRUE_EQ]    = "COMPARE_JUMP_IF_TRUE_EQ",
+    [VM_COMPARE_JUMP_IF_TRUE_NE]    = "COMPARE_JUMP_IF_TRUE_NE",
+    [VM_COMPARE_JUMP_IF_TRUE_LT]    = "COMPARE_JUMP_IF_TRUE_LT",
+    [VM_COMPARE_JUMP_IF_TRUE_GT]    = "COMPARE_JUMP_IF_TRUE_GT",
+    [VM_COMPARE_JUMP_IF_TRUE_LE]    = "COMPARE_JUMP_IF_TRUE_LE",
+    [VM_COMPARE_JUMP_IF_TRUE_GE]    = "COMPARE_JUMP_IF_TRUE_GE",
+    [VM_MATCH_EXCEPTION]    = "MATCH_EXCEPTION",
+    [VM_CALL_METHOD]        = "CALL_METHOD",
+    [VM_TAIL_CALL]          = "TAIL_CALL",
+
+#define SUPERINSTRUCTION_NAME(name, opcode, ...)    [VM_##name] = #name,
+    VM_SUPERINSTRUCTIONS(SUPERINSTRUCTION_NAME)
+    VM_SUPERINSTRUCTIONS_NUM(SUPERINSTRUCTION_NAME)
+
+    [VM_REG_MOVE]           = "REG_MOVE",
+    [VM_REG_ADD]            = "REG_ADD",
+    [VM_REG_SUBTRACT]       = "REG_SUBTRACT",
+    [VM_REG_MULTIPLY]       = "REG_MULTIPLY",
+    [VM_REG_DIVIDE]         = "REG_DIVIDE",
+    [VM_REG_MODULO]         = "REG_MODULO",
+    [VM_REG_AND]            = "REG_AND",
+    [VM_REG_OR]             = "REG_OR",
+    [VM_REG_XOR]            = "REG_XOR",
+    [VM_REG_SHL]            = "REG_SHL",
+    [VM_REG_SHR]            = "REG_SHR",
+    [VM_REG_COMPARE_EQ]     = "REG_COMPARE_EQ",
+    [VM_REG_COMPARE_NE]     = "REG_COMPARE_NE",
+    [VM_REG_COMPARE_LT]     = "REG_COMPARE_LT",
+    [VM_REG_COMPARE_GT]     = "REG_COMPARE_GT",
+    [VM_REG_COMPARE_LE]     = "REG_COMPARE_LE",
+    [VM_REG_COMPARE_GE]     = "REG_COMPARE_GE",
+    [VM_REG_JUMP_IF_FALSE]  = "REG_JUMP_IF_FALSE",
+    [VM_REG_JUMP_IF_TRUE]   = "REG_JUMP_IF_TRUE",
+};
+
+
+/*
+ * Components of the superinstructions
+ */
+#define SUPERINSTRUCTION_COMPONENTS(name, opcode, first, second, third)     { VM_##name, first, second, third },
+static const unsigned char superinstructions[][4] = {
+    VM_SUPERINSTRUCTIONS(SUPERINSTRUCTION_COMPONENTS)
+};
+
+#define SUPERINSTRUCTIONS_LEN   (int)(sizeof(superinstructions) / sizeof(superinstructions[0]))
+
+
+/**
+ * Returns the components of a superinstruction, or NULL when the opcode is no superinstruction
+ */
+static const unsigned char *_superinstruction(int opcode) {
+    // Quickened superinstructions consist of the same components
+    opcode = vm_opcode_generic(opcode);
+
+    if (opcode < VM_SUPERINSTRUCTION_FIRST || opcode > VM_SUPERINSTRUCTION_LAST) return NULL;
+    for (int i=0; i!=SUPERINSTRUCTIONS_LEN; i++) {
+        if (superinstructions[i][0] == opcode) return superinstructions[i] + 1;
+    }
+    return NULL;
+}
+
+
+/**
+ * Returns the number of operands the superinstruction components have
+ */
+static int _superinstruction_operands(const unsigned char *components) {
+    int count = 0;
+    for (int i=0; i!=3 && components[i]; i++) {
+        if (components[i] >= HAVE_ARGUMENT) count++;
+    }
+    return count;
+}
+
+
+/**
+ * Returns the superinstruction that fuses count (2 or 3) opcodes, or 0 when there is none
+ */
+int vm_superinstruction_find(const int *opcodes, int count) {
+    for (int i=0; i!=SUPERINSTRUCTIONS_LEN; i++) {
+        const unsigned char *components = superinstructions[i] + 1;
+        if (components[0] != opcodes[0] || components[1] != opcodes[1]) continue;
+        if (count == 3 ? components[2] != opcodes[2] : components[2] != 0) continue;
+        return superinstructions[i][0];
+    }
+    return 0;
+}
+
+
+/**
+ * Splits a superinstruction into the opcodes and operands of its components. Operands of components without an
+ * operand are 0. Returns the number of components, or 0 when the opcode is no superinstruction.
+ */
+int vm_superinstruction_split(int opcode, int oparg, int *opcodes, int *opargs) {
+    const unsigned char *components = _superinstruction(opcode);
+    if (! components) return 0;
+
+    // A single operand is not packed
+    int packed = (_superinstruction_operands(components) == 2);
+    int field = 0;
+
+    int count;
+    for (count=0; count!=3 && components[count]; count++) {
+        opcodes[count] = components[count];
+        opargs[count] = 0;
+        if (components[count] < HAVE_ARGUMENT) continue;
+
+        if (! packed) {
+            opargs[count] = oparg;
+        } else {
+            opargs[count] = field ? (int)(((unsigned int)oparg >> 16) & 0xFFFF) : (oparg & 0xFFFF);
+        }
+        field++;
+    }
+    return count;
+}
+
+
+/**
+ * Returns the name of an opcode, or NULL when the opcode does not exist
+ */
+const char *vm_opcode_name(int opcode) {
+    if (opcode < 0 || opcode > 255) return NULL;
+    return opcode_names[opcode];
+}
+
+
+/**
+ * Returns the number of operands the opcode is encoded with
+ */
+int vm_opcode_operands(int opcode) {
+    if (opcode < HAVE_ARGUMENT) return 0;
+
+    // Superinstructions have the operands of their components
+    const unsigned char *components = _superinstruction(opcode);
+    if (components) return _superinstruction_operands(components);
+
+    if (opcode == VM_REG_JUMP_IF_FALSE || opcode == VM_REG_JUMP_IF_TRUE) return 2;
+    if (opcode >= VM_REG_MOVE && opcode <= VM_REG_SHR) return 3;
+    if (opcode >= VM_REG_COMPARE_EQ && opcode <= VM_REG_COMPARE_GE) return 3;
+    return 1;
+}
+
+
+/**
+ * Returns 1 when the opcode is a jump. The first operand of a jump is its target.
+ */
+int vm_opcode_is_jump(int opcode) {
+    return (opcode == VM_JUMP_ABSOLUTE || opcode == VM_POP_JUMP_IF_FALSE || opcode == VM_POP_JUMP_IF_TRUE ||
+            opcode == VM_FOR_ITER || opcode == VM_REG_JUMP_IF_FALSE || opcode == VM_REG_JUMP_IF_TRUE ||
+            opcode == VM_MATCH_EXCEPTION ||
+            (opcode >= VM_COMPARE_JUMP_IF_FALSE_EQ && opcode <= VM_COMPARE_JUMP_IF_TRUE_GE));
+}
+
+
+/**
+ * Encodes a single operand into buf. The operand is padded to width bytes (when it is shorter). Returns the
+ * number of bytes written.
+ */
+int vm_encode_operand(unsigned char *buf, unsigned int value, int width) {
+    int len = 0;
+
+    do {
+        buf[len] = value & 0x7F;
+        value >>= 7;
+        len++;
+        if (value || len < width) buf[len - 1] |= 0x80;
+    } while (value || len < width);
+
+    return len;
+}
+
+
+/**
+ * Encodes an instruction into buf, which must hold INSTRUCTION_MAX_SIZE bytes. The target of a jump is padded
+ * to target_width bytes. Returns the length of the instruction.
+ */
+int vm_encode_instruction(unsigned char *buf, int opcode, int oparg, int target_width) {
+    unsigned int fields[3];
+    int count = vm_opcode_operands(opcode);
+    int len = 0;
+
+    buf[len++] = opcode;
+
+    if (opcode == VM_REG_JUMP_IF_FALSE || opcode == VM_REG_JUMP_IF_TRUE) {
+        fields[0] = REG_JUMP_TARGET(oparg);
+        fields[1] = REG_JUMP_REG(oparg);
+    } else if (count == 2) {
+        fields[0] = (unsigned int)oparg & 0xFFFF;
+        fields[1] = ((unsigned int)oparg >> 16) & 0xFFFF;
+    } else if (count == 3) {
+        fields[0] = REG_DST(oparg);
+        fields[1] = REG_SRC1(oparg);
+        fields[2] = REG_SRC2(oparg);
+    } else {
+        fields[0] = (unsigned int)oparg;
+    }
+
+    for (int i=0; i!=count; i++) {
+        int width = (i == 0 && vm_opcode_is_jump(opcode)) ? target_width : 0;
+        len += vm_encode_operand(buf + len, fields[i], width);
+    }
+
+    return len;
+}
+
+
+/**
+ * Decodes the instruction at offset pos into its opcode and (packed) operand. Returns the offset of the next
+ * instruction, or -1 when the instruction runs past len.
+ */
+int vm_decode_instruction(const unsigned char *code, int len, int pos, int *opcode, int *oparg) {
+    unsigned int fields[3] = { 0, 0, 0 };
+
+    if (pos < 0 || pos >= len) return -1;
+    *opcode = code[pos++];
+
+    int count = vm_opcode_operands(*opcode);
+    for (int i=0; i!=count; i++) {
+        // Make sure the complete operand is inside the code before reading it
+        int n = 0;
+        while (pos + n < len && (code[pos + n] & 0x80) && n < OPERAND_MAX_SIZE - 1) n++;
+        if (pos + n >= len) return -1;
+
+        const unsigned char *p = code + pos;
+        fields[i] = vm_read_operand(&p);
+        pos = p - code;
+    }
+
+    if (*opcode == VM_REG_JUMP_IF_FALSE || *opcode == VM_REG_JUMP_IF_TRUE) {
+        *oparg = REG_JUMP_PACK(fields[1], fields[0]);
+    } else if (count == 2) {
+        *oparg = (int)(fields[0] | (fields[1] << 16));
+    } else if (count == 3) {
+        *oparg = REG_PACK(fields[0], fields[1], fields[2]);
+    } else {
+        *oparg = (int)fields[0];
+    }
+
+    return pos;
+}
+
+
+/**
+ * Returns the number of items the opcode adds to (or removes from) the stack. Needed is set to the number of
+ * items that must be on the stack before the opcode runs, peak to the highest stack level it reaches while
+ * running, relative to the level it started with. For jumps, this is the effect when the jump is not taken.
+ */
+int vm_opcode_stack_effect(int opcode, int oparg, int *needed, int *peak) {
+    *needed = 0;
+    *peak = 0;
+
+    // Quickened opcodes behave like their generic opcode
+    opcode = vm_opcode_generic(opcode);
+
+    // Superinstructions add up the effects of their components
+    int opcodes[3], opargs[3];
+    int count = vm_superinstruction_split(opcode, oparg, opcodes, opargs);
+    if (count) {
+        int level = 0;
+        for (int i=0; i!=count; i++) {
+            int component_needed, component_peak;
+            int effect = vm_opcode_stack_effect(opcodes[i], opargs[i], &component_needed, &component_peak);
+            if (component_needed - level > *needed) *needed = component_needed - level;
+            if (level + component_peak > *peak) *peak = level + component_peak;
+            level += effect;
+        }
+        return level;
+    }
+
+    if (opcode >= VM_BINARY_ADD && opcode <= VM_BINARY_SHR) {
+        *needed = 2;
+        return -1;
+    }
+
+    if (opcode >= VM_COMPARE_JUMP_IF_FALSE_EQ && opcode <= VM_COMPARE_JUMP_IF_TRUE_GE) {
+        *needed = 2;
+        return -2;
+    }
+
+    switch (opcode) {
+        case VM_POP_TOP :
+        case VM_PRINT_VAR :
+        case VM_STORE_CLASS :
+        case VM_RETURN_VALUE :
+        case VM_YIELD_VALUE :
+        case VM_THROW :
+        case VM_STORE_VAR :
+        case VM_USE :
+        case VM_POP_JUMP_IF_FALSE :
+        case VM_POP_JUMP_IF_TRUE :
+            *needed = 1;
+            return -1;
+
+        case VM_ROT_TWO :
+            *needed = 2;
+            return 0;
+        case VM_ROT_THREE :
+            *needed = 3;
+            return 0;
+        case VM_ROT_FOUR :
+            *needed = 4;
+            return 0;
+
+        case VM_BUILD_CLASS :
+        case VM_LOAD_ATTRIB :
+            *needed = 1;
+            return 0;
+
+        case VM_DUP_TOP :
+        case VM_LOAD_METHOD :
+        case VM_FOR_ITER :
+            *needed = 1;
+            *peak = 1;
+            return 1;
+
+        case VM_LOAD_CONST :
+        case VM_LOAD_VAR :
+            *peak = 1;
+            return 1;
+
+        case VM_COMPARE_OP :
+        case VM_MATCH_EXCEPTION :
+        case VM_STORE_CONST :
+        case VM_STORE_PROPERTY :
+            *needed = 2;
+            return -1;
+
+        case VM_IMPORT :
+            *needed = 2;
+            return -2;
+
+        case VM_STORE_METHOD :
+            *needed = 4;
+            return -3;
+
+        // The method and its object are popped with the arguments, the result is pushed
+        case VM_CALL_METHOD :
+        case VM_TAIL_CALL :
+            *needed = oparg + 2;
+            return -(oparg + 1);
+    }
+
+    // Jumps, register instructions and the like do not touch the stack
+    return 0;
+}
+
+
+
+/**
+ * Returns the number of items the jump adds to (or removes from) the stack when the jump is taken
+ */
+int vm_opcode_jump_stack_effect(int opcode, int oparg) {
+    int needed, peak;
+
+    // An iterator that is done is popped
+    if (opcode == VM_FOR_ITER) return -1;
+
+    return vm_opcode_stack_effect(opcode, oparg, &needed, &peak);
+}
+
+
+/*
+ * Generic opcodes that can be quickened, and their quickened form
+ */
+static const unsigned char quickened_opcodes[][2] = {
+    { VM_BINARY_ADD,                VM_BINARY_ADD_NUM },
+    { VM_BINARY_SUBTRACT,           VM_BINARY_SUBTRACT_NUM },
+    { VM_BINARY_MULTIPLY,           VM_BINARY_MULTIPLY_NUM },
+    { VM_COMPARE_OP,                VM_COMPARE_OP_NUM },
+#define SUPERINSTRUCTION_QUICKENED(name, opcode, generic, ...)  { VM_##generic, VM_##name },
+    VM_SUPERINSTRUCTIONS_NUM(SUPERINSTRUCTION_QUICKENED)
+};
+
+
+/**
+ * Returns the quickened form of a generic opcode, or the opcode itself when it cannot be quickened
+ */
+int vm_opcode_quickened(int opcode) {
+    for (int i=0; i!=sizeof(quickened_opcodes) / sizeof(quickened_opcodes[0]); i++) {
+        if (quickened_opcodes[i][0] == opcode) return quickened_opcodes[i][1];
+    }
+    return opcode;
+}
+
+
+/**
+ * Returns the generic opcode of a quickened opcode, or the opcode itself when it is not quickened
+ */
+int vm_opcode_generic(int opcode) {
+    for (int i=0; i!=sizeof(quickened_opcodes) / sizeof(quickened_opcodes[0]); i++) {
+        if (quickened_opcodes[i][1] == opcode) return quickened_opcodes[i][0];
+    }
+    return opcode;
+}
\ No newline at end of file
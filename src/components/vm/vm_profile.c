@@ -0,0 +1,389 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm/vm_profile.h"
+#include "vm/vm_opcodes.h"
+#include "general/smm.h"
+
+/*
+ * The sequence profiler counts how often opcode pairs and triples are executed after each other. These are
+ * the candidates for superinstructions. Counts are merged into a profile file, so running a corpus of scripts
+ * one by one builds up a single profile.
+ */
+
+// Number of slots in the triple table (must be a power of two)
+#define TRIPLE_SLOTS    8192
+
+typedef struct _profile_triple {
+    unsigned int key;           // op1 << 16 | op2 << 8 | op3, or 0 when the slot is empty
+    unsigned long count;        // Number of executions
+} t_profile_triple;
+
+typedef struct _profile_sequence {
+    int len;                    // Number of opcodes in the sequence (2 or 3)
+    int ops[3];                 // Opcodes
+    unsigned long count;        // Number of executions
+} t_profile_sequence;
+
+int vm_profile_sequences = 0;
+
+static unsigned long *pairs = NULL;            // Pair counts, indexed by op1 << 8 | op2
+static t_profile_triple *triples = NULL;       // Open addressed triple counts
+static int history[2] = { -1, -1 };            // Previously executed opcodes
+
+
+/**
+ * Enables recording of opcode sequences
+ */
+void vm_profile_sequences_start(void) {
+    if (! pairs) {
+        pairs = smm_malloc(256 * 256 * sizeof(unsigned long));
+        memset(pairs, 0, 256 * 256 * sizeof(unsigned long));
+        triples = smm_malloc(TRIPLE_SLOTS * sizeof(t_profile_triple));
+        memset(triples, 0, TRIPLE_SLOTS * sizeof(t_profile_triple));
+    }
+
+    vm_profile_sequences_reset();
+    vm_profile_sequences = 1;
+}
+
+
+/**
+ * Forgets the previously executed opcodes, so no sequence is recorded over a frame boundary
+ */
+void vm_profile_sequences_reset(void) {
+    history[0] = history[1] = -1;
+}
+
+
+/**
+ * Adds a number of executions to a triple
+ */
+static void _add_triple(int op1, int op2, int op3, unsigned long count) {
+    // STOP_CODE never continues, so the triple 00,00,00 cannot happen and a key of 0 can mark an empty slot
+    unsigned int key = (op1 << 16) | (op2 << 8) | op3;
+    if (key == 0) return;
+
+    unsigned int slot = (key * 2654435761u) & (TRIPLE_SLOTS - 1);
+    for (int i=0; i!=TRIPLE_SLOTS; i++) {
+        t_profile_triple *t = &triples[(slot + i) & (TRIPLE_SLOTS - 1)];
+        if (t->key == key || t->key == 0) {
+            t->key = key;
+            t->count += count;
+            return;
+        }
+    }
+    // Table is full, the triple is dropped
+}
+
+
+/**
+ * Records the execution of an opcode
+ */
+void vm_profile_sequences_record(int opcode) {
+    if (history[1] != -1) {
+        pairs[(history[1] << 8) | opcode]++;
+        if (history[0] != -1) {
+            _add_triple(history[0], history[1], opcode, 1);
+        }
+    }
+
+    history[0] = history[1];
+    history[1] = opcode;
+}
+
+
+/**
+ * Reads an existing profile file and adds its counts to ours
+ */
+static void _merge_file(const char *filename) {
+    char line[256];
+    unsigned long count;
+    int op1, op2, op3;
+
+    FILE *f = fopen(filename, "r");
+    if (! f) return;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+
+        int n = sscanf(line, "%lu %x,%x,%x", &count, &op1, &op2, &op3);
+        if (n < 3 || op1 < 0 || op1 > 255 || op2 < 0 || op2 > 255) continue;
+
+        if (n == 3) {
+            pairs[(op1 << 8) | op2] += count;
+        } else if (op3 >= 0 && op3 <= 255) {
+            _add_triple(op1, op2, op3, count);
+        }
+    }
+
+    fclose(f);
+}
+
+
+/**
+ * Sorts sequences on descending count
+ */
+static int _compare_sequences(const void *a, const void *b) {
+    const t_profile_sequence *sa = a, *sb = b;
+    if (sa->count == sb->count) return 0;
+    return (sa->count < sb->count) ? 1 : -1;
+}
+
+
+/**
+ * Merges the recorded sequences into the profile file, most frequent sequences first. Returns 1 on success.
+ */
+int vm_profile_sequences_save(const char *filename) {
+    if (! pairs) return 0;
+
+    _merge_file(filename);
+
+    // Collect all sequences that have been seen
+    t_profile_sequence *seqs = smm_malloc((256 * 256 + TRIPLE_SLOTS) * sizeof(t_profile_sequence));
+    int seqs_len = 0;
+    for (int i=0; i!=256 * 256; i++) {
+        if (! pairs[i]) continue;
+        t_profile_sequence *s = &seqs[seqs_len++];
+        s->len = 2;
+        s->ops[0] = i >> 8;
+        s->ops[1] = i & 0xFF;
+        s->count = pairs[i];
+    }
+    for (int i=0; i!=TRIPLE_SLOTS; i++) {
+        if (! triples[i].key) continue;
+        t_profile_sequence *s = &seqs[seqs_len++];
+        s->len = 3;
+        s->ops[0] = (triples[i].key >> 16) & 0xFF;
+        s->ops[1] = (triples[i].key >> 8) & 0xFF;
+        s->ops[2] = triples[i].key & 0xFF;
+        s->count = triples[i].count;
+    }
+    qsort(seqs, seqs_len, sizeof(t_profile_sequence), _compare_sequences);
+
+    FILE *f = fopen(filename, "w");
+    if (! f) {
+        smm_free(seqs);
+        return 0;
+    }
+
+    fprintf(f, "# Saffire opcode sequence profile: count opcodes # names\n");
+    for (int i=0; i!=seqs_len; i++) {
+        t_profile_sequence *s = &seqs[i];
+
+        fprintf(f, "%lu ", s->count);
+        for (int j=0; j!=s->len; j++) {
+            fprintf(f, j ? ",%02X" : "%02X", s->ops[j]);
+        }
+        fprintf(f, " #");
+        for (int j=0; j!=s->len; j++) {
+            const char *name = vm_opcode_name(s->ops[j]);
+            fprintf(f, " %s", name ? name : "?");
+        }
+        fprintf(f, "\n");
+    }
+
+    smm_free(seqs);
+    return (fclose(f) == 0);
+}
+
+
+/*
+ * The opcode profiler counts how often every opcode is executed, how much time is spent in it and which
+ * opcode was executed right before it. The time of an opcode runs from its dispatch until the dispatch of
+ * the next opcode, so time spent in called frames is counted on the opcodes of those frames.
+ */
+
+typedef struct _profile_opcode {
+    int opcode;                 // Opcode
+    unsigned long count;        // Number of executions
+    uint64_t time;              // Total time spent in the opcode
+    int pred;                   // Most frequent predecessor (or -1)
+    unsigned long pred_count;   // Number of times the predecessor was seen
+} t_profile_opcode;
+
+int vm_profile_opcodes = 0;
+
+static unsigned long opcode_counts[256];
+static uint64_t opcode_time[256];
+static unsigned long *opcode_preds = NULL;     // Predecessor counts, indexed by previous << 8 | opcode
+static int timed_opcode = -1;                  // Opcode that is currently timed
+static int previous_opcode = -1;               // Previously executed opcode in the current frame
+static uint64_t timed_since = 0;
+
+
+/**
+ * Enables the opcode profiler
+ */
+void vm_profile_opcodes_start(void) {
+    if (! opcode_preds) {
+        opcode_preds = smm_malloc(256 * 256 * sizeof(unsigned long));
+    }
+    memset(opcode_preds, 0, 256 * 256 * sizeof(unsigned long));
+    memset(opcode_counts, 0, sizeof(opcode_counts));
+    memset(opcode_time, 0, sizeof(opcode_time));
+
+    timed_opcode = previous_opcode = -1;
+    vm_profile_opcodes = 1;
+}
+
+
+/**
+ * Records the dispatch of an opcode
+ */
+void vm_profile_opcodes_record(int opcode) {
+    uint64_t now = vm_timestamp();
+
+    if (timed_opcode != -1) {
+        opcode_time[timed_opcode] += now - timed_since;
+    }
+    if (previous_opcode != -1) {
+        opcode_preds[(previous_opcode << 8) | opcode]++;
+    }
+    opcode_counts[opcode]++;
+
+    timed_opcode = previous_opcode = opcode;
+    timed_since = now;
+}
+
+
+/**
+ * A new frame is entered. Returns the predecessor state of the calling frame, which must be passed to
+ * vm_profile_opcodes_leave() when the frame is left, so predecessors never cross a frame boundary.
+ */
+int vm_profile_opcodes_enter(void) {
+    int previous = previous_opcode;
+    previous_opcode = -1;
+    return previous;
+}
+
+void vm_profile_opcodes_leave(int previous) {
+    previous_opcode = previous;
+}
+
+
+/**
+ * Sorts opcodes on descending time
+ */
+static int _compare_opcodes(const void *a, const void *b) {
+    const t_profile_opcode *oa = a, *ob = b;
+    if (oa->time == ob->time) return 0;
+    return (oa->time < ob->time) ? 1 : -1;
+}
+
+
+/**
+ * Returns the statistics of all executed opcodes, most expensive first
+ */
+static int _collect_opcodes(t_profile_opcode *ops) {
+    int len = 0;
+
+    for (int op=0; op!=256; op++) {
+        if (! opcode_counts[op]) continue;
+
+        t_profile_opcode *o = &ops[len++];
+        o->opcode = op;
+        o->count = opcode_counts[op];
+        o->time = opcode_time[op];
+        o->pred = -1;
+        o->pred_count = 0;
+        for (int prev=0; prev!=256; prev++) {
+            if (opcode_preds[(prev << 8) | op] > o->pred_count) {
+                o->pred = prev;
+                o->pred_count = opcode_preds[(prev << 8) | op];
+            }
+        }
+    }
+
+    qsort(ops, len, sizeof(t_profile_opcode), _compare_opcodes);
+    return len;
+}
+
+
+/**
+ * Prints the opcode profile as a table
+ */
+void vm_profile_opcodes_report(FILE *f) {
+    t_profile_opcode ops[256];
+    uint64_t total = 0;
+
+    if (! opcode_preds) return;
+
+    int len = _collect_opcodes(ops);
+    for (int i=0; i!=len; i++) total += ops[i].time;
+
+    fprintf(f, "%-26s %12s %16s %6s %10s  %s\n", "opcode", "count", VM_TIMESTAMP_UNIT, "%", VM_TIMESTAMP_UNIT "/op", "most frequent predecessor");
+    for (int i=0; i!=len; i++) {
+        t_profile_opcode *o = &ops[i];
+        const char *name = vm_opcode_name(o->opcode);
+
+        fprintf(f, "%02X %-23s %12lu %16llu %6.2f %10.1f  ", o->opcode, name ? name : "?", o->count,
+                (unsigned long long)o->time, total ? 100.0 * o->time / total : 0.0, (double)o->time / o->count);
+        if (o->pred == -1) {
+            fprintf(f, "-\n");
+        } else {
+            name = vm_opcode_name(o->pred);
+            fprintf(f, "%02X %s (%.1f%%)\n", o->pred, name ? name : "?", 100.0 * o->pred_count / o->count);
+        }
+    }
+}
+
+
+/**
+ * Writes the opcode profile as JSON. Returns 1 on success.
+ */
+int vm_profile_opcodes_save_json(const char *filename) {
+    t_profile_opcode ops[256];
+
+    if (! opcode_preds) return 0;
+
+    FILE *f = fopen(filename, "w");
+    if (! f) return 0;
+
+    int len = _collect_opcodes(ops);
+    fprintf(f, "{\n    \"unit\": \"%s\",\n    \"opcodes\": [\n", VM_TIMESTAMP_UNIT);
+    for (int i=0; i!=len; i++) {
+        t_profile_opcode *o = &ops[i];
+        const char *name = vm_opcode_name(o->opcode);
+
+        fprintf(f, "        { \"opcode\": %d, \"name\": \"%s\", \"count\": %lu, \"time\": %llu, ",
+                o->opcode, name ? name : "?", o->count, (unsigned long long)o->time);
+        if (o->pred == -1) {
+            fprintf(f, "\"predecessor\": null }");
+        } else {
+            name = vm_opcode_name(o->pred);
+            fprintf(f, "\"predecessor\": { \"opcode\": %d, \"name\": \"%s\", \"count\": %lu } }",
+                    o->pred, name ? name : "?", o->pred_count);
+        }
+        fprintf(f, (i + 1 < len) ? ",\n" : "\n");
+    }
+    fprintf(f, "    ]\n}\n");
+
+    return (fclose(f) == 0);
+}
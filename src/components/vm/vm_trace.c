@@ -0,0 +1,180 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "vm/vm_trace.h"
+#include "vm/vm_profile.h"
+#include "vm/vm_opcodes.h"
+#include "general/smm.h"
+
+/*
+ * The tracer writes a small binary record for every dispatched opcode into a ring buffer, so the last
+ * VM_TRACE_RECORDS opcodes are always known. Nothing is written to disk until the buffer is dumped, which
+ * happens on errors, on crashes and on SIGUSR1. Dumps are read back with "saffire trace <file>".
+ */
+
+typedef struct _vm_trace_buffer {
+    uint64_t total;                                 // Number of records written
+    t_vm_trace_record records[VM_TRACE_RECORDS];
+} t_vm_trace_buffer;
+
+int vm_trace_enabled = 0;
+
+static __thread t_vm_trace_buffer *trace = NULL;    // Ring buffer of the current thread
+static char dump_file[1024];                        // Dumps are written here
+
+
+/**
+ * Writes the buffer and re-raises fatal signals, so the process still dies like it would have
+ */
+static void _signal_handler(int sig) {
+    vm_trace_dump();
+
+    if (sig != SIGUSR1) {
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+}
+
+
+/**
+ * Enables tracing. Dumps will be written to dump_file.
+ */
+void vm_trace_start(const char *filename) {
+    strncpy(dump_file, filename, sizeof(dump_file) - 1);
+    dump_file[sizeof(dump_file) - 1] = '\0';
+
+    signal(SIGUSR1, _signal_handler);
+    signal(SIGSEGV, _signal_handler);
+    signal(SIGBUS, _signal_handler);
+    signal(SIGABRT, _signal_handler);
+    signal(SIGFPE, _signal_handler);
+
+    vm_trace_enabled = 1;
+}
+
+
+/**
+ * Adds a record for a dispatched opcode
+ */
+void vm_trace_record(int ip, int opcode, int sp, int depth) {
+    if (! trace) {
+        trace = smm_malloc(sizeof(t_vm_trace_buffer));
+        trace->total = 0;
+    }
+
+    t_vm_trace_record *r = &trace->records[trace->total & (VM_TRACE_RECORDS - 1)];
+    r->timestamp = vm_timestamp();
+    r->ip = ip;
+    r->sp = sp > 0xFFFF ? 0xFFFF : sp;
+    r->opcode = opcode;
+    r->depth = depth > 0xFF ? 0xFF : depth;
+    trace->total++;
+}
+
+
+/**
+ * Writes the ring buffer of the current thread to the dump file, oldest record first. This only uses
+ * async-signal-safe calls, as it runs from signal handlers.
+ */
+void vm_trace_dump(void) {
+    t_vm_trace_header header;
+
+    if (! vm_trace_enabled || ! trace) return;
+
+    int fd = open(dump_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return;
+
+    uint64_t total = trace->total;
+    uint32_t count = total < VM_TRACE_RECORDS ? (uint32_t)total : VM_TRACE_RECORDS;
+    uint32_t first = (uint32_t)((total - count) & (VM_TRACE_RECORDS - 1));
+
+    header.magic = VM_TRACE_MAGIC;
+    header.version = VM_TRACE_VERSION;
+    header.record_size = sizeof(t_vm_trace_record);
+    header.count = count;
+    header.pid = (uint32_t)getpid();
+#if defined(__x86_64__) || defined(__i386__)
+    header.unit = VM_TRACE_UNIT_CYCLES;
+#else
+    header.unit = VM_TRACE_UNIT_NS;
+#endif
+    header.total = total;
+
+    // The oldest records are found from "first" up to the end of the buffer, then it wraps around
+    uint32_t tail = (first + count > VM_TRACE_RECORDS) ? VM_TRACE_RECORDS - first : count;
+    if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+        write(fd, &trace->records[first], tail * sizeof(t_vm_trace_record)) != (ssize_t)(tail * sizeof(t_vm_trace_record)) ||
+        write(fd, &trace->records[0], (count - tail) * sizeof(t_vm_trace_record)) != (ssize_t)((count - tail) * sizeof(t_vm_trace_record))) {
+        // Nothing we can do about it here
+    }
+    close(fd);
+}
+
+
+/**
+ * Prints a dump file in readable form. Returns 1 on success.
+ */
+int vm_trace_decode(const char *filename, FILE *out) {
+    t_vm_trace_header header;
+    t_vm_trace_record r;
+
+    FILE *f = fopen(filename, "rb");
+    if (! f) return 0;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != VM_TRACE_MAGIC ||
+        header.version != VM_TRACE_VERSION || header.record_size != sizeof(t_vm_trace_record)) {
+        fclose(f);
+        return 0;
+    }
+
+    const char *unit = (header.unit == VM_TRACE_UNIT_NS) ? "ns" : "cycles";
+    fprintf(out, "# Trace of process %u: last %u of %llu records, times in %s since the first record\n",
+            header.pid, header.count, (unsigned long long)header.total, unit);
+    fprintf(out, "# %12s %16s %5s %8s %5s  %s\n", "record", "time", "depth", "ip", "sp", "opcode");
+
+    uint64_t start = 0;
+    uint64_t seq = header.total - header.count;
+    for (uint32_t i=0; i!=header.count; i++, seq++) {
+        if (fread(&r, sizeof(r), 1, f) != 1) {
+            fprintf(out, "# Dump is truncated\n");
+            break;
+        }
+        if (i == 0) start = r.timestamp;
+
+        const char *name = vm_opcode_name(r.opcode);
+        fprintf(out, "  %12llu %16llu %5u %08X %5u  %02X %s\n", (unsigned long long)seq,
+                (unsigned long long)(r.timestamp - start), r.depth, r.ip, r.sp, r.opcode, name ? name : "?");
+    }
+
+    fclose(f);
+    return 1;
+}
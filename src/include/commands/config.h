@@ -27,6 +27,7 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+    int config_available(void);
     char *config_get_string(const char *key);
     char config_get_bool(const char *key);
     long config_get_long(const char *key);
@@ -33,16 +33,24 @@
     // different kind of nodes we manage
     typedef enum { typeAstString, typeAstNumerical, typeAstNull, typeAstIdentifier, typeAstOpr, typeAstClass, typeAstInterface, typeAstMethod } nodeEnum;
 
+    struct _object;
+    struct _ns_context;
+
     typedef struct {
         char *value;                // Pointer to the actual constant string
+        struct _object *object;     // Immortal string object for this constant, or NULL (used for interpreting)
     } stringNode;
 
     typedef struct {
         int value;                  // Integer constant
+        struct _object *object;     // Immortal numerical object for this constant, or NULL (used for interpreting)
     } numericalNode;
 
     typedef struct {
         char *name;                 // Name of the actual variable to use
+        struct _ns_context *context;    // Context the variable is bound to, or NULL when unbound (used for interpreting)
+        int slot;                   // Slot of the variable inside the bound context
+        struct _object *object;     // Built-in constant (True, False or Null) this name resolves to, or NULL (used for interpreting)
     } identifierNode;
 
     typedef struct {
@@ -77,6 +85,7 @@
         nodeEnum type;              // Type of the node
         int flags;                  // Current flag (used for interpreting)
         int lineno;                 // Current line number for this AST element
+        void *cache;                // Inline cache for method and operator lookups (used for interpreting)
         union {
             numericalNode numerical;    // constant int
             stringNode string;          // constant string
@@ -30,24 +30,90 @@
     #include <stdint.h>
     #include "compiler/ast.h"
     #include "general/dll.h"
+    #include "vm/vm_superinstructions.h"
 
     #define PACKED  __attribute__((packed))
 
-    #define MAGIC_HEADER 0x43424653     // big-endian SFBC (saffire bytecode)
+    #define MAGIC_HEADER 0x43424653     // "SFBC" (saffire bytecode) when stored little-endian
 
     #define BYTECODE_CONST_STRING        0
     #define BYTECODE_CONST_NUMERICAL     1
     #define BYTECODE_CONST_CODE          2
+    #define BYTECODE_CONST_NULL          3
+    #define BYTECODE_CONST_BOOLEAN       4
 
+    // Flags for bytecode_generate() and bytecode_optimize()
+    #define BYTECODE_REGISTERS           1      // Generate register instructions where possible
+    #define BYTECODE_UNBOX               2      // Let the optimizer turn arithmetic and compares on variables into
+                                                // register instructions, which keep numericals unboxed
+    #define BYTECODE_DEFAULT_FLAGS       BYTECODE_UNBOX
 
+
+    #define BYTECODE_FORMAT     4      // Version of the on-disk bytecode format
+
+    // Superinstructions are generated, so the set the code was optimized with is part of the version
+    #define BYTECODE_VERSION    (BYTECODE_FORMAT | (VM_SUPERINSTRUCTIONS_ID << 16))
+
+    /*
+     * On-disk (.sfc) layout. Every offset is relative to the start of the file, so the file can be mapped
+     * anywhere in memory and used in place. Strings are stored with a terminating \0. All fields are stored in
+     * host byte order, so a .sfc file only runs on machines with the same byte order as the one that wrote it.
+     *
+     *   header | code object (main) | code | exception table | constant table | variable table | strings |
+     *   nested code objects...
+     */
     typedef struct _bytecode_binary_header {
-        uint32_t   magic;               // magic number 0x53464243 (SFBC)
+        uint32_t   magic;               // Magic number (MAGIC_HEADER)
+        uint32_t   version;             // Bytecode format version (BYTECODE_VERSION)
         uint32_t   timestamp;           // Modified timestamp for source file
-        uint32_t   crc;                 // Simple CRC check on the file
+        uint32_t   crc;                 // CRC32 of the source file
+        uint32_t   length;              // Total length of the file
+        uint32_t   code_offset;         // Offset of the main code object
     } PACKED t_bytecode_binary_header;
 
+    // Version of the source file that bytecode is compiled from
+    typedef struct _bytecode_source_stamp {
+        uint32_t   timestamp;           // Modified timestamp for source file
+        uint32_t   crc;                 // CRC32 of the source file
+    } t_bytecode_source_stamp;
+
+    typedef struct _bytecode_binary_code {
+        uint32_t   stack_size;          // Maximum stack size for this code
+        uint32_t   code_len;            // Length of the opcodes
+        uint32_t   code_offset;         // Offset of the opcodes
+        uint32_t   constants_len;       // Number of constants
+        uint32_t   constants_offset;    // Offset of the constant table
+        uint32_t   variables_len;       // Number of variables
+        uint32_t   variables_offset;    // Offset of the variable table
+        uint32_t   handlers_len;        // Number of exception handlers
+        uint32_t   handlers_offset;     // Offset of the exception table
+        uint32_t   lines_len;           // Length of the line table
+        uint32_t   lines_offset;        // Offset of the line table
+    } PACKED t_bytecode_binary_code;
+
+    typedef struct _bytecode_binary_handler {
+        uint32_t   start;               // First code offset covered by the handler
+        uint32_t   end;                 // Code offset after the covered range
+        uint32_t   handler;             // Code offset of the handler
+        uint32_t   stack_level;         // Stack level the handler starts at (below the exception)
+    } PACKED t_bytecode_binary_handler;
+
+    typedef struct _bytecode_binary_constant {
+        uint32_t   type;                // Type of the constant
+        uint32_t   len;                 // Length of data
+        int64_t    value;               // Numerical value, or offset of the string or code object
+    } PACKED t_bytecode_binary_constant;
+
+    typedef struct _bytecode_binary_variable {
+        uint32_t   len;                 // Length of the name
+        uint32_t   offset;              // Offset of the name
+    } PACKED t_bytecode_binary_variable;
+
 
     struct _bytecode;
+    struct _object;
+    struct _inline_cache;
+    struct _jit_code;
     typedef struct _bytecode_constant_header {
         char type;          // Type of the constant
         int  len;           // Length of data
@@ -58,6 +124,8 @@
             struct _bytecode *code;
             void *ptr;
         } data;
+
+        struct _object *object;     // Object for this constant, created by the VM on first use (or NULL)
     } t_bytecode_constant;
 
 
@@ -67,8 +135,24 @@
     } t_bytecode_variable;
 
 
+    /*
+     * Exception table entry. An exception thrown by an instruction inside [start, end) continues at the handler,
+     * with the stack cut back to stack_level and the exception pushed on top of it. Entering a try block costs
+     * nothing, the table is only searched when something is thrown. Entries of inner try blocks come before the
+     * entries of the blocks around them, so the first entry that covers an instruction is the one to use.
+     */
+    typedef struct _bytecode_handler {
+        int start;
+        int end;
+        int handler;
+        int stack_level;
+    } t_bytecode_handler;
+
+
     typedef struct _bytecode {
         int stack_size;         // Maximum stack size for this bytecode
+        int verified;           // 1 when the bytecode (and all code inside it) passed bytecode_verify()
+        int generator;          // 1 when the code yields, set by bytecode_verify()
 
         int code_len;
         char *code;
@@ -78,12 +162,47 @@
 
         int variables_len;
         t_bytecode_variable **variables;
+
+        int handlers_len;
+        t_bytecode_handler *handlers;   // Exception table
+
+        int lines_len;
+        unsigned char *lines;   // Line table (see bytecode_set_lines)
+
+        char *map;              // Memory mapped file this bytecode points into (or NULL)
+        long map_len;           // Length of the mapping (only set on the main bytecode)
+
+        struct _inline_cache **caches;  // Inline caches of the call sites, indexed by code offset (or NULL)
+
+        struct _jit_code *jit;  // Native code for this bytecode (or NULL)
+        int jit_calls;          // Number of invocations, until compiled
+        int jit_backedges;      // Number of backward jumps taken, until compiled
+        int jit_failed;         // 1 when the bytecode could not be compiled
     } t_bytecode;
 
 
-    t_bytecode *generate_dummy_bytecode(void);
-    t_bytecode *bytecode_generate(t_ast_element *p, char *source_file);
+    t_bytecode *bytecode_new(void);
+    int bytecode_add_constant(t_bytecode *bc, int type, int len, void *data);
+    int bytecode_add_variable(t_bytecode *bc, const char *var);
+    int bytecode_add_handler(t_bytecode *bc, int start, int end, int handler, int stack_level);
+    void bytecode_set_lines(t_bytecode *bc, const int *offsets, const int *lines, int count);
+    int bytecode_get_lines(t_bytecode *bc, int **offsets, int **lines);
+    int bytecode_lineno(t_bytecode *bc, int offset);
+
+    t_bytecode *bytecode_generate(t_ast_element *p, char *source_file, int flags);
+    // 0 when bytecode_optimize() does not fuse superinstructions
+    extern int bytecode_superinstructions;
+
+    void bytecode_optimize(t_bytecode *bc, int flags);
+    void bytecode_shrink(t_bytecode *bc);
+    int bytecode_verify(t_bytecode *bc);
     void bytecode_free(t_bytecode *bc);
     char *bytecode_generate_destfile(const char *src);
+    char *bytecode_generate_cachefile(const char *cache_dir, const char *source_file);
+    int bytecode_source_stamp(const char *source_file, t_bytecode_source_stamp *stamp);
+    int bytecode_is_current(t_bytecode *bc, t_bytecode_source_stamp *stamp);
+
+    int bytecode_save(const char *dest_file, t_bytecode_source_stamp *stamp, t_bytecode *bc);
+    t_bytecode *bytecode_load(const char *filename);
 
 #endif
\ No newline at end of file
@@ -83,6 +83,7 @@
     char *sfc_build_var(int argc, ...);
 
     void saffire_validate_return();
+    void saffire_validate_yield();
     void saffire_validate_break();
     void saffire_validate_continue();
     void saffire_validate_breakelse();
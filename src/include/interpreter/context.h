@@ -39,15 +39,26 @@
 
     t_hash_table *ht_contexts;         // Hash of all contexts
 
+    /*
+     * Variables of a context are stored in slots. The vars hash maps the name of a variable to its slot number
+     * (plus one, so a missing name is NULL), and never shrinks. Slots can be empty, a variable only exists when its
+     * slot holds an object. Code that is bound to a (context, slot) pair accesses the variable by index.
+     */
     typedef struct _ns_context {
         char *name;                     // Name (or alias) of the context
         int aliased;                    // 0 not aliased, 1 if it is
         union {
             struct _ns_context *alias;  // Pointer to the context that is aliased
-            t_hash_table *vars;         // Variables (when not aliased)
+            t_hash_table *vars;         // Slot numbers of the variables (when not aliased)
         } data;
+        t_object **slots;               // Objects of the variables, indexed by slot number
+        int slots_len;                  // Number of slots
+        int slots_size;                 // Allocated number of slots
     } t_ns_context;
 
+    // Object stored in the slot of a context (or NULL)
+    #define SI_SLOT(ctx, slot)          ((ctx)->slots[slot])
+
     t_hash_table *ht_contexts;         // Hash of all contexts
 
     // @TODO: We can iterate hashes. Remove this
@@ -67,6 +78,7 @@
 
     int si_create_var_in_context(const char *var, t_ns_context *cur_ctx, t_object *obj, int mode);
     t_object *si_find_var_in_context(const char *var, t_ns_context *cur_ctx);
+    int si_bind_var_in_context(const char *var, t_ns_context *cur_ctx, t_ns_context **ctx, int *slot);
 
     t_ns_context *si_get_context(const char *name);
     t_ns_context *si_create_context(const char *name);
@@ -38,11 +38,15 @@
     // Different type of snodes
     typedef enum { snodeTypeNull, snodeTypeObject, snodeTypeIdentifier, snodeTypeString, snodeTypeDll } snodeTypeEnum;
 
+    struct _ns_context;
+
     // An identifier has a "name" (pointed by ID) and a pointer to the actual object it holds.
-    // Obj can be empty, ID should never be empty.
+    // Obj can be empty, ID should never be empty. A bound identifier knows the slot of its variable.
     typedef struct _t_identifier {
         char *id;            // "key" of the variable (cannot be NULL)
         t_object *obj;       // Actual object that is stored (can be NULL if nothing is set for this ID)
+        struct _ns_context *context;    // Context of the variable (NULL when not bound)
+        int slot;            // Slot of the variable inside the context
     } t_identifier;
 
     // Snode structure
@@ -65,48 +69,49 @@
 
 
     // Snode identifier macros
-    #define IS_OBJECT(snode)            (snode->type == snodeTypeObject)
-    #define IS_IDENTIFIER(snode)        (snode->type == snodeTypeIdentifier)
-    #define IS_STRING(snode)            (snode->type == snodeTypeString)
-    #define HAS_IDENTIFIER_ID(snode)    (snode->type == snodeTypeIdentifier && snode->data.id.id != NULL)
-    #define HAS_IDENTIFIER_OBJ(snode)   (snode->type == snodeTypeIdentifier && snode->data.id.obj != NULL)
-    #define IS_DLL(snode)               (snode->type == snodeTypeDll)
-    #define IS_NULL(snode)              (snode->type == snodeTypeNull)
-
-
-    // Snode return macros
-    #define RETURN_SNODE_STRING(string) { t_snode *ret = (t_snode *)smm_malloc(sizeof(t_snode)); \
-                                    ret->type = snodeTypeString; \
-                                    ret->data.str = string; \
-                                    dll_remove(lineno_stack, DLL_TAIL(lineno_stack)); \
-                                    return ret; }
-
-    #define RETURN_SNODE_NULL() { t_snode *ret = (t_snode *)smm_malloc(sizeof(t_snode)); \
-                                     ret->type = snodeTypeNull; \
-                                     dll_remove(lineno_stack, DLL_TAIL(lineno_stack)); \
+    #define IS_OBJECT(snode)            ((snode).type == snodeTypeObject)
+    #define IS_IDENTIFIER(snode)        ((snode).type == snodeTypeIdentifier)
+    #define IS_STRING(snode)            ((snode).type == snodeTypeString)
+    #define HAS_IDENTIFIER_ID(snode)    ((snode).type == snodeTypeIdentifier && (snode).data.id.id != NULL)
+    #define HAS_IDENTIFIER_OBJ(snode)   ((snode).type == snodeTypeIdentifier && (snode).data.id.obj != NULL)
+    #define IS_DLL(snode)               ((snode).type == snodeTypeDll)
+    #define IS_NULL(snode)              ((snode).type == snodeTypeNull)
+
+
+    // Snode return macros. Snodes are returned by value, so interpreting a node never allocates one.
+    #define RETURN_SNODE_STRING(string) { t_snode ret; \
+                                     ret.type = snodeTypeString; \
+                                     ret.data.str = string; \
+                                     return ret; }
+
+    #define RETURN_SNODE_NULL() { t_snode ret; \
+                                     ret.type = snodeTypeNull; \
                                      return ret; }
 
-    #define RETURN_SNODE_OBJECT(object) { t_snode *ret = (t_snode *)smm_malloc(sizeof(t_snode)); \
-                                     ret->type = snodeTypeObject; \
-                                     ret->data.obj = object; \
-                                     dll_remove(lineno_stack, DLL_TAIL(lineno_stack)); \
+    #define RETURN_SNODE_OBJECT(object) { t_snode ret; \
+                                     ret.type = snodeTypeObject; \
+                                     ret.data.obj = object; \
                                      return ret; }
 
-    #define RETURN_SNODE_IDENTIFIER(ident, object) { t_snode *ret = (t_snode *)smm_malloc(sizeof(t_snode)); \
-                                     ret->type = snodeTypeIdentifier; \
-                                     ret->data.id.id = smm_strdup(ident); \
-                                     ret->data.id.obj = object; \
-                                     dll_remove(lineno_stack, DLL_TAIL(lineno_stack)); \
+    // The identifier points into the AST, which outlives every snode
+    #define RETURN_SNODE_IDENTIFIER(ident, object) RETURN_SNODE_VARIABLE(ident, object, NULL, 0)
+
+    #define RETURN_SNODE_VARIABLE(ident, object, _context, _slot) { t_snode ret; \
+                                     ret.type = snodeTypeIdentifier; \
+                                     ret.data.id.id = ident; \
+                                     ret.data.id.obj = object; \
+                                     ret.data.id.context = _context; \
+                                     ret.data.id.slot = _slot; \
                                      return ret; }
 
-    #define RETURN_SNODE_DLL(_dll) { t_snode *ret = (t_snode *)smm_malloc(sizeof(t_snode)); \
-                                     ret->type = snodeTypeDll; \
-                                     ret->data.dll = _dll; \
-                                     dll_remove(lineno_stack, DLL_TAIL(lineno_stack)); \
+    #define RETURN_SNODE_DLL(_dll) { t_snode ret; \
+                                     ret.type = snodeTypeDll; \
+                                     ret.data.dll = _dll; \
                                      return ret; }
 
 
     int interpreter(t_ast_element *p);
     t_object *interpreter_leaf(t_ast_element *p);
+    int interpreter_lineno(void);
 
 #endif
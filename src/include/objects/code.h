@@ -29,13 +29,16 @@
 
     #include "objects/object.h"
 
-    #define RETURN_CODE(p, f)   RETURN_OBJECT(object_new(Object_Code, p, f));
+    #define RETURN_CODE(p, f, bc)   RETURN_OBJECT(object_new(Object_Code, p, f, bc));
+
+    struct _bytecode;
 
     typedef struct {
         SAFFIRE_OBJECT_HEADER
 
         t_ast_element *p;                        // external defined method (by AST leaf)
         t_object *(*f)(t_object *, t_dll *);     // internal method (by method call)
+        struct _bytecode *bc;                    // external defined method (by bytecode)
 
 //        // Additional information for code
 //        int calls;                  // Number of calls made to this code
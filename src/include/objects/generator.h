@@ -0,0 +1,54 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __GENERATOR_H__
+#define __GENERATOR_H__
+
+    #include "objects/object.h"
+
+    struct _vm_context;
+
+    #define RETURN_GENERATOR(frame)   RETURN_OBJECT(object_new(Object_Generator, frame));
+
+    /*
+     * A generator is returned by a call to a method that yields. It holds the frame of the method, which is
+     * suspended at every yield and resumed when the next value is asked for.
+     */
+    typedef struct _generator_object {
+        SAFFIRE_OBJECT_HEADER
+
+        struct _vm_context *frame;      // Suspended frame of the method (NULL when the generator has finished)
+        t_object *value;                // Value that has been produced, but not taken yet (or NULL)
+    } t_generator_object;
+
+    t_generator_object Object_Generator_struct;
+
+    #define Object_Generator   (t_object *)&Object_Generator_struct
+
+    void object_generator_init(void);
+    void object_generator_fini(void);
+
+#endif
@@ -121,6 +121,7 @@
     #define OBJECT_IS_BOOLEAN(obj)      (obj->type == objectTypeBoolean)
     #define OBJECT_IS_METHOD(obj)       (obj->type == objectTypeMethod)
     #define OBJECT_IS_CODE(obj)         (obj->type == objectTypeCode)
+    #define OBJECT_IS_GENERATOR(obj)    (obj->type == objectTypeGenerator)
 
 
 //    // A object's method hash table stores method_caller structures
@@ -134,10 +135,11 @@
 //    #define INTERNAL_METHOD(func) { func, 1 }
 
     // Object types, the objectTypeAny is a wildcard type. Matches any other type.
-    const char *objectTypeNames[10];
+    const char *objectTypeNames[11];
     typedef enum {
                    objectTypeAny, objectTypeCode, objectTypeMethod, objectTypeBase, objectTypeBoolean,
-                   objectTypeNull,objectTypeNumerical, objectTypeRegex, objectTypeString, objectTypeCustom
+                   objectTypeNull,objectTypeNumerical, objectTypeRegex, objectTypeString, objectTypeGenerator,
+                   objectTypeCustom
                  } t_objectype_enum;
 
     // Actual header that needs to be present in each object (as the first entry)
@@ -216,6 +218,32 @@
         { return (t_object *)self; }
 
 
+    /*
+     * Inline caches remember the outcome of method and operator lookups at a single call site. Each
+     * entry is keyed on the methods (or operators) table and the parent of the receiver, so a class
+     * and all its instances share one entry. Up to IC_ENTRIES different receivers are remembered
+     * before entries are being replaced.
+     */
+    #define IC_ENTRIES  4
+
+    typedef struct _inline_cache_entry {
+        void *key;              // Methods or operators table of the receiver
+        void *parent;           // Parent object of the receiver
+        void *value;            // Method object or operator function found
+    } t_inline_cache_entry;
+
+    typedef struct _inline_cache {
+        unsigned long epoch;    // Value of object_methods_epoch when this cache was filled
+        int count;              // Number of entries in use
+        int next;               // Entry to replace when all entries are in use
+        int misses;             // Number of times a quickened instruction at this site met other types
+        t_inline_cache_entry entries[IC_ENTRIES];
+    } t_inline_cache;
+
+    // Incremented whenever a methods table is created or changed, invalidating all inline caches
+    extern unsigned long object_methods_epoch;
+    #define object_methods_changed()    (object_methods_epoch++)
+
     int object_is_immutable(t_object *obj);
 
     void object_init(void);
@@ -224,6 +252,9 @@
     t_object *object_call_args(t_object *self, t_object *method_obj, t_dll *dll);
     t_object *object_call(t_object *self, t_object *method_obj, int arg_count, ...);
     t_object *object_operator(t_object *obj, int operator, int in_place, int arg_count, ...);
+    t_inline_cache *object_cache_new(void);
+    t_object *object_find_method_cached(t_object *obj, char *method_name, t_inline_cache *ic);
+    t_object *object_operator_cached(t_object *obj, int operator, int in_place, t_object *other, t_inline_cache *ic);
     t_object *object_comparison(t_object *obj1, int comparison, t_object *obj2);
     void object_free(t_object *obj);
     char *object_debug(t_object *obj);
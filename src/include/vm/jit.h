@@ -0,0 +1,83 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __VM_JIT_H__
+#define __VM_JIT_H__
+
+    #include <stdint.h>
+    #include "compiler/bytecode.h"
+
+    /*
+     * The JIT only exists on x86-64 Linux. Everywhere else jit_compile() never produces any code, and
+     * the VM simply keeps interpreting.
+     */
+    #if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__)
+        #define VM_JIT 1
+    #else
+        #define VM_JIT 0
+    #endif
+
+    // Number of invocations and backward jumps before a code object is compiled
+    #define JIT_CALL_THRESHOLD      100
+    #define JIT_BACKEDGE_THRESHOLD  1000
+
+    // Kind of machine code that is emitted for an opcode
+    #define JIT_EXIT            0       // Not supported: leave the native code and interpret from here (no helper)
+    #define JIT_CALL            1       // Call the helper and continue with the next instruction
+    #define JIT_SKIP            2       // Emit nothing at all
+    #define JIT_JUMP            3       // Jump to the operand
+    #define JIT_BRANCH          4       // Call the helper and jump to the operand when it returns a positive value,
+                                        // leave the native code when it returns a negative value
+    #define JIT_REG_BRANCH      5       // Like JIT_BRANCH, but with the target packed in a register jump operand
+    #define JIT_RETURN          6       // Call the helper and return the object it returned
+    #define JIT_CALL_CHECKED    7       // Like JIT_CALL, but leave the native code when the helper returns non-zero
+
+    /*
+     * A helper executes a single instruction on the frame. It receives the operand and the code offset
+     * of the next instruction (the offset of the instruction itself for JIT_EXIT).
+     */
+    typedef intptr_t (*t_jit_helper)(void *ctx, int oparg, int pc);
+
+    typedef struct _jit_template {
+        int kind;                   // JIT_* kind
+        t_jit_helper helper;        // Helper to call (if any)
+    } t_jit_template;
+
+    typedef struct _jit_code {
+        unsigned char *code;        // Executable mapping
+        size_t size;                // Size of the mapping
+        int code_len;               // Length of the bytecode this was compiled from
+        unsigned char **labels;     // Native address for every code offset (NULL when not an instruction)
+    } t_jit_code;
+
+    // 1 when hot code objects are compiled to native code
+    extern int vm_jit_enabled;
+
+    t_jit_code *jit_compile(t_bytecode *bc, const t_jit_template *templates, t_jit_helper exit_helper);
+    void *jit_enter(t_jit_code *jit, void *ctx, int ip);
+    void jit_free(t_jit_code *jit);
+
+#endif
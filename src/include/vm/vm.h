@@ -28,8 +28,16 @@
 #define __VM_H__
 
     #include "compiler/bytecode.h"
+    #include "objects/object.h"
+    #include "general/dll.h"
+
+    struct _generator_object;
 
     int vm_execute(t_bytecode *source_bc);
+    t_object *vm_call(t_bytecode *bc, t_object *self, t_dll *args);
+    t_object *vm_generator_resume(struct _generator_object *gen);
+    void vm_generator_close(struct _generator_object *gen);
+    int vm_lineno(void);
 
 #endif
 
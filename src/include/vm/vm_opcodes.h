@@ -38,15 +38,163 @@
 
     #define VM_NOP                  0x09
 
+    // Binary operators are laid out in the same order as the OPERATOR_* defines
     #define VM_BINARY_ADD           0x17
     #define VM_BINARY_SUBTRACT      0x18
+    #define VM_BINARY_MULTIPLY      0x19
+    #define VM_BINARY_DIVIDE        0x1A
+    #define VM_BINARY_MODULO        0x1B
+    #define VM_BINARY_AND           0x1C
+    #define VM_BINARY_OR            0x1D
+    #define VM_BINARY_XOR           0x1E
+    #define VM_BINARY_SHL           0x1F
+    #define VM_BINARY_SHR           0x20
+
+    // Quickened operators. The VM rewrites the generic operator into these once it sees numericals.
+    #define VM_BINARY_ADD_NUM       0x21
+    #define VM_BINARY_SUBTRACT_NUM  0x22
+    #define VM_BINARY_MULTIPLY_NUM  0x23
+
+    #define VM_BUILD_CLASS          0x50
+    #define VM_STORE_CLASS          0x51
+    #define VM_RETURN_VALUE         0x53
+    #define VM_YIELD_VALUE          0x56        // Suspends a generator frame and hands a value to its consumer
+    #define VM_THROW                0x57        // Throws the object on top of the stack
 
 
 #define HAVE_ARGUMENT 0x5a
 
     #define VM_STORE_VAR            0x5a
+    #define VM_STORE_CONST          0x5b
+    #define VM_STORE_PROPERTY       0x5c
+    #define VM_STORE_METHOD         0x5d
 
     #define VM_LOAD_CONST           0x64
     #define VM_LOAD_VAR             0x65
+    #define VM_LOAD_ATTRIB          0x66
+    #define VM_LOAD_METHOD          0x67
+
+    #define VM_COMPARE_OP           0x6B
+    #define VM_IMPORT               0x6C
+    #define VM_USE                  0x6D
+    #define VM_COMPARE_OP_NUM       0x6E        // Quickened COMPARE_OP
+
+    #define VM_JUMP_ABSOLUTE        0x71
+    #define VM_POP_JUMP_IF_FALSE    0x72
+    #define VM_POP_JUMP_IF_TRUE     0x73
+    #define VM_FOR_ITER             0x74        // Pushes the next value of an iterator, or pops it and jumps when done
+
+    // Compare the two values on top of the stack and jump on the outcome. Laid out in the order of the
+    // COMPARISON_* defines.
+    #define VM_COMPARE_JUMP_IF_FALSE_EQ    0x75
+    #define VM_COMPARE_JUMP_IF_FALSE_NE    0x76
+    #define VM_COMPARE_JUMP_IF_FALSE_LT    0x77
+    #define VM_COMPARE_JUMP_IF_FALSE_GT    0x78
+    #define VM_COMPARE_JUMP_IF_FALSE_LE    0x79
+    #define VM_COMPARE_JUMP_IF_FALSE_GE    0x7A
+
+    #define VM_COMPARE_JUMP_IF_TRUE_EQ     0x7B
+    #define VM_COMPARE_JUMP_IF_TRUE_NE     0x7C
+    #define VM_COMPARE_JUMP_IF_TRUE_LT     0x7D
+    #define VM_COMPARE_JUMP_IF_TRUE_GT     0x7E
+    #define VM_COMPARE_JUMP_IF_TRUE_LE     0x7F
+    #define VM_COMPARE_JUMP_IF_TRUE_GE     0x80
+
+    #define VM_MATCH_EXCEPTION      0x81        // Pops a class, jumps when the exception below it is no instance of it
+
+    #define VM_CALL_METHOD          0x83
+    #define VM_TAIL_CALL            0x84        // Call in return position, reuses the frame of the caller
+
+    // Superinstructions are generated from opcode sequence profiles by tools/gen_superinstructions.py. Two
+    // operands are packed into the low and high 16 bits of the operand.
+    #define VM_SUPERINSTRUCTION_FIRST   0x90
+    #define VM_SUPERINSTRUCTION_LAST    0x9F
+    #include "vm/vm_superinstructions.h"
+
+    // Register instructions use the variables of the frame as registers. Operators are laid out in the
+    // same order as the OPERATOR_* defines, comparisons in the order of the COMPARISON_* defines.
+    #define VM_REG_MOVE             0xA0
+    #define VM_REG_ADD              0xA1
+    #define VM_REG_SUBTRACT         0xA2
+    #define VM_REG_MULTIPLY         0xA3
+    #define VM_REG_DIVIDE           0xA4
+    #define VM_REG_MODULO           0xA5
+    #define VM_REG_AND              0xA6
+    #define VM_REG_OR               0xA7
+    #define VM_REG_XOR              0xA8
+    #define VM_REG_SHL              0xA9
+    #define VM_REG_SHR              0xAA
+
+    #define VM_REG_COMPARE_EQ       0xB1
+    #define VM_REG_COMPARE_NE       0xB2
+    #define VM_REG_COMPARE_LT       0xB3
+    #define VM_REG_COMPARE_GT       0xB4
+    #define VM_REG_COMPARE_LE       0xB5
+    #define VM_REG_COMPARE_GE       0xB6
+
+    #define VM_REG_JUMP_IF_FALSE    0xB8
+    #define VM_REG_JUMP_IF_TRUE     0xB9
+
+    /*
+     * Register instructions pack their operands: the destination register in bits 0-9 and the two sources
+     * in bits 10-20 and 21-31. A source with REG_CONST set is a constant instead of a register. Register
+     * jumps hold the register in bits 22-31 and the target in bits 0-21.
+     */
+    #define REG_MAX                 0x3FF
+    #define REG_CONST               0x400
+    #define REG_PACK(dst, a, b)     ((int)((unsigned int)(dst) | ((unsigned int)(a) << 10) | ((unsigned int)(b) << 21)))
+    #define REG_DST(arg)            ((unsigned int)(arg) & 0x3FF)
+    #define REG_SRC1(arg)           (((unsigned int)(arg) >> 10) & 0x7FF)
+    #define REG_SRC2(arg)           (((unsigned int)(arg) >> 21) & 0x7FF)
+
+    #define REG_JUMP_MAX            0x3FFFFF
+    #define REG_JUMP_PACK(reg, target)  ((int)((unsigned int)(target) | ((unsigned int)(reg) << 22)))
+    #define REG_JUMP_REG(arg)       (((unsigned int)(arg) >> 22) & 0x3FF)
+    #define REG_JUMP_TARGET(arg)    ((unsigned int)(arg) & 0x3FFFFF)
+
+
+    /*
+     * Operands are encoded as unsigned LEB128: 7 bits per byte, lowest bits first, with the high bit set on
+     * every byte except the last one. Most operands fit into a single byte. The fields of packed operands
+     * (superinstructions, register instructions and register jumps) are encoded as separate operands, the
+     * target of a register jump first. Decoding packs them into a single operand again.
+     *
+     * A jump target may be padded to OPERAND_MAX_SIZE bytes, so it can be patched once the target is known.
+     */
+    #define OPERAND_MAX_SIZE        5
+    #define INSTRUCTION_MAX_SIZE    (1 + 3 * OPERAND_MAX_SIZE)
+
+
+    const char *vm_opcode_name(int opcode);
+    int vm_opcode_operands(int opcode);
+    int vm_opcode_is_jump(int opcode);
+    int vm_opcode_stack_effect(int opcode, int oparg, int *needed, int *peak);
+    int vm_opcode_jump_stack_effect(int opcode, int oparg);
+    int vm_opcode_quickened(int opcode);
+    int vm_opcode_generic(int opcode);
+    int vm_superinstruction_find(const int *opcodes, int count);
+    int vm_superinstruction_split(int opcode, int oparg, int *opcodes, int *opargs);
+
+    int vm_encode_operand(unsigned char *buf, unsigned int value, int width);
+    int vm_encode_instruction(unsigned char *buf, int opcode, int oparg, int target_width);
+    int vm_decode_instruction(const unsigned char *code, int len, int pos, int *opcode, int *oparg);
+
+
+    /**
+     * Reads an operand and moves the pointer past it. Stops after OPERAND_MAX_SIZE bytes.
+     */
+    static inline unsigned int vm_read_operand(const unsigned char **p) {
+        const unsigned char *ip = *p;
+        unsigned int value = 0;
+        int shift = 0;
+
+        do {
+            value |= (unsigned int)(*ip & 0x7F) << shift;
+            shift += 7;
+        } while ((*ip++ & 0x80) && shift < 7 * OPERAND_MAX_SIZE);
+
+        *p = ip;
+        return value;
+    }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,86 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __VM_PROFILE_H__
+#define __VM_PROFILE_H__
+
+    #include <stdio.h>
+    #include <stdint.h>
+    #include <time.h>
+    #if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #endif
+
+    // Unit of vm_timestamp()
+    #if defined(__x86_64__) || defined(__i386__)
+        #define VM_TIMESTAMP_UNIT   "cycles"
+    #else
+        #define VM_TIMESTAMP_UNIT   "ns"
+    #endif
+
+    /**
+     * Returns the current time in cycles when available, or else in nanoseconds
+     */
+    static inline uint64_t vm_timestamp(void) {
+    #if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    #endif
+    }
+
+    // 1 when the VM records opcode sequences
+    extern int vm_profile_sequences;
+
+    // 1 when the VM records counts, time and predecessors per opcode
+    extern int vm_profile_opcodes;
+
+    void vm_profile_sequences_start(void);
+    void vm_profile_sequences_record(int opcode);
+    void vm_profile_sequences_reset(void);
+    int vm_profile_sequences_save(const char *filename);
+
+    void vm_profile_opcodes_start(void);
+    void vm_profile_opcodes_record(int opcode);
+    int vm_profile_opcodes_enter(void);
+    void vm_profile_opcodes_leave(int previous);
+    void vm_profile_opcodes_report(FILE *f);
+    int vm_profile_opcodes_save_json(const char *filename);
+
+    // 1 when any of the profilers needs to see every dispatched opcode
+    #define vm_profiling()  (vm_profile_sequences || vm_profile_opcodes)
+
+    /**
+     * Passes a dispatched opcode to the active profilers
+     */
+    static inline void vm_profile_record(int opcode) {
+        if (vm_profile_sequences) vm_profile_sequences_record(opcode);
+        if (vm_profile_opcodes) vm_profile_opcodes_record(opcode);
+    }
+
+#endif
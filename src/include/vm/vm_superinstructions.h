@@ -0,0 +1,83 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*
+ * Superinstructions, generated by tools/gen_superinstructions.py from the opcode sequence profile(s)
+ * tools/sequences.profile. Do not edit, regenerate it instead.
+ */
+#ifndef __VM_SUPERINSTRUCTIONS_H__
+#define __VM_SUPERINSTRUCTIONS_H__
+
+    // Identifies this set of superinstructions
+    #define VM_SUPERINSTRUCTIONS_ID     0x6AB4
+
+    #define VM_LOAD_VAR_LOAD_ATTRIB                         0x90        // 1200 times in the profile
+    #define VM_LOAD_VAR_LOAD_ATTRIB_BINARY_MULTIPLY         0x91        // 400 times in the profile
+    #define VM_LOAD_VAR_LOAD_METHOD                         0x92        // 648 times in the profile
+    #define VM_LOAD_VAR_LOAD_VAR                            0x93        // 640 times in the profile
+    #define VM_LOAD_METHOD_CALL_METHOD                      0x94        // 640 times in the profile
+    #define VM_LOAD_CONST_BINARY_MULTIPLY                   0x95        // 400 times in the profile
+    #define VM_LOAD_VAR_LOAD_CONST_BINARY_MULTIPLY          0x96        // 200 times in the profile
+    #define VM_LOAD_VAR_LOAD_ATTRIB_BINARY_SUBTRACT         0x97        // 200 times in the profile
+    #define VM_LOAD_ATTRIB_LOAD_VAR                         0x98        // 400 times in the profile
+    #define VM_LOAD_CONST_BINARY_SUBTRACT                   0x99        // 200 times in the profile
+    #define VM_DUP_TOP_STORE_VAR_LOAD_CONST                 0x9A        // 46 times in the profile
+
+    #define VM_LOAD_VAR_LOAD_ATTRIB_BINARY_MULTIPLY_NUM     0x9B
+    #define VM_LOAD_CONST_BINARY_MULTIPLY_NUM               0x9C
+    #define VM_LOAD_VAR_LOAD_CONST_BINARY_MULTIPLY_NUM      0x9D
+    #define VM_LOAD_VAR_LOAD_ATTRIB_BINARY_SUBTRACT_NUM     0x9E
+    #define VM_LOAD_CONST_BINARY_SUBTRACT_NUM               0x9F
+
+    /*
+     * SUPERINSTRUCTION(name, opcode, first, second, third) for every superinstruction. A superinstruction
+     * of two instructions has 0 as its third one.
+     */
+    #define VM_SUPERINSTRUCTIONS(SUPERINSTRUCTION) \
+        SUPERINSTRUCTION(LOAD_VAR_LOAD_ATTRIB, 0x90, VM_LOAD_VAR, VM_LOAD_ATTRIB, 0) \
+        SUPERINSTRUCTION(LOAD_VAR_LOAD_ATTRIB_BINARY_MULTIPLY, 0x91, VM_LOAD_VAR, VM_LOAD_ATTRIB, VM_BINARY_MULTIPLY) \
+        SUPERINSTRUCTION(LOAD_VAR_LOAD_METHOD, 0x92, VM_LOAD_VAR, VM_LOAD_METHOD, 0) \
+        SUPERINSTRUCTION(LOAD_VAR_LOAD_VAR, 0x93, VM_LOAD_VAR, VM_LOAD_VAR, 0) \
+        SUPERINSTRUCTION(LOAD_METHOD_CALL_METHOD, 0x94, VM_LOAD_METHOD, VM_CALL_METHOD, 0) \
+        SUPERINSTRUCTION(LOAD_CONST_BINARY_MULTIPLY, 0x95, VM_LOAD_CONST, VM_BINARY_MULTIPLY, 0) \
+        SUPERINSTRUCTION(LOAD_VAR_LOAD_CONST_BINARY_MULTIPLY, 0x96, VM_LOAD_VAR, VM_LOAD_CONST, VM_BINARY_MULTIPLY) \
+        SUPERINSTRUCTION(LOAD_VAR_LOAD_ATTRIB_BINARY_SUBTRACT, 0x97, VM_LOAD_VAR, VM_LOAD_ATTRIB, VM_BINARY_SUBTRACT) \
+        SUPERINSTRUCTION(LOAD_ATTRIB_LOAD_VAR, 0x98, VM_LOAD_ATTRIB, VM_LOAD_VAR, 0) \
+        SUPERINSTRUCTION(LOAD_CONST_BINARY_SUBTRACT, 0x99, VM_LOAD_CONST, VM_BINARY_SUBTRACT, 0) \
+        SUPERINSTRUCTION(DUP_TOP_STORE_VAR_LOAD_CONST, 0x9A, VM_DUP_TOP, VM_STORE_VAR, VM_LOAD_CONST) \
+
+    /*
+     * SUPERINSTRUCTION_NUM(name, opcode, generic, first, second, third) for the quickened forms of the
+     * superinstructions that end in an operator
+     */
+    #define VM_SUPERINSTRUCTIONS_NUM(SUPERINSTRUCTION_NUM) \
+        SUPERINSTRUCTION_NUM(LOAD_VAR_LOAD_ATTRIB_BINARY_MULTIPLY_NUM, 0x9B, LOAD_VAR_LOAD_ATTRIB_BINARY_MULTIPLY, VM_LOAD_VAR, VM_LOAD_ATTRIB, VM_BINARY_MULTIPLY) \
+        SUPERINSTRUCTION_NUM(LOAD_CONST_BINARY_MULTIPLY_NUM, 0x9C, LOAD_CONST_BINARY_MULTIPLY, VM_LOAD_CONST, VM_BINARY_MULTIPLY, 0) \
+        SUPERINSTRUCTION_NUM(LOAD_VAR_LOAD_CONST_BINARY_MULTIPLY_NUM, 0x9D, LOAD_VAR_LOAD_CONST_BINARY_MULTIPLY, VM_LOAD_VAR, VM_LOAD_CONST, VM_BINARY_MULTIPLY) \
+        SUPERINSTRUCTION_NUM(LOAD_VAR_LOAD_ATTRIB_BINARY_SUBTRACT_NUM, 0x9E, LOAD_VAR_LOAD_ATTRIB_BINARY_SUBTRACT, VM_LOAD_VAR, VM_LOAD_ATTRIB, VM_BINARY_SUBTRACT) \
+        SUPERINSTRUCTION_NUM(LOAD_CONST_BINARY_SUBTRACT_NUM, 0x9F, LOAD_CONST_BINARY_SUBTRACT, VM_LOAD_CONST, VM_BINARY_SUBTRACT, 0) \
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __VM_TRACE_H__
+#define __VM_TRACE_H__
+
+    #include <stdio.h>
+    #include <stdint.h>
+
+    #define VM_TRACE_MAGIC      0x52544653      // "SFTR"
+    #define VM_TRACE_VERSION    1
+
+    // Number of records in the ring buffer (must be a power of two)
+    #define VM_TRACE_RECORDS    8192
+
+    #define VM_TRACE_UNIT_CYCLES    0
+    #define VM_TRACE_UNIT_NS        1
+
+    typedef struct _vm_trace_header {
+        uint32_t magic;             // VM_TRACE_MAGIC
+        uint32_t version;           // VM_TRACE_VERSION
+        uint32_t record_size;       // Size of a single record
+        uint32_t count;             // Number of records that follow, oldest first
+        uint32_t pid;               // Process that wrote the dump
+        uint32_t unit;              // Unit of the timestamps (VM_TRACE_UNIT_*)
+        uint64_t total;             // Total number of records written, including the overwritten ones
+    } __attribute__((packed)) t_vm_trace_header;
+
+    typedef struct _vm_trace_record {
+        uint64_t timestamp;         // Time of dispatch
+        uint32_t ip;                // Code offset of the opcode
+        uint16_t sp;                // Number of items on the stack
+        uint8_t  opcode;            // Opcode
+        uint8_t  depth;             // Frame depth (saturates at 255)
+    } __attribute__((packed)) t_vm_trace_record;
+
+    // 1 when the VM writes trace records
+    extern int vm_trace_enabled;
+
+    void vm_trace_start(const char *dump_file);
+    void vm_trace_record(int ip, int opcode, int sp, int depth);
+    void vm_trace_dump(void);
+    int vm_trace_decode(const char *filename, FILE *out);
+
+#endif
@@ -30,11 +30,15 @@
 #include <locale.h>
 #include "interpreter/context.h"
 #include "modules/module_api.h"
-#include "vm/vm.h"
+#include "compiler/bytecode.h"
+#include "general/smm.h"
 #include "commands/command.h"
 #include "general/parse_options.h"
 
 
+static int optimize = 1;
+static int generate_flags = BYTECODE_DEFAULT_FLAGS;
+
 static int do_compile(void) {
     char *source_file = saffire_getopt_string(0);
 
@@ -44,24 +48,24 @@ static int do_compile(void) {
     module_init();
 
 
-    t_bytecode *bc = generate_dummy_bytecode();
-    vm_execute(bc);
-    return 0;
+    // Stamp the source before it is parsed, so the stamp never belongs to a newer version than the bytecode
+    t_bytecode_source_stamp stamp;
+    int stamped = bytecode_source_stamp(source_file, &stamp);
 
     t_ast_element *ast = ast_generate_from_file(source_file);
-//    char *dest_file = bytecode_generate_destfile(source_file);
-//    t_bytecode *bc = bytecode_generate(ast_root, source_file);
-//    if (bc && bc->length) {
-//        printf("Dumping %d bytes into '%s'\n", bc->length, dest_file);
-//        FILE *f = fopen(dest_file, "w+");
-//        if (f) {
-//            fwrite(bc->buffer, 1, bc->length, f);
-//            fclose(f);
-//        }
-//    }
-//
-//    bytecode_free(bc);
-//    smm_free(dest_file);        // free dest file name
+    t_bytecode *bc = bytecode_generate(ast, source_file, generate_flags);
+    if (optimize) {
+        bytecode_optimize(bc, generate_flags);
+    }
+
+    int ret = 0;
+    char *dest_file = bytecode_generate_destfile(source_file);
+    if (! bytecode_save(dest_file, stamped ? &stamp : NULL, bc)) {
+        printf("Cannot write bytecode file '%s'\n", dest_file);
+        ret = 1;
+    }
+    smm_free(dest_file);
+    bytecode_free(bc);
 
     // Release memory of ast root
     if (ast != NULL) {
@@ -72,7 +76,7 @@ static int do_compile(void) {
     object_fini();
     context_fini();
 
-    return 0;
+    return ret;
 }
 
 
@@ -81,14 +85,41 @@ static int do_compile(void) {
  ***/
 
 
+static void opt_no_optimize(void *data) {
+    optimize = 0;
+}
+
+static void opt_registers(void *data) {
+    generate_flags |= BYTECODE_REGISTERS;
+}
+
+static void opt_no_unbox(void *data) {
+    generate_flags &= ~BYTECODE_UNBOX;
+}
+
+
 /* Usage string */
-static const char help[]   = "Compiles a Saffire script.\n";
+static const char help[]   = "Compiles a Saffire script.\n"
+                             "\n"
+                             "Global settings:\n"
+                             "    --no-optimize, -n       Do not optimize the generated bytecode\n"
+                             "    --registers, -r         Generate register instructions where possible\n"
+                             "    --no-unbox              Do not let the optimizer turn arithmetic and compares on variables into\n"
+                             "                            register instructions that keep numericals unboxed\n";
+
+
+static struct saffire_option global_options[] = {
+    { "no-optimize", "n", no_argument, opt_no_optimize },
+    { "registers", "r", no_argument, opt_registers },
+    { "no-unbox", "", no_argument, opt_no_unbox },
+    { 0, 0, 0, 0 }
+};
 
 
 
 /* Config actions */
 static struct command_action command_actions[] = {
-    { "", "s", do_compile, NULL },
+    { "", "s", do_compile, global_options },
     { 0, 0, 0, 0 }
 };
 
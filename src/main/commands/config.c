@@ -29,6 +29,7 @@
 #include <string.h>
 #include <time.h>
 #include <fnmatch.h>
+#include <unistd.h>
 #include "commands/command.h"
 #include "commands/config.h"
 #include "general/parse_options.h"
@@ -44,8 +45,10 @@ static const char *default_ini[] = {
     "[global]",
     "  # debug, notice, warning, error",
     "  log.level = debug",
-    "  log.path = /var/log/saffire/saffire.log"
+    "  log.path = /var/log/saffire/saffire.log",
     "",
+    "  # Directory for compiled bytecode of scripts executed with --vm (disabled when empty)",
+    "  bytecode.cache.path = /var/cache/saffire",
     "",
     "[fastcgi]",
     "  pid.path = /var/run/saffire.pid",
@@ -154,6 +157,14 @@ static void read_ini(void) {
 }
 
 
+/**
+ * Returns 1 when the configuration can be read, 0 otherwise
+ */
+int config_available(void) {
+    return ini_read || access(ini_file, R_OK) == 0;
+}
+
+
 /**
  * Return a string from the configuration
  */
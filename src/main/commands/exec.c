@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <string.h>
 #include <locale.h>
 #include "interpreter/context.h"
 #include "objects/object.h"
@@ -34,19 +35,120 @@
 #include "compiler/ast.h"
 #include "dot/dot.h"
 #include "interpreter/interpreter.h"
+#include "compiler/bytecode.h"
+#include "vm/vm.h"
+#include "vm/vm_profile.h"
+#include "vm/vm_trace.h"
+#include "vm/jit.h"
 #include "commands/command.h"
+#include "commands/config.h"
+#include "general/smm.h"
 #include "general/parse_options.h"
 
 char *dot_file = NULL;
+static char *sequence_file = NULL;
+static int profile_opcodes = 0;
+static char *opcode_json_file = NULL;
+static char *trace_file = NULL;
+static int optimize = 1;
+static int use_vm = 0;
+static int generate_flags = BYTECODE_DEFAULT_FLAGS;
 
-static int do_exec(void) {
-    char *source_file = saffire_getopt_string(0);
+/**
+ * Returns 1 when the file is a compiled bytecode file (.sfc)
+ */
+static int _is_bytecode_file(const char *filename) {
+    size_t len = strlen(filename);
+    return (len > 4 && strcmp(filename + len - 4, ".sfc") == 0);
+}
 
-    setlocale(LC_ALL,"");
-    context_init();
-    object_init();
-    module_init();
+/**
+ * Runs a compiled bytecode file directly from its mapping
+ */
+static int _exec_bytecode(const char *bytecode_file) {
+    t_bytecode *bc = bytecode_load(bytecode_file);
+    if (! bc) {
+        printf("Cannot load bytecode file '%s'\n", bytecode_file);
+        return 1;
+    }
+
+    int ret = vm_execute(bc);
+    bytecode_free(bc);
+    return ret;
+}
+
+/**
+ * Compiles a source file into bytecode
+ */
+static t_bytecode *_generate_bytecode(const char *source_file) {
+    t_ast_element *ast = ast_generate_from_file((char *)source_file);
+    t_bytecode *bc = bytecode_generate(ast, (char *)source_file, generate_flags);
+    if (ast != NULL) {
+        ast_free_node(ast);
+    }
+
+    if (optimize) {
+        bytecode_optimize(bc, generate_flags);
+    }
+    return bc;
+}
+
+/**
+ * Returns bytecode for the source file from the bytecode cache. On a miss, the source is compiled and the
+ * cache entry is (re)written. Returns NULL when no cache is configured.
+ */
+static t_bytecode *_cached_bytecode(const char *source_file) {
+    if (! config_available()) return NULL;
 
+    char *cache_dir = config_get_string("global.bytecode.cache.path");
+    if (! cache_dir || ! *cache_dir) return NULL;
+
+    char *cache_file = bytecode_generate_cachefile(cache_dir, source_file);
+
+    // The cache only holds optimized stack bytecode, so it is bypassed for other kinds of bytecode
+    int use_cache = optimize && generate_flags == BYTECODE_DEFAULT_FLAGS && bytecode_superinstructions;
+
+    // Stamp the source before it is parsed. When it changes during the compile, the entry gets the stamp of the
+    // old version and is recompiled on the next run.
+    t_bytecode_source_stamp stamp;
+    if (use_cache && ! bytecode_source_stamp(source_file, &stamp)) {
+        use_cache = 0;
+    }
+
+    t_bytecode *bc = use_cache ? bytecode_load(cache_file) : NULL;
+    if (bc && ! bytecode_is_current(bc, &stamp)) {
+        bytecode_free(bc);
+        bc = NULL;
+    }
+
+    if (! bc) {
+        bc = _generate_bytecode(source_file);
+
+        // A cache that cannot be written is not fatal, we just run the compiled code
+        if (use_cache) {
+            bytecode_save(cache_file, &stamp, bc);
+        }
+    }
+
+    smm_free(cache_file);
+    return bc;
+}
+
+/**
+ * Returns the bytecode to run a source file on the VM. The bytecode cache is used when it is configured.
+ */
+static t_bytecode *_source_bytecode(const char *source_file) {
+    t_bytecode *bc = _cached_bytecode(source_file);
+    if (! bc) {
+        bc = _generate_bytecode(source_file);
+    }
+    return bc;
+}
+
+/**
+ * Runs a source file through the interpreter
+ */
+static int _exec_source(char *source_file) {
     t_ast_element *ast = ast_generate_from_file(source_file);
 
     if (dot_file) {
@@ -60,6 +162,55 @@ static int do_exec(void) {
         ast_free_node(ast);
     }
 
+    return ret;
+}
+
+static int do_exec(void) {
+    char *source_file = saffire_getopt_string(0);
+    t_bytecode *bc;
+    int ret;
+
+    setlocale(LC_ALL,"");
+    context_init();
+    object_init();
+    module_init();
+
+    if (sequence_file || profile_opcodes || trace_file) {
+        // The profilers and tracer record the opcodes as they are dispatched, so everything must be interpreted
+        vm_jit_enabled = 0;
+    }
+    if (trace_file) {
+        vm_trace_start(trace_file);
+    }
+    if (sequence_file) {
+        vm_profile_sequences_start();
+    }
+    if (profile_opcodes) {
+        vm_profile_opcodes_start();
+    }
+
+    if (_is_bytecode_file(source_file)) {
+        ret = _exec_bytecode(source_file);
+    } else if (use_vm && ! dot_file) {
+        // Bytecode has no AST, so DOT files are always generated by the interpreter
+        bc = _source_bytecode(source_file);
+        ret = vm_execute(bc);
+        bytecode_free(bc);
+    } else {
+        ret = _exec_source(source_file);
+    }
+
+    if (sequence_file && ! vm_profile_sequences_save(sequence_file)) {
+        printf("Cannot write opcode sequence profile to '%s'\n", sequence_file);
+    }
+    if (opcode_json_file) {
+        if (! vm_profile_opcodes_save_json(opcode_json_file)) {
+            printf("Cannot write opcode profile to '%s'\n", opcode_json_file);
+        }
+    } else if (profile_opcodes) {
+        vm_profile_opcodes_report(stderr);
+    }
+
     module_fini();
     object_fini();
     context_fini();
@@ -76,18 +227,88 @@ static void opt_dot(void *data) {
     dot_file = (char *)data;
 }
 
+static void opt_vm(void *data) {
+    use_vm = 1;
+}
+
+static void opt_no_optimize(void *data) {
+    optimize = 0;
+}
+
+static void opt_registers(void *data) {
+    use_vm = 1;
+    generate_flags |= BYTECODE_REGISTERS;
+}
+
+static void opt_no_unbox(void *data) {
+    generate_flags &= ~BYTECODE_UNBOX;
+}
+
+static void opt_no_jit(void *data) {
+    vm_jit_enabled = 0;
+}
+
+static void opt_profile_sequences(void *data) {
+    use_vm = 1;
+    sequence_file = (char *)data;
+    // Profile the sequences that could be fused, instead of the superinstructions we already have
+    bytecode_superinstructions = 0;
+}
+
+static void opt_trace(void *data) {
+    use_vm = 1;
+    trace_file = (char *)data;
+}
+
+static void opt_profile_opcodes(void *data) {
+    use_vm = 1;
+    profile_opcodes = 1;
+}
+
+static void opt_profile_opcodes_json(void *data) {
+    use_vm = 1;
+    profile_opcodes = 1;
+    opcode_json_file = (char *)data;
+}
+
 
 /* Usage string */
 static const char help[]   = "Executes a Saffire script.\n"
                              "\n"
                              "Global settings:\n"
                              "    --dot, -d <FILE>        Generate a DOT file\n"
+                             "    --vm                    Compile the script to bytecode and run it on the VM. The bytecode is\n"
+                             "                            cached when global.bytecode.cache.path is set\n"
+                             "    --no-optimize, -n       Do not optimize the bytecode\n"
+                             "    --registers, -r         Run on the VM with register instructions where possible\n"
+                             "    --no-unbox              Do not let the optimizer turn arithmetic and compares on variables into\n"
+                             "                            register instructions that keep numericals unboxed\n"
+                             "    --no-jit                Never compile hot bytecode to native code\n"
+                             "    --profile-sequences <FILE>\n"
+                             "                            Run on the VM and add opcode pair and triple counts to FILE. Superinstructions\n"
+                             "                            are not fused, see tools/gen_superinstructions.py\n"
+                             "    --profile-opcodes       Run on the VM and print count, time and most frequent predecessor\n"
+                             "                            per opcode\n"
+                             "    --profile-opcodes-json <FILE>\n"
+                             "                            Like --profile-opcodes, but write the profile as JSON to FILE\n"
+                             "    --trace <FILE>          Run on the VM and trace the last executed opcodes. The trace is\n"
+                             "                            written to FILE on errors, crashes and SIGUSR1. Use \"saffire trace\"\n"
+                             "                            to read it.\n"
                              "\n"
                              "This command allows you to enter Saffire commands, which are immediately executed.\n";
 
 
 static struct saffire_option global_options[] = {
     { "dot", "d", required_argument, opt_dot },
+    { "vm", "", no_argument, opt_vm },
+    { "no-optimize", "n", no_argument, opt_no_optimize },
+    { "registers", "r", no_argument, opt_registers },
+    { "no-unbox", "", no_argument, opt_no_unbox },
+    { "no-jit", "", no_argument, opt_no_jit },
+    { "profile-sequences", "", required_argument, opt_profile_sequences },
+    { "profile-opcodes", "", no_argument, opt_profile_opcodes },
+    { "profile-opcodes-json", "", required_argument, opt_profile_opcodes_json },
+    { "trace", "", required_argument, opt_trace },
     { 0, 0, 0, 0 }
 };
 
@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include "commands/command.h"
+#include "vm/vm_trace.h"
+#include "general/parse_options.h"
+
+
+/**
+ * Decodes a trace dump written by "saffire exec --trace"
+ */
+static int do_trace(void) {
+    char *dump_file = saffire_getopt_string(0);
+
+    if (! vm_trace_decode(dump_file, stdout)) {
+        printf("Cannot read trace dump '%s'\n", dump_file);
+        return 1;
+    }
+    return 0;
+}
+
+
+/****
+ * Argument Parsing and action definitions
+ ***/
+
+
+/* Usage string */
+static const char help[]   = "Decodes a trace dump that was written by \"saffire exec --trace <FILE>\".\n"
+                             "\n"
+                             "Every line shows a single executed opcode, oldest first: the record number, the time since\n"
+                             "the first record, the frame depth, the code offset, the stack level and the opcode.\n";
+
+/* Config actions */
+static struct command_action command_actions[] = {
+    { "", "s", do_trace, NULL },
+    { 0, 0, 0, 0 }
+};
+
+struct command_info info_trace = {
+    "Decode an execution trace dump",
+    command_actions,
+    help
+};
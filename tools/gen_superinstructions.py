@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2012, The Saffire Group
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of the <organization> nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+"""
+Generates src/include/vm/vm_superinstructions.h from opcode sequence profiles.
+
+Record one or more profiles (counts are added up when the same file is used again):
+
+    saffire exec --profile-sequences profile.txt script.sf
+
+Superinstructions are not fused while profiling, so the profile shows the sequences that could be fused.
+Then regenerate the header and rebuild:
+
+    tools/gen_superinstructions.py profile.txt > src/include/vm/vm_superinstructions.h
+
+The committed header is generated from tools/sequences.profile, which tools/profile_sequences.sh records from the
+scripts in tools/corpus.
+
+The most frequent pairs and triples that the VM can fuse become superinstructions. The opcodes, the
+handlers in vm.c (interpreter and JIT), the peephole patterns, the verifier and the stack effects are all
+derived from the lists in the header. The bytecode version includes VM_SUPERINSTRUCTIONS_ID, so compiled
+bytecode of another set of superinstructions is not loaded.
+"""
+
+import argparse
+import os
+import re
+import sys
+import zlib
+
+# Top of the tree
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+# Opcodes, HAVE_ARGUMENT and the range of superinstruction opcodes (VM_SUPERINSTRUCTION_FIRST to _LAST)
+OPCODES_H = os.path.join(ROOT, "src", "include", "vm", "vm_opcodes.h")
+
+# Components the VM can run inside a superinstruction, see SUPER_STEP() in vm.c
+COMPONENTS = {
+    "POP_TOP", "DUP_TOP", "LOAD_CONST", "LOAD_VAR", "LOAD_ATTRIB", "LOAD_METHOD", "STORE_VAR", "CALL_METHOD",
+    "BINARY_ADD", "BINARY_SUBTRACT", "BINARY_MULTIPLY", "BINARY_DIVIDE", "BINARY_MODULO", "BINARY_AND",
+    "BINARY_OR", "BINARY_XOR", "BINARY_SHL", "BINARY_SHR",
+}
+
+# Operators that have a quickened form. A superinstruction that ends in one gets a quickened form as well.
+QUICKENED = {"BINARY_ADD", "BINARY_SUBTRACT", "BINARY_MULTIPLY"}
+
+# Components that use the inline cache of the instruction. A superinstruction has a single cache.
+CACHED = {"LOAD_METHOD"}
+
+LICENSE = """/*
+ Copyright (c) 2012, The Saffire Group
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the <organization> nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+"""
+
+
+def _relative(filename):
+    """Returns the name of a file relative to the top of the tree, when it is inside the tree"""
+    relative = os.path.relpath(os.path.abspath(filename), os.path.abspath(ROOT))
+    return filename if relative.startswith("..") else relative
+
+
+def read_opcodes(filename):
+    """Returns the opcode defines of vm_opcodes.h by name (without VM_)"""
+    opcodes = {}
+    with open(filename) as f:
+        for line in f:
+            m = re.match(r"\s*#define\s+(?:VM_)?(\w+)\s+(0x[0-9A-Fa-f]+)", line)
+            if m:
+                opcodes[m.group(1)] = int(m.group(2), 16)
+    return opcodes
+
+
+def read_profile(filename, counts, opcodes):
+    """Adds the sequence counts of a profile file to counts, keyed by the tuple of (opcode, name) pairs"""
+    with open(filename) as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+
+            try:
+                fields, names = line.split("#", 1)
+                count, sequence = fields.split()
+                sequence = [int(op, 16) for op in sequence.split(",")]
+                names = names.split()
+                count = int(count)
+            except ValueError:
+                sys.exit("%s:%d: not an opcode sequence profile line" % (filename, number))
+
+            if len(sequence) != len(names):
+                sys.exit("%s:%d: opcodes and names do not match" % (filename, number))
+
+            # Quickened instructions are counted as their generic instruction, that is what the optimizer sees
+            names = [name[:-4] if name.endswith("_NUM") and name[:-4] in opcodes else name for name in names]
+            key = tuple((opcodes.get(name, op), name) for op, name in zip(sequence, names))
+            counts[key] = counts.get(key, 0) + count
+
+
+def can_fuse(sequence, have_argument):
+    """Returns the reason why the VM cannot fuse the sequence, or None when it can"""
+    names = [name for _, name in sequence]
+
+    for name in names:
+        if name not in COMPONENTS:
+            return "%s cannot be part of a superinstruction" % name
+    for name in names[:-1]:
+        if name.startswith("BINARY_"):
+            return "operators can only end a superinstruction"
+
+    # Operands are packed into 16 bits each, so a superinstruction holds at most two of them
+    if len([op for op, _ in sequence if op >= have_argument]) > 2:
+        return "a superinstruction holds at most two operands"
+
+    if len([name for name in names if name in CACHED or name.startswith("BINARY_")]) > 1:
+        return "a superinstruction has a single inline cache"
+
+    return None
+
+
+def select(counts, limit, have_argument):
+    """Returns the sequences to fuse, most dispatches saved first"""
+    remaining = dict((seq, counts[seq]) for seq in counts if can_fuse(seq, have_argument) is None)
+
+    selected = []
+    opcodes = 0
+    while remaining:
+        # Fusing n instructions saves n - 1 dispatches every time the sequence runs
+        seq = min(remaining, key=lambda seq: (-remaining[seq] * (len(seq) - 1), seq))
+        count = remaining.pop(seq)
+        if count == 0:
+            break
+
+        needed = 2 if seq[-1][1] in QUICKENED else 1
+        if opcodes + needed > limit:
+            continue
+        selected.append(seq)
+        opcodes += needed
+
+        # The optimizer fuses triples before pairs, so the pairs inside a triple run less often
+        if len(seq) == 3:
+            for pair in (seq[:2], seq[1:]):
+                if pair in remaining:
+                    remaining[pair] = max(0, remaining[pair] - count)
+
+    return selected
+
+
+def generate(selected, counts, profiles, first):
+    """Returns the header for the selected sequences"""
+    supers = []
+    quickened = []
+
+    opcode = first
+    for seq in selected:
+        names = [name for _, name in seq]
+        supers.append(("_".join(names), opcode, names, counts[seq]))
+        opcode += 1
+    for name, _, names, _ in supers:
+        if names[-1] in QUICKENED:
+            quickened.append((name + "_NUM", opcode, name, names))
+            opcode += 1
+
+    # Bytecode stores the opcodes, so bytecode of another set of superinstructions cannot be loaded
+    ident = zlib.crc32(" ".join(name for name, _, _, _ in supers).encode()) & 0xFFFF
+
+    out = [LICENSE]
+    out.append("/*\n")
+    out.append(" * Superinstructions, generated by tools/gen_superinstructions.py from the opcode sequence profile(s)\n")
+    out.append(" * %s. Do not edit, regenerate it instead.\n" % ", ".join(_relative(p) for p in profiles))
+    out.append(" */\n")
+    out.append("#ifndef __VM_SUPERINSTRUCTIONS_H__\n")
+    out.append("#define __VM_SUPERINSTRUCTIONS_H__\n\n")
+
+    out.append("    // Identifies this set of superinstructions\n")
+    out.append("    #define VM_SUPERINSTRUCTIONS_ID     0x%04X\n\n" % ident)
+
+    width = max(len(name) for name, _, _, _ in supers + quickened) + 4
+    for name, opcode, _, count in supers:
+        out.append("    #define VM_%-*s 0x%02X        // %d times in the profile\n" % (width, name, opcode, count))
+    out.append("\n")
+    if quickened:
+        for name, opcode, _, _ in quickened:
+            out.append("    #define VM_%-*s 0x%02X\n" % (width, name, opcode))
+        out.append("\n")
+
+    out.append("    /*\n")
+    out.append("     * SUPERINSTRUCTION(name, opcode, first, second, third) for every superinstruction. A superinstruction\n")
+    out.append("     * of two instructions has 0 as its third one.\n")
+    out.append("     */\n")
+    out.append("    #define VM_SUPERINSTRUCTIONS(SUPERINSTRUCTION) \\\n")
+    for name, opcode, names, _ in supers:
+        components = ["VM_" + n for n in names] + ["0"] * (3 - len(names))
+        out.append("        SUPERINSTRUCTION(%s, 0x%02X, %s) \\\n" % (name, opcode, ", ".join(components)))
+    out.append("\n")
+
+    out.append("    /*\n")
+    out.append("     * SUPERINSTRUCTION_NUM(name, opcode, generic, first, second, third) for the quickened forms of the\n")
+    out.append("     * superinstructions that end in an operator\n")
+    out.append("     */\n")
+    out.append("    #define VM_SUPERINSTRUCTIONS_NUM(SUPERINSTRUCTION_NUM) \\\n")
+    for name, opcode, generic, names in quickened:
+        components = ["VM_" + n for n in names] + ["0"] * (3 - len(names))
+        out.append("        SUPERINSTRUCTION_NUM(%s, 0x%02X, %s, %s) \\\n" % (name, opcode, generic, ", ".join(components)))
+    out.append("\n")
+
+    out.append("#endif\n")
+    return "".join(out)
+
+
+def main():
+    opcodes = read_opcodes(OPCODES_H)
+    first, last = opcodes["SUPERINSTRUCTION_FIRST"], opcodes["SUPERINSTRUCTION_LAST"]
+
+    parser = argparse.ArgumentParser(description="Generates superinstructions from opcode sequence profiles")
+    parser.add_argument("profiles", nargs="+", help="profile written by saffire exec --profile-sequences")
+    parser.add_argument("--opcodes", type=int, default=last - first + 1,
+                        help="number of opcodes to use, including quickened forms (default: all %(default)d)")
+    parser.add_argument("--verbose", "-v", action="store_true", help="explain on stderr why sequences were skipped")
+    args = parser.parse_args()
+
+    if args.opcodes < 1 or args.opcodes > last - first + 1:
+        sys.exit("--opcodes must be between 1 and %d" % (last - first + 1))
+
+    counts = {}
+    for filename in args.profiles:
+        read_profile(filename, counts, opcodes)
+
+    if args.verbose:
+        for seq in sorted(counts, key=lambda seq: -counts[seq]):
+            reason = can_fuse(seq, opcodes["HAVE_ARGUMENT"])
+            if reason:
+                names = " ".join(name for _, name in seq)
+                sys.stderr.write("skipped %s (%d times): %s\n" % (names, counts[seq], reason))
+
+    selected = select(counts, args.opcodes, opcodes["HAVE_ARGUMENT"])
+    if not selected:
+        sys.exit("No sequence in the profile can be fused")
+
+    sys.stdout.write(generate(selected, counts, args.profiles, first))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,16 @@
+#!/bin/sh
+#
+# Records the opcode sequence profile of the scripts in tools/corpus into tools/sequences.profile, and
+# regenerates src/include/vm/vm_superinstructions.h from it. Rebuild saffire afterwards.
+#
+#     tools/profile_sequences.sh [saffire binary, default src/saffire]
+#
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+SAFFIRE=${1:-$TOP/src/saffire}
+
+rm -f "$TOP/tools/sequences.profile"
+for script in "$TOP"/tools/corpus/*.sf; do
+    "$SAFFIRE" exec --profile-sequences "$TOP/tools/sequences.profile" "$script" > /dev/null || exit 1
+done
+
+"$TOP/tools/gen_superinstructions.py" "$TOP/tools/sequences.profile" > "$TOP/src/include/vm/vm_superinstructions.h"
@@ -0,0 +1,220 @@
+# Saffire opcode sequence profile: count opcodes # names
+2280 A1,B3 # REG_ADD REG_COMPARE_LT
+2280 B3,B9 # REG_COMPARE_LT REG_JUMP_IF_TRUE
+2280 A1,B3,B9 # REG_ADD REG_COMPARE_LT REG_JUMP_IF_TRUE
+1600 B1,B8 # REG_COMPARE_EQ REG_JUMP_IF_FALSE
+1583 B4,B8 # REG_COMPARE_GT REG_JUMP_IF_FALSE
+1560 B8,B4 # REG_JUMP_IF_FALSE REG_COMPARE_GT
+1560 B9,B1 # REG_JUMP_IF_TRUE REG_COMPARE_EQ
+1560 B1,B8,B4 # REG_COMPARE_EQ REG_JUMP_IF_FALSE REG_COMPARE_GT
+1560 B8,B4,B8 # REG_JUMP_IF_FALSE REG_COMPARE_GT REG_JUMP_IF_FALSE
+1560 B3,B9,B1 # REG_COMPARE_LT REG_JUMP_IF_TRUE REG_COMPARE_EQ
+1560 B9,B1,B8 # REG_JUMP_IF_TRUE REG_COMPARE_EQ REG_JUMP_IF_FALSE
+1200 65,66 # LOAD_VAR LOAD_ATTRIB
+828 71,A1 # JUMP_ABSOLUTE REG_ADD
+820 71,A1,B3 # JUMP_ABSOLUTE REG_ADD REG_COMPARE_LT
+803 B8,A2 # REG_JUMP_IF_FALSE REG_SUBTRACT
+803 B4,B8,A2 # REG_COMPARE_GT REG_JUMP_IF_FALSE REG_SUBTRACT
+795 A2,A1 # REG_SUBTRACT REG_ADD
+795 B8,A2,A1 # REG_JUMP_IF_FALSE REG_SUBTRACT REG_ADD
+780 A1,71 # REG_ADD JUMP_ABSOLUTE
+780 B8,A1 # REG_JUMP_IF_FALSE REG_ADD
+780 B4,B8,A1 # REG_COMPARE_GT REG_JUMP_IF_FALSE REG_ADD
+780 A2,A1,B3 # REG_SUBTRACT REG_ADD REG_COMPARE_LT
+780 B8,A1,71 # REG_JUMP_IF_FALSE REG_ADD JUMP_ABSOLUTE
+780 A1,71,A1 # REG_ADD JUMP_ABSOLUTE REG_ADD
+648 65,67 # LOAD_VAR LOAD_METHOD
+640 5A,A1 # STORE_VAR REG_ADD
+640 65,65 # LOAD_VAR LOAD_VAR
+640 67,83 # LOAD_METHOD CALL_METHOD
+640 5A,A1,B3 # STORE_VAR REG_ADD REG_COMPARE_LT
+640 65,67,83 # LOAD_VAR LOAD_METHOD CALL_METHOD
+604 B9,65 # REG_JUMP_IF_TRUE LOAD_VAR
+602 B3,B9,65 # REG_COMPARE_LT REG_JUMP_IF_TRUE LOAD_VAR
+597 B9,65,65 # REG_JUMP_IF_TRUE LOAD_VAR LOAD_VAR
+440 65,65,67 # LOAD_VAR LOAD_VAR LOAD_METHOD
+400 66,65 # LOAD_ATTRIB LOAD_VAR
+400 65,66,65 # LOAD_VAR LOAD_ATTRIB LOAD_VAR
+400 66,65,66 # LOAD_ATTRIB LOAD_VAR LOAD_ATTRIB
+398 22,5A # BINARY_SUBTRACT_NUM STORE_VAR
+398 23,21 # BINARY_MULTIPLY_NUM BINARY_ADD_NUM
+398 64,23 # LOAD_CONST BINARY_MULTIPLY_NUM
+398 66,23 # LOAD_ATTRIB BINARY_MULTIPLY_NUM
+398 22,5A,A1 # BINARY_SUBTRACT_NUM STORE_VAR REG_ADD
+398 65,66,23 # LOAD_VAR LOAD_ATTRIB BINARY_MULTIPLY_NUM
+238 21,5A # BINARY_ADD_NUM STORE_VAR
+200 65,64 # LOAD_VAR LOAD_CONST
+200 66,53 # LOAD_ATTRIB RETURN_VALUE
+200 65,66,53 # LOAD_VAR LOAD_ATTRIB RETURN_VALUE
+200 65,65,64 # LOAD_VAR LOAD_VAR LOAD_CONST
+199 21,53 # BINARY_ADD_NUM RETURN_VALUE
+199 21,64 # BINARY_ADD_NUM LOAD_CONST
+199 21,65 # BINARY_ADD_NUM LOAD_VAR
+199 23,53 # BINARY_MULTIPLY_NUM RETURN_VALUE
+199 23,65 # BINARY_MULTIPLY_NUM LOAD_VAR
+199 64,22 # LOAD_CONST BINARY_SUBTRACT_NUM
+199 66,22 # LOAD_ATTRIB BINARY_SUBTRACT_NUM
+199 21,5A,A1 # BINARY_ADD_NUM STORE_VAR REG_ADD
+199 66,23,21 # LOAD_ATTRIB BINARY_MULTIPLY_NUM BINARY_ADD_NUM
+199 64,23,21 # LOAD_CONST BINARY_MULTIPLY_NUM BINARY_ADD_NUM
+199 23,21,53 # BINARY_MULTIPLY_NUM BINARY_ADD_NUM RETURN_VALUE
+199 65,64,23 # LOAD_VAR LOAD_CONST BINARY_MULTIPLY_NUM
+199 64,23,53 # LOAD_CONST BINARY_MULTIPLY_NUM RETURN_VALUE
+199 66,22,5A # LOAD_ATTRIB BINARY_SUBTRACT_NUM STORE_VAR
+199 64,22,5A # LOAD_CONST BINARY_SUBTRACT_NUM STORE_VAR
+199 21,64,22 # BINARY_ADD_NUM LOAD_CONST BINARY_SUBTRACT_NUM
+199 65,66,22 # LOAD_VAR LOAD_ATTRIB BINARY_SUBTRACT_NUM
+199 23,65,66 # BINARY_MULTIPLY_NUM LOAD_VAR LOAD_ATTRIB
+199 21,65,66 # BINARY_ADD_NUM LOAD_VAR LOAD_ATTRIB
+199 66,23,65 # LOAD_ATTRIB BINARY_MULTIPLY_NUM LOAD_VAR
+199 23,21,64 # BINARY_MULTIPLY_NUM BINARY_ADD_NUM LOAD_CONST
+80 65,5A # LOAD_VAR STORE_VAR
+79 B9,A1 # REG_JUMP_IF_TRUE REG_ADD
+79 B3,B9,A1 # REG_COMPARE_LT REG_JUMP_IF_TRUE REG_ADD
+55 5A,64 # STORE_VAR LOAD_CONST
+46 04,5A # DUP_TOP STORE_VAR
+46 64,04 # LOAD_CONST DUP_TOP
+46 04,5A,64 # DUP_TOP STORE_VAR LOAD_CONST
+46 64,04,5A # LOAD_CONST DUP_TOP STORE_VAR
+45 64,77 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LT
+45 5A,64,77 # STORE_VAR LOAD_CONST COMPARE_JUMP_IF_FALSE_LT
+43 64,53 # LOAD_CONST RETURN_VALUE
+40 5A,65 # STORE_VAR LOAD_VAR
+40 5A,71 # STORE_VAR JUMP_ABSOLUTE
+40 77,B1 # COMPARE_JUMP_IF_FALSE_LT REG_COMPARE_EQ
+40 A1,65 # REG_ADD LOAD_VAR
+40 B8,65 # REG_JUMP_IF_FALSE LOAD_VAR
+40 65,5A,A1 # LOAD_VAR STORE_VAR REG_ADD
+40 B9,A1,B3 # REG_JUMP_IF_TRUE REG_ADD REG_COMPARE_LT
+40 5A,71,A1 # STORE_VAR JUMP_ABSOLUTE REG_ADD
+40 64,77,B1 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LT REG_COMPARE_EQ
+40 B8,65,65 # REG_JUMP_IF_FALSE LOAD_VAR LOAD_VAR
+40 77,B1,B8 # COMPARE_JUMP_IF_FALSE_LT REG_COMPARE_EQ REG_JUMP_IF_FALSE
+40 B1,B8,65 # REG_COMPARE_EQ REG_JUMP_IF_FALSE LOAD_VAR
+40 65,5A,65 # LOAD_VAR STORE_VAR LOAD_VAR
+40 A1,65,5A # REG_ADD LOAD_VAR STORE_VAR
+40 5A,65,5A # STORE_VAR LOAD_VAR STORE_VAR
+39 B9,64 # REG_JUMP_IF_TRUE LOAD_CONST
+39 B9,64,04 # REG_JUMP_IF_TRUE LOAD_CONST DUP_TOP
+39 21,5A,71 # BINARY_ADD_NUM STORE_VAR JUMP_ABSOLUTE
+39 B3,B9,64 # REG_COMPARE_LT REG_JUMP_IF_TRUE LOAD_CONST
+39 B9,A1,65 # REG_JUMP_IF_TRUE REG_ADD LOAD_VAR
+23 A1,B4 # REG_ADD REG_COMPARE_GT
+23 B4,B9 # REG_COMPARE_GT REG_JUMP_IF_TRUE
+23 A1,B4,B9 # REG_ADD REG_COMPARE_GT REG_JUMP_IF_TRUE
+22 B9,B4 # REG_JUMP_IF_TRUE REG_COMPARE_GT
+22 B9,B4,B8 # REG_JUMP_IF_TRUE REG_COMPARE_GT REG_JUMP_IF_FALSE
+22 B4,B9,B4 # REG_COMPARE_GT REG_JUMP_IF_TRUE REG_COMPARE_GT
+15 A2,A1,B4 # REG_SUBTRACT REG_ADD REG_COMPARE_GT
+12 A1,B5 # REG_ADD REG_COMPARE_LE
+12 A3,A1 # REG_MULTIPLY REG_ADD
+12 B5,B9 # REG_COMPARE_LE REG_JUMP_IF_TRUE
+12 A1,B5,B9 # REG_ADD REG_COMPARE_LE REG_JUMP_IF_TRUE
+12 A3,A1,B5 # REG_MULTIPLY REG_ADD REG_COMPARE_LE
+11 64,64 # LOAD_CONST LOAD_CONST
+11 B9,A3 # REG_JUMP_IF_TRUE REG_MULTIPLY
+11 B5,B9,A3 # REG_COMPARE_LE REG_JUMP_IF_TRUE REG_MULTIPLY
+11 B9,A3,A1 # REG_JUMP_IF_TRUE REG_MULTIPLY REG_ADD
+10 64,5A # LOAD_CONST STORE_VAR
+9 64,5A,64 # LOAD_CONST STORE_VAR LOAD_CONST
+8 65,83 # LOAD_VAR CALL_METHOD
+8 67,65 # LOAD_METHOD LOAD_VAR
+8 83,01 # CALL_METHOD POP_TOP
+8 A2,71 # REG_SUBTRACT JUMP_ABSOLUTE
+8 71,A1,B4 # JUMP_ABSOLUTE REG_ADD REG_COMPARE_GT
+8 A2,71,A1 # REG_SUBTRACT JUMP_ABSOLUTE REG_ADD
+8 65,83,01 # LOAD_VAR CALL_METHOD POP_TOP
+8 B8,A2,71 # REG_JUMP_IF_FALSE REG_SUBTRACT JUMP_ABSOLUTE
+8 65,67,65 # LOAD_VAR LOAD_METHOD LOAD_VAR
+8 67,65,83 # LOAD_METHOD LOAD_VAR CALL_METHOD
+7 01,64 # POP_TOP LOAD_CONST
+7 B9,65,67 # REG_JUMP_IF_TRUE LOAD_VAR LOAD_METHOD
+7 83,01,64 # CALL_METHOD POP_TOP LOAD_CONST
+6 5A,64,04 # STORE_VAR LOAD_CONST DUP_TOP
+4 64,5D # LOAD_CONST STORE_METHOD
+4 64,64,64 # LOAD_CONST LOAD_CONST LOAD_CONST
+4 64,64,5D # LOAD_CONST LOAD_CONST STORE_METHOD
+3 50,64 # BUILD_CLASS LOAD_CONST
+3 51,64 # STORE_CLASS LOAD_CONST
+3 5C,64 # STORE_PROPERTY LOAD_CONST
+3 5D,51 # STORE_METHOD STORE_CLASS
+3 64,50 # LOAD_CONST BUILD_CLASS
+3 64,5C # LOAD_CONST STORE_PROPERTY
+3 64,6C # LOAD_CONST IMPORT
+3 6C,64 # IMPORT LOAD_CONST
+3 77,65 # COMPARE_JUMP_IF_FALSE_LT LOAD_VAR
+3 64,5C,64 # LOAD_CONST STORE_PROPERTY LOAD_CONST
+3 64,77,65 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LT LOAD_VAR
+3 5D,51,64 # STORE_METHOD STORE_CLASS LOAD_CONST
+3 51,64,5A # STORE_CLASS LOAD_CONST STORE_VAR
+3 5A,64,5A # STORE_VAR LOAD_CONST STORE_VAR
+3 01,64,5A # POP_TOP LOAD_CONST STORE_VAR
+3 64,5D,51 # LOAD_CONST STORE_METHOD STORE_CLASS
+3 64,6C,64 # LOAD_CONST IMPORT LOAD_CONST
+3 77,65,65 # COMPARE_JUMP_IF_FALSE_LT LOAD_VAR LOAD_VAR
+3 01,64,53 # POP_TOP LOAD_CONST RETURN_VALUE
+3 64,50,64 # LOAD_CONST BUILD_CLASS LOAD_CONST
+3 64,64,6C # LOAD_CONST LOAD_CONST IMPORT
+2 17,5A # BINARY_ADD STORE_VAR
+2 18,5A # BINARY_SUBTRACT STORE_VAR
+2 19,17 # BINARY_MULTIPLY BINARY_ADD
+2 64,19 # LOAD_CONST BINARY_MULTIPLY
+2 66,19 # LOAD_ATTRIB BINARY_MULTIPLY
+2 18,5A,A1 # BINARY_SUBTRACT STORE_VAR REG_ADD
+2 65,66,19 # LOAD_VAR LOAD_ATTRIB BINARY_MULTIPLY
+2 6C,64,50 # IMPORT LOAD_CONST BUILD_CLASS
+2 50,64,5C # BUILD_CLASS LOAD_CONST STORE_PROPERTY
+1 01,65 # POP_TOP LOAD_VAR
+1 17,53 # BINARY_ADD RETURN_VALUE
+1 17,64 # BINARY_ADD LOAD_CONST
+1 17,65 # BINARY_ADD LOAD_VAR
+1 19,53 # BINARY_MULTIPLY RETURN_VALUE
+1 19,65 # BINARY_MULTIPLY LOAD_VAR
+1 5A,B4 # STORE_VAR REG_COMPARE_GT
+1 5B,64 # STORE_CONST LOAD_CONST
+1 5D,64 # STORE_METHOD LOAD_CONST
+1 64,18 # LOAD_CONST BINARY_SUBTRACT
+1 64,5B # LOAD_CONST STORE_CONST
+1 64,79 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LE
+1 66,18 # LOAD_ATTRIB BINARY_SUBTRACT
+1 77,64 # COMPARE_JUMP_IF_FALSE_LT LOAD_CONST
+1 77,A1 # COMPARE_JUMP_IF_FALSE_LT REG_ADD
+1 79,A3 # COMPARE_JUMP_IF_FALSE_LE REG_MULTIPLY
+1 66,18,5A # LOAD_ATTRIB BINARY_SUBTRACT STORE_VAR
+1 64,18,5A # LOAD_CONST BINARY_SUBTRACT STORE_VAR
+1 17,5A,A1 # BINARY_ADD STORE_VAR REG_ADD
+1 64,79,A3 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LE REG_MULTIPLY
+1 5C,64,5B # STORE_PROPERTY LOAD_CONST STORE_CONST
+1 65,64,19 # LOAD_VAR LOAD_CONST BINARY_MULTIPLY
+1 5A,64,79 # STORE_VAR LOAD_CONST COMPARE_JUMP_IF_FALSE_LE
+1 64,5A,B4 # LOAD_CONST STORE_VAR REG_COMPARE_GT
+1 77,64,04 # COMPARE_JUMP_IF_FALSE_LT LOAD_CONST DUP_TOP
+1 01,65,67 # POP_TOP LOAD_VAR LOAD_METHOD
+1 5A,B4,B8 # STORE_VAR REG_COMPARE_GT REG_JUMP_IF_FALSE
+1 01,64,50 # POP_TOP LOAD_CONST BUILD_CLASS
+1 66,19,65 # LOAD_ATTRIB BINARY_MULTIPLY LOAD_VAR
+1 B4,B9,65 # REG_COMPARE_GT REG_JUMP_IF_TRUE LOAD_VAR
+1 B5,B9,65 # REG_COMPARE_LE REG_JUMP_IF_TRUE LOAD_VAR
+1 6C,64,5A # IMPORT LOAD_CONST STORE_VAR
+1 17,64,18 # BINARY_ADD LOAD_CONST BINARY_SUBTRACT
+1 5B,64,64 # STORE_CONST LOAD_CONST LOAD_CONST
+1 5D,64,64 # STORE_METHOD LOAD_CONST LOAD_CONST
+1 5C,64,64 # STORE_PROPERTY LOAD_CONST LOAD_CONST
+1 50,64,64 # BUILD_CLASS LOAD_CONST LOAD_CONST
+1 65,66,18 # LOAD_VAR LOAD_ATTRIB BINARY_SUBTRACT
+1 64,77,A1 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LT REG_ADD
+1 64,77,64 # LOAD_CONST COMPARE_JUMP_IF_FALSE_LT LOAD_CONST
+1 19,17,64 # BINARY_MULTIPLY BINARY_ADD LOAD_CONST
+1 17,5A,71 # BINARY_ADD STORE_VAR JUMP_ABSOLUTE
+1 19,65,66 # BINARY_MULTIPLY LOAD_VAR LOAD_ATTRIB
+1 17,65,66 # BINARY_ADD LOAD_VAR LOAD_ATTRIB
+1 83,01,65 # CALL_METHOD POP_TOP LOAD_VAR
+1 77,A1,65 # COMPARE_JUMP_IF_FALSE_LT REG_ADD LOAD_VAR
+1 64,5B,64 # LOAD_CONST STORE_CONST LOAD_CONST
+1 64,5D,64 # LOAD_CONST STORE_METHOD LOAD_CONST
+1 66,19,17 # LOAD_ATTRIB BINARY_MULTIPLY BINARY_ADD
+1 64,19,17 # LOAD_CONST BINARY_MULTIPLY BINARY_ADD
+1 79,A3,A1 # COMPARE_JUMP_IF_FALSE_LE REG_MULTIPLY REG_ADD
+1 19,17,53 # BINARY_MULTIPLY BINARY_ADD RETURN_VALUE
+1 64,19,53 # LOAD_CONST BINARY_MULTIPLY RETURN_VALUE
+1 5C,64,5C # STORE_PROPERTY LOAD_CONST STORE_PROPERTY
@@ -221,33 +221,41 @@ class UnitTester {
         $pattern = "/^\@\@+/m";
         $tests = preg_split($pattern, $body);
 
+        // Every test runs once for each set of arguments, separated by |
+        $arguments = array("");
+        if (isset($this->_current['tags']['arguments'])) {
+            $arguments = array_map("trim", explode("|", $this->_current['tags']['arguments']));
+        }
+
         foreach ($tests as $test) {
-            // Run the actual test
-            $result = $this->_runFunctionalTest($test);
-            $this->_results['total_tests']++;
-
-            switch ($result) {
-                case self::PASS :
-                    $this->_results['passed']++;
-                    break;
-                case self::FAIL :
-                    $this->_results['failed']++;
-                    break;
-                case self::IGNORE :
-                    $this->_results['ignored']++;
-                    break;
-                case self::SKIP :
-                    $this->_results['skipped']++;
-                    break;
+            foreach ($arguments as $argument) {
+                // Run the actual test
+                $result = $this->_runFunctionalTest($test, $argument);
+                $this->_results['total_tests']++;
+
+                switch ($result) {
+                    case self::PASS :
+                        $this->_results['passed']++;
+                        break;
+                    case self::FAIL :
+                        $this->_results['failed']++;
+                        break;
+                    case self::IGNORE :
+                        $this->_results['ignored']++;
+                        break;
+                    case self::SKIP :
+                        $this->_results['skipped']++;
+                        break;
+                }
+                $this->_output($result);
             }
-            $this->_output($result);
         }
     }
 
 
     /**
      */
-    protected function _runFunctionalTest($test) {
+    protected function _runFunctionalTest($test, $arguments = "") {
         $tmpDir = sys_get_temp_dir();
 
         // Don't expect any output
@@ -269,7 +277,7 @@ class UnitTester {
 
         // Run saffire test
         $ret = self::FAIL;  // Assume the worst
-        exec($this->_saffireBinary." ".$tmpFile.".sf > ".$tmpFile.".out 2>&1", $output, $result);
+        exec($this->_saffireBinary." ".($arguments ? $arguments." " : "").$tmpFile.".sf > ".$tmpFile.".out 2>&1", $output, $result);
 
         // No output expected and result is not 0. So FAIL
         if (! $outputExpected && $result != 0) {
@@ -289,7 +297,7 @@ class UnitTester {
             exec("/usr/bin/diff --suppress-common-lines ".$tmpFile.".out ".$tmpFile.".exp", $output, $result);
             if ($result != 0) {
                 $tmp = "";
-                $tmp .= "Error in ".$this->_current['filename']."\n";
+                $tmp .= "Error in ".$this->_current['filename'].($arguments ? " (arguments: ".$arguments.")" : "")."\n";
                 $tmp .= join("\n", $output);
                 $tmp .= "\n";
 